@@ -0,0 +1,34 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Helpers shared by the host benchmarks
+
+// Returns monotonic time in nanoseconds
+static inline uint64_t bench_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// Prints time per operation of a finished run
+static inline void bench_report(const char *name, const uint64_t operations, const uint64_t elapsedNs)
+{
+    printf("%-32s %10llu ops %12.1f ns/op\n", name, (unsigned long long)operations, operations ? (double)elapsedNs / operations : 0.0);
+}
+
+// Returns iteration count given as first argument (or fallback)
+static inline uint64_t bench_iterations(const int argc, char **argv, const int index, const uint64_t fallback)
+{
+    return (argc > index) ? strtoull(argv[index], NULL, 10) : fallback;
+}
+
+// Keeps the compiler from optimizing away benchmarked results
+static volatile double benchSink;
+
+#endif // BENCH_H_
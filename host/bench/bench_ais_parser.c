@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "ais_parser.h"
+
+#define OWN_MMSI 245242000
+#define CAPTURE_MARKER "AISCAP\t"
+#define MAX_MESSAGES 4096
+
+// Typical messages of aisstream.io, used if no capture is given
+static const char *SAMPLE_MESSAGES[] = {
+    "{\"Message\":{\"PositionReport\":{\"Cog\":123.4,\"CommunicationState\":59916,\"Latitude\":53.5743,\"Longitude\":9.6826,\"MessageID\":1,"
+    "\"NavigationalStatus\":0,\"PositionAccuracy\":true,\"Raim\":false,\"RateOfTurn\":0,\"RepeatIndicator\":0,\"Sog\":5.2,\"Spare\":0,"
+    "\"SpecialManoeuvreIndicator\":0,\"Timestamp\":31,\"TrueHeading\":125,\"UserID\":245242000,\"Valid\":true}},\"MessageType\":\"PositionReport\","
+    "\"MetaData\":{\"MMSI\":245242000,\"MMSI_String\":245242000,\"ShipName\":\"MY BOAT             \",\"latitude\":53.5743,\"longitude\":9.6826,"
+    "\"time_utc\":\"2024-10-18 12:34:56.123456789 +0000 UTC\"}}",
+    "{\"Message\":{\"PositionReport\":{\"Cog\":360,\"Latitude\":53.541,\"Longitude\":9.91,\"MessageID\":3,\"NavigationalStatus\":5,\"Sog\":0,"
+    "\"TrueHeading\":511,\"UserID\":211234560,\"Valid\":true}},\"MessageType\":\"PositionReport\","
+    "\"MetaData\":{\"MMSI\":211234560,\"MMSI_String\":211234560,\"ShipName\":\"HARBOUR FERRY\",\"latitude\":53.541,\"longitude\":9.91,"
+    "\"time_utc\":\"2024-10-18 12:34:57.000000000 +0000 UTC\"}}",
+    "{\"Message\":{\"ShipStaticData\":{\"CallSign\":\"DABC\",\"Destination\":\"HAMBURG\",\"MessageID\":5,\"Name\":\"MY BOAT\",\"Type\":37,"
+    "\"UserID\":245242000,\"Valid\":true}},\"MessageType\":\"ShipStaticData\",\"MetaData\":{\"MMSI\":245242000,\"ShipName\":\"MY BOAT\","
+    "\"latitude\":53.5743,\"longitude\":9.6826,\"time_utc\":\"2024-10-18 12:35:00.000000000 +0000 UTC\"}}",
+};
+
+static char *messages[MAX_MESSAGES];
+static size_t lengths[MAX_MESSAGES];
+
+// Loads messages of a capture (see CONFIG_AIS_CAPTURE and tools/ais_replay_server.py). Returns amount loaded
+static size_t load_capture(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    size_t count = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    while (count < MAX_MESSAGES && getline(&line, &capacity, file) > 0)
+    {
+        char *start = strstr(line, CAPTURE_MARKER);
+        char *payload = (start != NULL) ? strchr(start + strlen(CAPTURE_MARKER), '\t') : NULL;
+        if (payload == NULL)
+        {
+            continue; // Other log output
+        }
+        payload++;
+        payload[strcspn(payload, "\r\n")] = '\0';
+        lengths[count] = strlen(payload);
+        messages[count] = strdup(payload);
+        count++;
+    }
+    free(line);
+    fclose(file);
+    return count;
+}
+
+// Usage: bench_ais_parser [capture.log] [iterations]
+int main(int argc, char **argv)
+{
+    size_t count = 0;
+    if (argc > 1)
+    {
+        count = load_capture(argv[1]);
+    }
+    else
+    {
+        for (; count < sizeof(SAMPLE_MESSAGES) / sizeof(SAMPLE_MESSAGES[0]); count++)
+        {
+            messages[count] = strdup(SAMPLE_MESSAGES[count]);
+            lengths[count] = strlen(messages[count]);
+        }
+    }
+    if (count == 0)
+    {
+        fprintf(stderr, "No messages found\n");
+        return 1;
+    }
+    const uint64_t iterations = bench_iterations(argc, argv, 2, 200000);
+
+    uint64_t types[AIS_MESSAGE_TRAFFIC + 1] = {0};
+    size_t bytes = 0;
+    struct AIS_MESSAGE message = {.own = {.course = -1}};
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        size_t index = i % count;
+        types[ais_parse_message(messages[index], lengths[index], OWN_MMSI, true, &message)]++;
+        bytes += lengths[index];
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("ais_parse_message", iterations, elapsed);
+    printf("%.1f MB/s, %zu distinct messages\n", bytes / (elapsed / 1e9) / 1e6, count);
+    printf("own %llu, traffic %llu, corrupt %llu, error %llu, invalid %llu, ignored %llu\n",
+           (unsigned long long)types[AIS_MESSAGE_OWN], (unsigned long long)types[AIS_MESSAGE_TRAFFIC], (unsigned long long)types[AIS_MESSAGE_CORRUPT],
+           (unsigned long long)types[AIS_MESSAGE_ERROR], (unsigned long long)types[AIS_MESSAGE_INVALID], (unsigned long long)types[AIS_MESSAGE_IGNORED]);
+    benchSink = message.own.latitude + message.traffic.longitude;
+    return 0;
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "stored_state.h"
+
+// Usage: bench_stored_state [iterations]
+int main(int argc, char **argv)
+{
+    const uint64_t iterations = bench_iterations(argc, argv, 1, 10000000);
+
+    struct StoredState original = {.version = STORED_STATE_VERSION, .positionValid = true, .mmsiValid = true, .latitude = 53.5743, .longitude = 9.6826};
+    strcpy(original.mmsi, "245242000");
+
+    uint64_t valid = 0;
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        struct StoredState decoded;
+        valid += stored_state_decode(&original, sizeof(original), &decoded);
+    }
+    bench_report("stored_state_decode", iterations, bench_now_ns() - start);
+
+    // Position every second, flushed every 300 s: counts how many writes remain
+    struct FlushSchedule schedule = {0};
+    uint64_t writes = 0;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        int64_t now = (int64_t)i * 1000000;
+        flush_schedule_mark(&schedule, now, 300 * 1000000LL);
+        if (now >= schedule.due && flush_schedule_take(&schedule))
+        {
+            writes++;
+        }
+    }
+    bench_report("flush_schedule_mark/take", iterations, bench_now_ns() - start);
+
+    printf("valid %llu, %llu position updates caused %llu writes\n", (unsigned long long)valid, (unsigned long long)iterations, (unsigned long long)writes);
+    return 0;
+}
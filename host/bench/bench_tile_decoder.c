@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "png_writer.h"
+#include "tile_decoder.h"
+
+#define MAX_PNG_SIZE (1024 * 1024)
+#define ARENA_SIZE 53248 // Default of CONFIG_TILE_DECODER_ARENA_SIZE
+
+static uint8_t png[MAX_PNG_SIZE];
+static uint16_t pixels[TILE_PIXELS];
+
+// Creates an RGB tile with a gradient. Returns its size
+static size_t create_test_png()
+{
+    static uint8_t rgb[TILE_PIXELS * 3];
+    for (int y = 0; y < TILE_SIZE; y++)
+    {
+        for (int x = 0; x < TILE_SIZE; x++)
+        {
+            uint8_t *pixel = &rgb[(y * TILE_SIZE + x) * 3];
+            pixel[0] = (uint8_t)x;
+            pixel[1] = (uint8_t)y;
+            pixel[2] = (uint8_t)(x ^ y);
+        }
+    }
+    return png_writer_write_tile(rgb, png);
+}
+
+// Usage: bench_tile_decoder [tile.png] [iterations] [slice_us]. Without a file a generated (uncompressed) tile is used
+int main(int argc, char **argv)
+{
+    size_t length = 0;
+    if (argc > 1)
+    {
+        FILE *file = fopen(argv[1], "rb");
+        if (file == NULL)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+        length = fread(png, 1, sizeof(png), file);
+        fclose(file);
+    }
+    else
+    {
+        length = create_test_png();
+    }
+    const uint64_t iterations = bench_iterations(argc, argv, 2, 200);
+
+    static uint8_t arenaMemory[ARENA_SIZE];
+    if (tile_decoder_init(arenaMemory, sizeof(arenaMemory)) != ESP_OK)
+    {
+        return 1;
+    }
+
+    uint64_t failed = 0;
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        failed += tile_decode(png, length, pixels) != ESP_OK;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("tile_decode", iterations, elapsed);
+
+    // Sliced like on the device (TILE_DECODE_SLICE_US), has to give the same pixels
+    static uint16_t slicedPixels[TILE_PIXELS];
+    const uint32_t budgetUs = (uint32_t)bench_iterations(argc, argv, 3, 100);
+    uint64_t slices = 0;
+    uint64_t slicedStart = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        esp_err_t ret;
+        tile_decode_begin(png, length, slicedPixels);
+        do
+        {
+            ret = tile_decode_continue(budgetUs);
+            slices++;
+        } while (ret == ESP_ERR_NOT_FINISHED);
+        failed += ret != ESP_OK;
+    }
+    bench_report("tile_decode sliced", iterations, bench_now_ns() - slicedStart);
+    failed += memcmp(pixels, slicedPixels, sizeof(pixels)) != 0;
+    struct TileDecoderStats stats;
+    tile_decoder_get_stats(&stats);
+    printf("arena: %zu of %zu bytes used at most, %u heap allocations\n", stats.arenaPeak, stats.arenaSize, (unsigned)stats.heapAllocations);
+    printf("slices of %u us: %.1f per tile, longest %u us\n", (unsigned)budgetUs, (double)slices / iterations, (unsigned)stats.longestSliceUs);
+    printf("%.2f ms/tile, %.1f Mpixel/s, %zu bytes PNG, %llu failed, pixel[255,255] 0x%04x\n",
+           elapsed / 1e6 / iterations, (double)TILE_PIXELS * iterations / (elapsed / 1e3), length, (unsigned long long)failed, pixels[TILE_PIXELS - 1]);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "tile_math.h"
+
+#define ACCURACY_ZOOM 19 // Highest zoom level of OpenStreetMap
+#define ACCURACY_SAMPLES 2000000
+#define MAX_ERROR_PIXELS 0.05 // Error bound the kernel is designed for
+
+// Pseudo random numbers (xorshift), so that runs are comparable
+static uint32_t randomState = 2463534242u;
+static uint32_t next_random()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+// Returns random value in [min, max]
+static double random_between(const double min, const double max)
+{
+    return min + (max - min) * next_random() / 4294967295.0;
+}
+
+// Compares the kernel against the double precision reference (fractional pixels at ACCURACY_ZOOM). Returns false if out of bounds
+static bool check_accuracy()
+{
+    const double pixelsPerUnit = ldexp(1.0, ACCURACY_ZOOM + 8 - 32);
+    double maxErrorX = 0;
+    double maxErrorY = 0;
+    double maxErrorLatitude = 0;
+    uint64_t tileMismatches = 0;
+    for (int i = 0; i < ACCURACY_SAMPLES; i++)
+    {
+        // Half of the samples near the poles, where the projection is steepest
+        double latitude = (i % 2) ? random_between(-85.05, 85.05) : random_between(80.0, 85.0511) * ((i % 4) ? -1 : 1);
+        double longitude = random_between(-179.9999, 179.9999);
+        // Compare positions exactly representable in 1e-7 degrees, rounding of input isn't an error of the kernel
+        latitude = DEGREES_TO_E7(latitude) * 1e-7;
+        longitude = DEGREES_TO_E7(longitude) * 1e-7;
+
+        double xReference;
+        double yReference;
+        position_to_tile_fraction(latitude, longitude, ACCURACY_ZOOM, &xReference, &yReference);
+        struct WorldPoint point;
+        position_to_world(latitude, longitude, &point);
+        double errorX = fabs(point.x * pixelsPerUnit - xReference * 256);
+        double errorY = fabs(point.y * pixelsPerUnit - yReference * 256);
+        maxErrorX = fmax(maxErrorX, errorX);
+        maxErrorY = fmax(maxErrorY, errorY);
+        if (fabs(latitude) < 80)
+        {
+            maxErrorLatitude = fmax(maxErrorLatitude, errorY);
+        }
+
+        int xTile;
+        int yTile;
+        position_to_tile_coordinates(latitude, longitude, ACCURACY_ZOOM, &xTile, &yTile);
+        // Closer to a tile border than the kernel's error, both results are fine
+        const double borderTiles = MAX_ERROR_PIXELS / 256;
+        bool onBorder = fabs(xReference - round(xReference)) < borderTiles || fabs(yReference - round(yReference)) < borderTiles;
+        tileMismatches += !onBorder && ((xTile != (int)xReference) || (yTile != (int)yReference));
+    }
+    printf("accuracy at zoom %d (%d samples): max error x %.5f px, y %.5f px (%.5f px below 80 degrees), %llu tile mismatches\n",
+           ACCURACY_ZOOM, ACCURACY_SAMPLES, maxErrorX, maxErrorY, maxErrorLatitude, (unsigned long long)tileMismatches);
+    return maxErrorX < MAX_ERROR_PIXELS && maxErrorY < MAX_ERROR_PIXELS && tileMismatches == 0;
+}
+
+// Usage: bench_tile_math [iterations]
+int main(int argc, char **argv)
+{
+    const uint64_t iterations = bench_iterations(argc, argv, 1, 1000000);
+    const int zoom = 14;
+
+    uint64_t start = bench_now_ns();
+    tile_math_init();
+    bench_report("tile_math_init", 1, bench_now_ns() - start);
+    bool accurate = check_accuracy();
+
+    // Positions spread over a harbour area, so that tile changes happen now and then
+    double sum = 0;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        double x;
+        double y;
+        position_to_tile_fraction(53.5 + (i % 1000) * 0.0001, 9.6 + (i % 997) * 0.0001, zoom, &x, &y);
+        sum += x + y;
+    }
+    bench_report("position_to_tile_fraction", iterations, bench_now_ns() - start);
+
+    uint64_t pixelSum = 0;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        struct WorldPoint point;
+        int32_t x;
+        int32_t y;
+        position_to_world(53.5 + (i % 1000) * 0.0001, 9.6 + (i % 997) * 0.0001, &point);
+        world_to_pixel(&point, zoom, &x, &y);
+        pixelSum += x + y;
+    }
+    bench_report("position_to_world+world_to_pixel", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        struct WorldPoint point;
+        position_e7_to_world(535000000 + (i % 1000) * 1000, 96000000 + (i % 997) * 1000, &point);
+        pixelSum += point.x + point.y;
+    }
+    bench_report("position_e7_to_world", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        sum += tile_to_latitude(5300 + (i % 1000) * 0.01, zoom) + tile_to_longitude(8600 + (i % 1000) * 0.01, zoom);
+    }
+    bench_report("tile_to_latitude/longitude", iterations, bench_now_ns() - start);
+
+    uint64_t needed = 0;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        double latitude = 53.5 + (i % 1000) * 0.0001;
+        needed += new_tiles_for_position_needed(latitude, 9.6, zoom, latitude + 0.0001, 9.6001, zoom);
+    }
+    bench_report("new_tiles_for_position_needed", iterations, bench_now_ns() - start);
+
+    benchSink = sum + pixelSum;
+    printf("checksum %.3f, tile changes %llu\n", sum + pixelSum, (unsigned long long)needed);
+    return accurate ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "tile_decoder.h"
+#include "tile_rle.h"
+
+#define CHUNK_SIZE 4096 // Like PROXY_CHUNK_SIZE of the downloader
+
+static uint16_t source[TILE_PIXELS];
+static uint16_t tile[TILE_PIXELS];
+static uint8_t encoded[TILE_RLE_MAGIC_LENGTH + TILE_RLE_MAX_ENCODED(TILE_PIXELS)];
+
+// Stream like the one of tools/tile_proxy.py. Returns length
+static size_t encode(const uint16_t *pixels, uint8_t *out)
+{
+    memcpy(out, TILE_RLE_MAGIC, TILE_RLE_MAGIC_LENGTH);
+    return TILE_RLE_MAGIC_LENGTH + tile_rle_encode(pixels, TILE_PIXELS, out + TILE_RLE_MAGIC_LENGTH);
+}
+
+// Map like content: areas of flat color crossed by roads and a bit of text like noise
+static void generate_tile()
+{
+    srand(1);
+    for (int y = 0; y < TILE_SIZE; y++)
+    {
+        for (int x = 0; x < TILE_SIZE; x++)
+        {
+            uint16_t color = (x + y < 300) ? 0xAEBF : 0xF79E; // Water and land
+            if (abs(x - 2 * y + 100) < 4 || abs(y - 180) < 3)
+            {
+                color = 0xFFFF;
+            }
+            if (x > 40 && x < 120 && y > 30 && y < 40 && (rand() & 3) == 0)
+            {
+                color = 0x4208;
+            }
+            source[y * TILE_SIZE + x] = color;
+        }
+    }
+}
+
+// Decodes the stream in chunks of given size. Returns true if the tile is complete
+static bool decode(const uint8_t *data, const size_t length, const size_t chunkSize)
+{
+    struct TileRleDecoder decoder;
+    tile_rle_begin(&decoder, tile, TILE_PIXELS);
+    for (size_t offset = 0; offset < length; offset += chunkSize)
+    {
+        size_t size = (length - offset < chunkSize) ? length - offset : chunkSize;
+        if (!tile_rle_feed(&decoder, &data[offset], size))
+        {
+            return false;
+        }
+    }
+    return tile_rle_finish(&decoder);
+}
+
+// Usage: bench_tile_rle [iterations] [tile.rle (from tools/tile_proxy.py --cache-dir)]
+int main(int argc, char **argv)
+{
+    const uint64_t iterations = bench_iterations(argc, argv, 1, 2000);
+    generate_tile();
+    size_t length = encode(source, encoded);
+    bool valid = true;
+    for (size_t chunkSize = 1; chunkSize <= 7; chunkSize++)
+    {
+        valid = valid && decode(encoded, length, chunkSize) && memcmp(tile, source, sizeof(tile)) == 0;
+    }
+    valid = valid && decode(encoded, length, CHUNK_SIZE) && memcmp(tile, source, sizeof(tile)) == 0;
+    valid = valid && !decode(encoded, length - 1, CHUNK_SIZE); // Truncated
+    encoded[0] = 'X';
+    valid = valid && !decode(encoded, length, CHUNK_SIZE); // No tile (e.g. error page)
+    encoded[0] = TILE_RLE_MAGIC[0];
+
+    // Worst case: noise
+    static uint16_t noise[TILE_PIXELS];
+    for (size_t i = 0; i < TILE_PIXELS; i++)
+    {
+        noise[i] = (i % 7 == 0) ? noise[i - (i > 0)] : (uint16_t)rand();
+    }
+    size_t noiseLength = encode(noise, encoded);
+    valid = valid && noiseLength <= sizeof(encoded) && decode(encoded, noiseLength, CHUNK_SIZE) && memcmp(tile, noise, sizeof(tile)) == 0;
+    length = encode(source, encoded);
+    printf("round trip in chunks: %s\n", valid ? "ok" : "FAILED");
+
+    if (argc > 2)
+    {
+        FILE *file = fopen(argv[2], "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Cannot open %s\n", argv[2]);
+            return 1;
+        }
+        length = fread(encoded, 1, sizeof(encoded), file);
+        fclose(file);
+        if (!decode(encoded, length, CHUNK_SIZE))
+        {
+            fprintf(stderr, "%s is no valid tile\n", argv[2]);
+            return 1;
+        }
+    }
+    printf("tile: %zu bytes RLE, %zu bytes raw\n", length, sizeof(tile));
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        decode(encoded, length, CHUNK_SIZE);
+    }
+    bench_report("tile_rle decode", iterations, bench_now_ns() - start);
+
+    static uint8_t reencoded[sizeof(encoded)];
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        benchSink = encode(source, reencoded);
+    }
+    bench_report("tile_rle_encode", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        memcpy(tile, source, sizeof(tile));
+        benchSink = tile[i % TILE_PIXELS];
+    }
+    bench_report("memcpy of raw tile", iterations, bench_now_ns() - start);
+    benchSink = tile[TILE_PIXELS - 1];
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tile_cache.h"
+#include "tile_decoder.h"
+#include "tile_synth.h"
+
+#define CACHE_TILES 20
+
+static uint16_t children[4][TILE_PIXELS];
+static uint16_t tile[TILE_PIXELS];
+
+// Usage: bench_tile_synth [iterations]
+int main(int argc, char **argv)
+{
+    const uint64_t iterations = bench_iterations(argc, argv, 1, 500);
+    srand(1);
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < TILE_PIXELS; j++)
+        {
+            children[i][j] = (uint16_t)rand();
+        }
+    }
+    const uint16_t *sources[4] = {children[0], children[1], children[2], children[3]};
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        tile_synth_downsample(sources, tile);
+    }
+    bench_report("tile_synth_downsample", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        tile_synth_upscale(children[0], i & 1, (i >> 1) & 1, tile);
+    }
+    bench_report("tile_synth_upscale", iterations, bench_now_ns() - start);
+
+    void *memory = malloc(tile_cache_memory_size(CACHE_TILES));
+    tile_cache_init(memory, CACHE_TILES);
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        tile_cache_put(14, (int)(i % (CACHE_TILES * 2)), 5300, tile);
+    }
+    bench_report("tile_cache_put", iterations, bench_now_ns() - start);
+
+    uint64_t hits = 0;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations * 100; i++)
+    {
+        hits += tile_cache_find(14, (int)(i % (CACHE_TILES * 2)), 5300) != NULL;
+    }
+    bench_report("tile_cache_find", iterations * 100, bench_now_ns() - start);
+    printf("cache hits %llu of %llu\n", (unsigned long long)hits, (unsigned long long)iterations * 100);
+    free(memory);
+    benchSink = tile[TILE_PIXELS - 1];
+    return 0;
+}
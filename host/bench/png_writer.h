@@ -0,0 +1,111 @@
+#ifndef PNG_WRITER_H_
+#define PNG_WRITER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tile_decoder.h"
+
+// Writes RGB tiles as PNG with uncompressed deflate blocks, so that benchmarks and tests need no encoder library
+
+#define PNG_WRITER_RAW_SIZE (TILE_SIZE * (1 + TILE_SIZE * 3)) // Filter byte and RGB pixels of every row
+#define PNG_WRITER_MAX_SIZE (PNG_WRITER_RAW_SIZE + PNG_WRITER_RAW_SIZE / 65535 * 5 + 128)
+
+static uint32_t pngWriterCrcTable[256];
+
+static uint32_t png_writer_crc(const uint8_t *data, const size_t length)
+{
+    if (pngWriterCrcTable[1] == 0)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            pngWriterCrcTable[n] = c;
+        }
+    }
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++)
+    {
+        c = pngWriterCrcTable[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+static size_t png_writer_put_u32(uint8_t *out, const uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+    return 4;
+}
+
+// Appends a chunk (type and data) to out. Returns its size
+static size_t png_writer_put_chunk(uint8_t *out, const char *type, const uint8_t *data, const size_t length)
+{
+    size_t size = png_writer_put_u32(out, (uint32_t)length);
+    memcpy(out + size, type, 4);
+    if (length > 0)
+    {
+        memcpy(out + size + 4, data, length);
+    }
+    size += 4 + length;
+    return size + png_writer_put_u32(out + size, png_writer_crc(out + 4, length + 4));
+}
+
+// Writes a tile of RGB pixels (TILE_SIZE x TILE_SIZE, 3 bytes each) into png (PNG_WRITER_MAX_SIZE bytes). Returns its size
+static size_t png_writer_write_tile(const uint8_t *rgb, uint8_t *png)
+{
+    static uint8_t raw[PNG_WRITER_RAW_SIZE];
+    static uint8_t zlib[PNG_WRITER_MAX_SIZE];
+    size_t rawLength = 0;
+    for (int y = 0; y < TILE_SIZE; y++)
+    {
+        raw[rawLength++] = 0; // Filter: none
+        memcpy(raw + rawLength, rgb + y * TILE_SIZE * 3, TILE_SIZE * 3);
+        rawLength += TILE_SIZE * 3;
+    }
+
+    size_t zlibLength = 0;
+    zlib[zlibLength++] = 0x78;
+    zlib[zlibLength++] = 0x01;
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t offset = 0; offset < rawLength; offset += 65535)
+    {
+        size_t block = (rawLength - offset > 65535) ? 65535 : rawLength - offset;
+        zlib[zlibLength++] = (offset + block == rawLength) ? 1 : 0; // Stored block, last one flagged
+        zlib[zlibLength++] = block & 0xFF;
+        zlib[zlibLength++] = block >> 8;
+        zlib[zlibLength++] = ~block & 0xFF;
+        zlib[zlibLength++] = (~block >> 8) & 0xFF;
+        memcpy(zlib + zlibLength, raw + offset, block);
+        zlibLength += block;
+    }
+    for (size_t i = 0; i < rawLength; i++)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    zlibLength += png_writer_put_u32(zlib + zlibLength, (b << 16) | a);
+
+    static const uint8_t SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t header[13] = {0};
+    png_writer_put_u32(header, TILE_SIZE);
+    png_writer_put_u32(header + 4, TILE_SIZE);
+    header[8] = 8; // Bit depth
+    header[9] = 2; // RGB
+
+    size_t size = sizeof(SIGNATURE);
+    memcpy(png, SIGNATURE, size);
+    size += png_writer_put_chunk(png + size, "IHDR", header, sizeof(header));
+    size += png_writer_put_chunk(png + size, "IDAT", zlib, zlibLength);
+    size += png_writer_put_chunk(png + size, "IEND", NULL, 0);
+    return size;
+}
+
+#endif // PNG_WRITER_H_
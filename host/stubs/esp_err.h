@@ -0,0 +1,20 @@
+#ifndef HOST_ESP_ERR_H_
+#define HOST_ESP_ERR_H_
+
+// Minimal stand-in for ESP-IDF's esp_err.h on host builds
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FINISHED 0x10C
+
+static inline const char *esp_err_to_name(const esp_err_t code)
+{
+    return (code == ESP_OK) ? "ESP_OK" : "ESP_FAIL";
+}
+
+#endif // HOST_ESP_ERR_H_
@@ -0,0 +1,28 @@
+#ifndef HOST_ESP_LOG_H_
+#define HOST_ESP_LOG_H_
+
+#include <stdio.h>
+
+// Minimal stand-in for ESP-IDF's esp_log.h on host builds. Silent by default so that logging doesn't dominate
+// benchmarks, configure with -DHOST_LOG_LEVEL=<0..5> (0: none, 1: errors, ..., 5: verbose)
+
+#ifndef HOST_LOG_LEVEL
+#define HOST_LOG_LEVEL 0
+#endif
+
+#define HOST_LOG(level, letter, tag, format, ...)                                 \
+    do                                                                            \
+    {                                                                             \
+        if (HOST_LOG_LEVEL >= (level))                                            \
+        {                                                                         \
+            fprintf(stderr, letter " (%s): " format "\n", tag, ##__VA_ARGS__);    \
+        }                                                                         \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG(5, "V", tag, format, ##__VA_ARGS__)
+
+#endif // HOST_ESP_LOG_H_
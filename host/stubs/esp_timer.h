@@ -0,0 +1,17 @@
+#ifndef HOST_ESP_TIMER_H_
+#define HOST_ESP_TIMER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+// Minimal stand-in for ESP-IDF's esp_timer.h on host builds
+
+// Returns monotonic time in microseconds
+static inline int64_t esp_timer_get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+#endif // HOST_ESP_TIMER_H_
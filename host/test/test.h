@@ -0,0 +1,60 @@
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+// Assertions of the host tests (run by ctest). A failed check is reported with its location and the test goes on, so that
+// one run shows all failures. main returns test_result()
+
+static int testChecks;
+static int testFailures;
+
+#define CHECK(condition)                                                                   \
+    do                                                                                     \
+    {                                                                                      \
+        testChecks++;                                                                      \
+        if (!(condition))                                                                  \
+        {                                                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);  \
+            testFailures++;                                                                \
+        }                                                                                  \
+    } while (0)
+
+// Compares integers and prints both values if they differ
+#define CHECK_EQUAL(expected, actual)                                                                          \
+    do                                                                                                         \
+    {                                                                                                          \
+        long long expectedValue = (long long)(expected);                                                       \
+        long long actualValue = (long long)(actual);                                                           \
+        testChecks++;                                                                                          \
+        if (expectedValue != actualValue)                                                                      \
+        {                                                                                                      \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %s (%lld)\n", __FILE__, __LINE__, #actual, actualValue, \
+                    #expected, expectedValue);                                                                 \
+            testFailures++;                                                                                    \
+        }                                                                                                      \
+    } while (0)
+
+// Compares doubles with a tolerance
+#define CHECK_NEAR(expected, actual, tolerance)                                                                  \
+    do                                                                                                           \
+    {                                                                                                            \
+        double expectedValue = (expected);                                                                       \
+        double actualValue = (actual);                                                                           \
+        testChecks++;                                                                                            \
+        if (!(actualValue >= expectedValue - (tolerance) && actualValue <= expectedValue + (tolerance)))         \
+        {                                                                                                        \
+            fprintf(stderr, "%s:%d: %s is %.9f, expected %.9f +- %g\n", __FILE__, __LINE__, #actual, actualValue, \
+                    expectedValue, (double)(tolerance));                                                         \
+            testFailures++;                                                                                      \
+        }                                                                                                        \
+    } while (0)
+
+// Prints the summary. Returns the exit code of the test
+static inline int test_result(const char *name)
+{
+    printf("%s: %d checks, %d failed\n", name, testChecks, testFailures);
+    return testFailures ? 1 : 0;
+}
+
+#endif // TEST_H_
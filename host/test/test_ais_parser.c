@@ -0,0 +1,116 @@
+#include <string.h>
+
+#include "ais_parser.h"
+#include "test.h"
+
+#define OWN_MMSI 245242000
+
+static const char *OWN_POSITION =
+    "{\"Message\":{\"PositionReport\":{\"Cog\":123.4,\"Latitude\":53.5743,\"Longitude\":9.6826,\"MessageID\":1,\"Sog\":5.2,"
+    "\"TrueHeading\":125,\"UserID\":245242000,\"Valid\":true}},\"MessageType\":\"PositionReport\","
+    "\"MetaData\":{\"MMSI\":245242000,\"ShipName\":\"MY BOAT\",\"latitude\":53.5743,\"longitude\":9.6826,"
+    "\"time_utc\":\"2024-10-18 12:34:56.123456789 +0000 UTC\"}}";
+
+static const char *OTHER_POSITION =
+    "{\"Message\":{\"PositionReport\":{\"Cog\":360,\"Latitude\":53.541,\"Longitude\":9.91,\"TrueHeading\":90}},"
+    "\"MessageType\":\"PositionReport\",\"MetaData\":{\"MMSI\":211234560,\"ShipName\":\"HARBOUR FERRY\",\"latitude\":53.541,"
+    "\"longitude\":9.91,\"time_utc\":\"2024-10-18 12:34:57.000000000 +0000 UTC\"}}";
+
+static enum AIS_MESSAGE_TYPE parse(const char *json, const bool trafficMode, struct AIS_MESSAGE *message)
+{
+    return ais_parse_message(json, strlen(json), OWN_MMSI, trafficMode, message);
+}
+
+static void test_own_position()
+{
+    struct AIS_MESSAGE message;
+    memset(&message, 0, sizeof(message));
+    CHECK_EQUAL(AIS_MESSAGE_OWN, parse(OWN_POSITION, true, &message));
+    CHECK_EQUAL(OWN_MMSI, message.own.mmsi);
+    CHECK_NEAR(53.5743, message.own.latitude, 0);
+    CHECK_NEAR(9.6826, message.own.longitude, 0);
+    CHECK_NEAR(123.4, message.own.course, 0);
+    CHECK(strcmp(message.own.shipName, "MY BOAT") == 0);
+    CHECK(strcmp(message.own.time_utc, "2024-10-18 12:34:56.123456789 +0000 UTC") == 0);
+}
+
+// Messages get parsed in the receive buffer, which has no null terminator
+static void test_unterminated()
+{
+    char buffer[1024];
+    size_t length = strlen(OWN_POSITION);
+    memcpy(buffer, OWN_POSITION, length);
+    memcpy(buffer + length, "}}garbage", 10);
+    struct AIS_MESSAGE message;
+    memset(&message, 0, sizeof(message));
+    CHECK_EQUAL(AIS_MESSAGE_OWN, ais_parse_message(buffer, length, OWN_MMSI, false, &message));
+    CHECK_NEAR(53.5743, message.own.latitude, 0);
+    CHECK_EQUAL(AIS_MESSAGE_INVALID, ais_parse_message(buffer, length - 1, OWN_MMSI, false, &message));
+}
+
+// Other vessels are only reported in traffic mode, COG 360 means not available
+static void test_traffic()
+{
+    struct AIS_MESSAGE message;
+    memset(&message, 0, sizeof(message));
+    CHECK_EQUAL(AIS_MESSAGE_TRAFFIC, parse(OTHER_POSITION, true, &message));
+    CHECK_EQUAL(211234560, message.traffic.mmsi);
+    CHECK_NEAR(53.541, message.traffic.latitude, 0);
+    CHECK_NEAR(9.91, message.traffic.longitude, 0);
+    CHECK(strcmp(message.traffic.shipName, "HARBOUR FERRY") == 0);
+
+    // Without traffic mode the subscription only delivers the own vessel, so it gets taken as such (course from heading)
+    memset(&message, 0, sizeof(message));
+    CHECK_EQUAL(AIS_MESSAGE_OWN, parse(OTHER_POSITION, false, &message));
+    CHECK_NEAR(90, message.own.course, 0);
+
+    const char *noPosition = "{\"MetaData\":{\"MMSI\":211234560,\"ShipName\":\"HARBOUR FERRY\"}}";
+    CHECK_EQUAL(AIS_MESSAGE_IGNORED, parse(noPosition, true, &message));
+}
+
+// Fields missing in a message keep the previous values of the own vessel
+static void test_partial_update()
+{
+    struct AIS_MESSAGE message;
+    memset(&message, 0, sizeof(message));
+    CHECK_EQUAL(AIS_MESSAGE_OWN, parse(OWN_POSITION, false, &message));
+
+    const char *staticData = "{\"Message\":{\"ShipStaticData\":{\"Name\":\"MY BOAT\"}},\"MetaData\":{\"MMSI\":245242000,"
+                             "\"ShipName\":\"\",\"latitude\":53.58,\"longitude\":9.69,\"time_utc\":\"2024-10-18 12:35:00 +0000 UTC\"}}";
+    CHECK_EQUAL(AIS_MESSAGE_OWN, parse(staticData, false, &message));
+    CHECK(strcmp(message.own.shipName, "MY BOAT") == 0); // Empty name ignored
+    CHECK_NEAR(123.4, message.own.course, 0);             // No position report
+    CHECK_NEAR(53.58, message.own.latitude, 0);
+
+    const char *noHeading = "{\"Message\":{\"PositionReport\":{\"Cog\":360,\"TrueHeading\":511}},\"MetaData\":{\"MMSI\":245242000,"
+                            "\"ShipName\":\"MY BOAT\",\"latitude\":53.59,\"longitude\":9.7,\"time_utc\":\"t\"}}";
+    CHECK_EQUAL(AIS_MESSAGE_OWN, parse(noHeading, false, &message));
+    CHECK_NEAR(123.4, message.own.course, 0);
+
+    const char *noTime = "{\"MetaData\":{\"MMSI\":245242000,\"ShipName\":\"MY BOAT\",\"latitude\":53.6,\"longitude\":9.71}}";
+    CHECK_EQUAL(AIS_MESSAGE_CORRUPT, parse(noTime, false, &message));
+    CHECK_NEAR(53.6, message.own.latitude, 0); // Fields found are still taken
+    CHECK(strcmp(message.own.time_utc, "t") == 0);
+}
+
+static void test_errors()
+{
+    struct AIS_MESSAGE message;
+    memset(&message, 0, sizeof(message));
+    CHECK_EQUAL(AIS_MESSAGE_ERROR, parse("{\"error\":\"Api Key Is Not Valid\"}", false, &message));
+    CHECK(strcmp(message.error, "Api Key Is Not Valid") == 0);
+
+    CHECK_EQUAL(AIS_MESSAGE_INVALID, parse("not json", false, &message));
+    CHECK_EQUAL(AIS_MESSAGE_CORRUPT, parse("{\"Message\":{}}", false, &message));
+    CHECK_EQUAL(AIS_MESSAGE_CORRUPT, parse("{\"MetaData\":{\"MMSI\":\"245242000\"}}", false, &message));
+}
+
+int main()
+{
+    test_own_position();
+    test_unterminated();
+    test_traffic();
+    test_partial_update();
+    test_errors();
+    return test_result("ais_parser");
+}
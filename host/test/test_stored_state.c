@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "stored_state.h"
+#include "test.h"
+
+// Layout of version 1 as written by older firmware
+struct StoredStateV1
+{
+    uint32_t version;
+    bool positionValid;
+    bool mmsiValid;
+    double latitude;
+    double longitude;
+    char mmsi[STORED_MMSI_LENGTH];
+};
+
+static struct StoredState valid_state()
+{
+    struct StoredState state;
+    memset(&state, 0, sizeof(state));
+    state.version = STORED_STATE_VERSION;
+    state.positionValid = true;
+    state.mmsiValid = true;
+    state.latitude = 53.5511;
+    state.longitude = 9.9937;
+    strcpy(state.mmsi, "211234560");
+    state.accessPointValid = true;
+    strcpy(state.accessPoint.ssid, "Marina");
+    state.accessPoint.channel = 6;
+    return state;
+}
+
+static void test_decode_current()
+{
+    struct StoredState blob = valid_state();
+    struct StoredState state;
+    CHECK(stored_state_decode(&blob, sizeof(blob), &state));
+    CHECK(memcmp(&state, &blob, sizeof(state)) == 0);
+}
+
+static void test_decode_v1()
+{
+    struct StoredStateV1 old;
+    memset(&old, 0, sizeof(old));
+    old.version = 1;
+    old.positionValid = true;
+    old.mmsiValid = true;
+    old.latitude = -33.8568;
+    old.longitude = 151.2153;
+    strcpy(old.mmsi, "503123456");
+
+    struct StoredState state;
+    CHECK(stored_state_decode(&old, sizeof(old), &state));
+    CHECK_EQUAL(STORED_STATE_VERSION, state.version);
+    CHECK(state.positionValid);
+    CHECK_NEAR(-33.8568, state.latitude, 0);
+    CHECK_NEAR(151.2153, state.longitude, 0);
+    CHECK(state.mmsiValid && strcmp(state.mmsi, "503123456") == 0);
+    CHECK(!state.accessPointValid); // Wasn't stored yet
+
+    old.version = 3;
+    CHECK(!stored_state_decode(&old, sizeof(old), &state));
+}
+
+// Broken records leave state untouched
+static void test_decode_invalid()
+{
+    struct StoredState state = valid_state();
+    struct StoredState untouched = state;
+    struct StoredState blob = valid_state();
+
+    CHECK(!stored_state_decode(&blob, sizeof(blob) - 1, &state)); // Unknown size
+    blob.version = STORED_STATE_VERSION + 1;
+    CHECK(!stored_state_decode(&blob, sizeof(blob), &state));
+
+    blob = valid_state();
+    memset(blob.mmsi, '1', sizeof(blob.mmsi)); // Not terminated
+    CHECK(!stored_state_decode(&blob, sizeof(blob), &state));
+    blob.mmsiValid = false; // Unused, so it doesn't matter
+    CHECK(stored_state_decode(&blob, sizeof(blob), &state));
+
+    state = untouched;
+    blob = valid_state();
+    memset(blob.accessPoint.ssid, 'x', sizeof(blob.accessPoint.ssid));
+    CHECK(!stored_state_decode(&blob, sizeof(blob), &state));
+    CHECK(memcmp(&state, &untouched, sizeof(state)) == 0);
+}
+
+// Changes within the delay get written together at the earliest deadline
+static void test_flush_schedule()
+{
+    struct FlushSchedule schedule = {0};
+    CHECK(!flush_schedule_take(&schedule)); // Nothing changed
+
+    CHECK(flush_schedule_mark(&schedule, 1000, 5000));
+    CHECK_EQUAL(6000, schedule.due);
+    CHECK(!flush_schedule_mark(&schedule, 2000, 5000)); // Written with the pending one
+    CHECK_EQUAL(6000, schedule.due);
+    CHECK(flush_schedule_mark(&schedule, 2000, 100)); // Has to be written earlier
+    CHECK_EQUAL(2100, schedule.due);
+
+    CHECK(flush_schedule_take(&schedule));
+    CHECK_EQUAL(0, schedule.due);
+    CHECK(!flush_schedule_take(&schedule));
+
+    CHECK(flush_schedule_mark(&schedule, 9000, 5000)); // New change after the write schedules again
+    CHECK_EQUAL(14000, schedule.due);
+}
+
+int main()
+{
+    test_decode_current();
+    test_decode_v1();
+    test_decode_invalid();
+    test_flush_schedule();
+    return test_result("stored_state");
+}
@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "png_writer.h"
+#include "test.h"
+#include "tile_decoder.h"
+
+#define ARENA_SIZE 53248 // Default of CONFIG_TILE_DECODER_ARENA_SIZE
+
+static uint8_t rgb[TILE_PIXELS * 3];
+static uint8_t png[PNG_WRITER_MAX_SIZE];
+static uint16_t pixels[TILE_PIXELS];
+static uint16_t slicedPixels[TILE_PIXELS];
+
+// Counts pixels which aren't the RGB565 value of the source
+static int count_mismatches(const uint16_t *decoded)
+{
+    int mismatches = 0;
+    for (int i = 0; i < TILE_PIXELS; i++)
+    {
+        const uint8_t *source = &rgb[i * 3];
+        const uint16_t expected = (uint16_t)(((source[0] & 0xF8) << 8) | ((source[1] & 0xFC) << 3) | (source[2] >> 3));
+        mismatches += decoded[i] != expected;
+    }
+    return mismatches;
+}
+
+// Gradient with all values of every channel
+static size_t create_png()
+{
+    for (int y = 0; y < TILE_SIZE; y++)
+    {
+        for (int x = 0; x < TILE_SIZE; x++)
+        {
+            uint8_t *pixel = &rgb[(y * TILE_SIZE + x) * 3];
+            pixel[0] = (uint8_t)x;
+            pixel[1] = (uint8_t)y;
+            pixel[2] = (uint8_t)(x ^ y);
+        }
+    }
+    return png_writer_write_tile(rgb, png);
+}
+
+static void test_decode(const size_t length)
+{
+    memset(pixels, 0, sizeof(pixels));
+    CHECK_EQUAL(ESP_OK, tile_decode(png, length, pixels));
+    CHECK_EQUAL(0, count_mismatches(pixels));
+
+    struct TileDecoderStats stats;
+    tile_decoder_get_stats(&stats);
+    CHECK(stats.arenaPeak <= stats.arenaSize);
+    CHECK_EQUAL(0, stats.heapAllocations);
+}
+
+// Decoding in slices gives the same pixels as decoding at once
+static void test_sliced(const size_t length)
+{
+    memset(slicedPixels, 0, sizeof(slicedPixels));
+    tile_decode_begin(png, length, slicedPixels);
+    int slices = 0;
+    esp_err_t ret;
+    do
+    {
+        ret = tile_decode_continue(1); // Every call feeds at least one input slice
+        slices++;
+    } while (ret == ESP_ERR_NOT_FINISHED && slices <= (int)length);
+    CHECK_EQUAL(ESP_OK, ret);
+    CHECK(slices > 1);
+    CHECK(memcmp(pixels, slicedPixels, sizeof(pixels)) == 0);
+}
+
+// An aborted tile is dropped, the next one decodes normally
+static void test_abort(const size_t length)
+{
+    tile_decode_begin(png, length, slicedPixels);
+    CHECK_EQUAL(ESP_ERR_NOT_FINISHED, tile_decode_continue(1));
+    tile_decode_abort();
+    CHECK_EQUAL(ESP_FAIL, tile_decode_continue(0));
+    tile_decode_abort(); // Nothing to abort
+
+    memset(pixels, 0, sizeof(pixels));
+    CHECK_EQUAL(ESP_OK, tile_decode(png, length, pixels));
+    CHECK_EQUAL(0, count_mismatches(pixels));
+}
+
+static void test_invalid(const size_t length)
+{
+    static const char ERROR_PAGE[] = "<html><body>429 Too Many Requests</body></html>";
+    CHECK_EQUAL(ESP_FAIL, tile_decode((const uint8_t *)ERROR_PAGE, sizeof(ERROR_PAGE) - 1, pixels));
+
+    png[1] = 'X'; // Broken signature
+    CHECK_EQUAL(ESP_FAIL, tile_decode(png, length, pixels));
+    png[1] = 'P';
+    CHECK_EQUAL(ESP_OK, tile_decode(png, length, pixels));
+}
+
+int main()
+{
+    static uint8_t arenaMemory[ARENA_SIZE];
+    CHECK_EQUAL(ESP_OK, tile_decoder_init(arenaMemory, sizeof(arenaMemory)));
+    const size_t length = create_png();
+    test_decode(length);
+    test_sliced(length);
+    test_abort(length);
+    test_invalid(length);
+    return test_result("tile_decoder");
+}
@@ -0,0 +1,108 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "test.h"
+#include "tile_math.h"
+
+#define WORLD_UNITS_PER_PIXEL_Z19 32 // 2^32 / (256 * 2^19)
+
+// Tiles of known places (OpenStreetMap tile URLs)
+static void test_known_tiles()
+{
+    int x;
+    int y;
+    position_to_tile_coordinates(53.5511, 9.9937, 10, &x, &y); // Hamburg
+    CHECK_EQUAL(540, x);
+    CHECK_EQUAL(330, y);
+    position_to_tile_coordinates(53.5511, 9.9937, 14, &x, &y);
+    CHECK_EQUAL(8646, x);
+    CHECK_EQUAL(5295, y);
+    position_to_tile_coordinates(-33.8568, 151.2153, 12, &x, &y); // Sydney, southern and eastern hemisphere
+    CHECK_EQUAL(3768, x);
+    CHECK_EQUAL(2457, y);
+    position_to_tile_coordinates(40.6892, -74.0445, 16, &x, &y); // New York, western hemisphere
+    CHECK_EQUAL(19288, x);
+    CHECK_EQUAL(24645, y);
+    position_to_tile_coordinates(-0.001, 0.001, 1, &x, &y); // Next to the corner of all 4 tiles
+    CHECK_EQUAL(1, x);
+    CHECK_EQUAL(1, y);
+    position_to_tile_coordinates(0.001, -0.001, 1, &x, &y);
+    CHECK_EQUAL(0, x);
+    CHECK_EQUAL(0, y);
+}
+
+// World coordinates at the borders of the projection (within a world unit, 1/32 pixel at zoom 19)
+static void test_world_borders()
+{
+    struct WorldPoint point;
+    position_e7_to_world(0, 0, &point);
+    CHECK_NEAR(1u << 31, point.x, 1);
+    CHECK_EQUAL(1u << 31, point.y);
+    position_e7_to_world(0, -1800000000, &point);
+    CHECK_EQUAL(0, point.x);
+    position_e7_to_world(900000000, 0, &point); // Cut off at ~85.05°
+    CHECK_EQUAL(0, point.y);
+    position_e7_to_world(-900000000, 0, &point);
+    CHECK_EQUAL(UINT32_MAX, point.y);
+
+    int32_t pixelX;
+    int32_t pixelY;
+    point.x = 1u << 31;
+    point.y = 1u << 31;
+    world_to_pixel(&point, 0, &pixelX, &pixelY);
+    CHECK_EQUAL(128, pixelX);
+    CHECK_EQUAL(128, pixelY);
+    world_to_pixel(&point, 19, &pixelX, &pixelY);
+    CHECK_EQUAL(128 << 19, pixelX);
+    CHECK_EQUAL(128 << 19, pixelY);
+}
+
+// Integer kernel against the double precision formulas, within 1/20 pixel at zoom 19
+static void test_kernel_accuracy()
+{
+    const double tolerance = WORLD_UNITS_PER_PIXEL_Z19 / 20.0;
+    for (int32_t latitudeE7 = -850000000; latitudeE7 <= 850000000; latitudeE7 += 12345679)
+    {
+        for (int32_t longitudeE7 = -1790000000; longitudeE7 <= 1790000000; longitudeE7 += 234567891)
+        {
+            struct WorldPoint point;
+            position_e7_to_world(latitudeE7, longitudeE7, &point);
+            double xReference;
+            double yReference;
+            position_to_tile_fraction(latitudeE7 * 1e-7, longitudeE7 * 1e-7, 0, &xReference, &yReference);
+            CHECK_NEAR(xReference * 4294967296.0, point.x, tolerance);
+            CHECK_NEAR(yReference * 4294967296.0, point.y, tolerance);
+        }
+    }
+}
+
+// Tile coordinates back to positions
+static void test_inverse()
+{
+    double x;
+    double y;
+    position_to_tile_fraction(53.5511, 9.9937, 14, &x, &y);
+    CHECK_NEAR(53.5511, tile_to_latitude(y, 14), 1e-9);
+    CHECK_NEAR(9.9937, tile_to_longitude(x, 14), 1e-9);
+    CHECK_NEAR(0, tile_to_latitude(1, 1), 1e-9);
+    CHECK_NEAR(-180, tile_to_longitude(0, 5), 1e-9);
+    CHECK_NEAR(85.0511287798, tile_to_latitude(0, 3), 1e-9);
+}
+
+static void test_new_tiles_needed()
+{
+    CHECK(!new_tiles_for_position_needed(53.5511, 9.9937, 14, 53.5512, 9.9938, 14)); // Same tile
+    CHECK(new_tiles_for_position_needed(53.5511, 9.9937, 14, 53.5511, 10.02, 14));    // Next tile east
+    CHECK(new_tiles_for_position_needed(53.5511, 9.9937, 14, 53.5511, 9.9937, 15));   // Other zoom
+}
+
+int main()
+{
+    tile_math_init();
+    test_known_tiles();
+    test_world_borders();
+    test_kernel_accuracy();
+    test_inverse();
+    test_new_tiles_needed();
+    return test_result("tile_math");
+}
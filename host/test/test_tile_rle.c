@@ -0,0 +1,120 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "tile_decoder.h"
+#include "tile_rle.h"
+
+static uint16_t source[TILE_PIXELS];
+static uint16_t tile[TILE_PIXELS];
+static uint8_t encoded[TILE_RLE_MAGIC_LENGTH + TILE_RLE_MAX_ENCODED(TILE_PIXELS) + 16];
+
+// Stream like the one of tools/tile_proxy.py. Returns length
+static size_t encode(const uint16_t *pixels)
+{
+    memcpy(encoded, TILE_RLE_MAGIC, TILE_RLE_MAGIC_LENGTH);
+    return TILE_RLE_MAGIC_LENGTH + tile_rle_encode(pixels, TILE_PIXELS, encoded + TILE_RLE_MAGIC_LENGTH);
+}
+
+// Decodes the stream in chunks of given size. Returns true if the tile is complete
+static bool decode(const size_t length, const size_t chunkSize)
+{
+    struct TileRleDecoder decoder;
+    memset(tile, 0, sizeof(tile));
+    tile_rle_begin(&decoder, tile, TILE_PIXELS);
+    for (size_t offset = 0; offset < length; offset += chunkSize)
+    {
+        size_t size = (length - offset < chunkSize) ? length - offset : chunkSize;
+        if (!tile_rle_feed(&decoder, &encoded[offset], size))
+        {
+            return false;
+        }
+    }
+    return tile_rle_finish(&decoder);
+}
+
+// Encodes source and checks that it decodes to the same pixels, whichever way the stream is split
+static void check_round_trip(const size_t maxLength)
+{
+    size_t length = encode(source);
+    CHECK(length <= maxLength);
+    static const size_t CHUNK_SIZES[] = {1, 2, 3, 5, 7, 4096, sizeof(encoded)};
+    for (size_t i = 0; i < sizeof(CHUNK_SIZES) / sizeof(CHUNK_SIZES[0]); i++)
+    {
+        CHECK(decode(length, CHUNK_SIZES[i]));
+        CHECK(memcmp(tile, source, sizeof(tile)) == 0);
+    }
+}
+
+static void test_flat()
+{
+    for (size_t i = 0; i < TILE_PIXELS; i++)
+    {
+        source[i] = 0xAEBF;
+    }
+    // Only repeat packets of 3 bytes
+    check_round_trip(TILE_RLE_MAGIC_LENGTH + TILE_PIXELS / TILE_RLE_MAX_PACKET * 3);
+}
+
+static void test_noise()
+{
+    srand(1);
+    for (size_t i = 0; i < TILE_PIXELS; i++)
+    {
+        source[i] = (uint16_t)rand();
+    }
+    check_round_trip(TILE_RLE_MAGIC_LENGTH + TILE_RLE_MAX_ENCODED(TILE_PIXELS));
+}
+
+// Runs of every length around the packet limits, separated by single pixels
+static void test_runs()
+{
+    size_t i = 0;
+    uint16_t color = 0;
+    for (size_t run = 1; i < TILE_PIXELS; run = (run % (2 * TILE_RLE_MAX_PACKET + 2)) + 1)
+    {
+        for (size_t j = 0; j < run && i < TILE_PIXELS; j++)
+        {
+            source[i++] = color;
+        }
+        color += 0x0821;
+        if (i < TILE_PIXELS)
+        {
+            source[i++] = 0xFFFF;
+        }
+    }
+    check_round_trip(TILE_RLE_MAGIC_LENGTH + TILE_RLE_MAX_ENCODED(TILE_PIXELS));
+}
+
+// Streams which aren't a complete tile get rejected
+static void test_invalid()
+{
+    for (size_t i = 0; i < TILE_PIXELS; i++)
+    {
+        source[i] = (i % 3) ? 0x1234 : (uint16_t)i;
+    }
+    size_t length = encode(source);
+    CHECK(!decode(length - 1, 4096)); // Truncated
+    CHECK(!decode(TILE_RLE_MAGIC_LENGTH, 4096)); // Only magic
+
+    encoded[length] = 0x80; // One more repeat packet
+    encoded[length + 1] = 0x00;
+    encoded[length + 2] = 0x00;
+    CHECK(!decode(length + 3, 4096));
+    CHECK(!decode(length + 3, 1));
+
+    encoded[0] = '<'; // e.g. an HTML error page
+    CHECK(!decode(length, 4096));
+    encoded[0] = TILE_RLE_MAGIC[0];
+    CHECK(decode(length, 4096));
+}
+
+int main()
+{
+    test_flat();
+    test_noise();
+    test_runs();
+    test_invalid();
+    return test_result("tile_rle");
+}
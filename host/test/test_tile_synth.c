@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "tile_cache.h"
+#include "tile_decoder.h"
+#include "tile_synth.h"
+
+#define CACHE_TILES 3
+
+static uint16_t children[4][TILE_PIXELS];
+static uint16_t tile[TILE_PIXELS];
+
+static uint16_t rgb565(const int r, const int g, const int b)
+{
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// Every child of a single color ends up as one quadrant of that color
+static void test_downsample_quadrants()
+{
+    const uint16_t colors[4] = {rgb565(31, 0, 0), rgb565(0, 63, 0), rgb565(0, 0, 31), rgb565(31, 63, 31)};
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < TILE_PIXELS; j++)
+        {
+            children[i][j] = colors[i];
+        }
+    }
+    const uint16_t *sources[4] = {children[0], children[1], children[2], children[3]};
+    tile_synth_downsample(sources, tile);
+    const int half = TILE_SIZE / 2;
+    CHECK_EQUAL(colors[0], tile[0]);
+    CHECK_EQUAL(colors[0], tile[(half - 1) * TILE_SIZE + half - 1]);
+    CHECK_EQUAL(colors[1], tile[half]);
+    CHECK_EQUAL(colors[1], tile[TILE_SIZE - 1]);
+    CHECK_EQUAL(colors[2], tile[half * TILE_SIZE]);
+    CHECK_EQUAL(colors[3], tile[half * TILE_SIZE + half]);
+    CHECK_EQUAL(colors[3], tile[TILE_PIXELS - 1]);
+}
+
+// Every channel gets averaged on its own and rounded half up, without carries into the neighbouring channel
+static void test_downsample_average()
+{
+    const uint16_t block[][4] = {
+        {rgb565(0, 0, 0), rgb565(0, 0, 0), rgb565(0, 0, 0), rgb565(1, 1, 1)},     // 0.25 -> 0
+        {rgb565(0, 0, 0), rgb565(0, 0, 0), rgb565(1, 1, 1), rgb565(1, 1, 1)},     // 0.5 -> 1
+        {rgb565(31, 63, 31), rgb565(31, 63, 31), rgb565(31, 63, 31), rgb565(31, 63, 31)}, // No overflow
+        {rgb565(31, 0, 31), rgb565(30, 0, 30), rgb565(31, 0, 31), rgb565(30, 0, 30)}, // Red and blue don't spill into green
+    };
+    const uint16_t expected[] = {rgb565(0, 0, 0), rgb565(1, 1, 1), rgb565(31, 63, 31), rgb565(31, 0, 31)};
+    memset(children, 0, sizeof(children));
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        children[0][2 * i] = block[i][0];
+        children[0][2 * i + 1] = block[i][1];
+        children[0][TILE_SIZE + 2 * i] = block[i][2];
+        children[0][TILE_SIZE + 2 * i + 1] = block[i][3];
+    }
+    const uint16_t *sources[4] = {children[0], children[1], children[2], children[3]};
+    tile_synth_downsample(sources, tile);
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        CHECK_EQUAL(expected[i], tile[i]);
+    }
+}
+
+// Every pixel of the quadrant becomes a 2x2 block
+static void test_upscale()
+{
+    srand(2);
+    for (int j = 0; j < TILE_PIXELS; j++)
+    {
+        children[0][j] = (uint16_t)rand();
+    }
+    for (int quadrant = 0; quadrant < 4; quadrant++)
+    {
+        const int quadrantX = quadrant % 2;
+        const int quadrantY = quadrant / 2;
+        tile_synth_upscale(children[0], quadrantX, quadrantY, tile);
+        int mismatches = 0;
+        for (int y = 0; y < TILE_SIZE; y++)
+        {
+            for (int x = 0; x < TILE_SIZE; x++)
+            {
+                const int sourceX = quadrantX * TILE_SIZE / 2 + x / 2;
+                const int sourceY = quadrantY * TILE_SIZE / 2 + y / 2;
+                mismatches += tile[y * TILE_SIZE + x] != children[0][sourceY * TILE_SIZE + sourceX];
+            }
+        }
+        CHECK_EQUAL(0, mismatches);
+    }
+}
+
+// Least recently used tile gets replaced, finding a tile counts as use
+static void test_cache()
+{
+    void *memory = malloc(tile_cache_memory_size(CACHE_TILES));
+    tile_cache_init(memory, CACHE_TILES);
+    CHECK(tile_cache_find(14, 1, 1) == NULL);
+
+    for (int i = 0; i < CACHE_TILES; i++)
+    {
+        memset(tile, i + 1, sizeof(tile));
+        tile_cache_put(14, i, 1, tile);
+    }
+    const uint16_t *cached = tile_cache_find(14, 0, 1);
+    CHECK(cached != NULL && cached[TILE_PIXELS - 1] == 0x0101);
+    CHECK(tile_cache_find(15, 0, 1) == NULL); // Zoom is part of the key
+    CHECK(tile_cache_find(14, 1, 0) == NULL);
+
+    tile_cache_put(14, 10, 1, tile); // Replaces x = 1, x = 0 was used last
+    CHECK(tile_cache_find(14, 0, 1) != NULL);
+    CHECK(tile_cache_find(14, 1, 1) == NULL);
+    CHECK(tile_cache_find(14, 2, 1) != NULL);
+    cached = tile_cache_find(14, 10, 1);
+    CHECK(cached != NULL && memcmp(cached, tile, sizeof(tile)) == 0);
+    free(memory);
+}
+
+int main()
+{
+    test_downsample_quadrants();
+    test_downsample_average();
+    test_upscale();
+    test_cache();
+    return test_result("tile_synth");
+}
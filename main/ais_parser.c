@@ -0,0 +1,177 @@
+#include "ais_parser.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "cJSON.h"
+
+#define AIS_COURSE_NOT_AVAILABLE 360 // COG and TrueHeading use 360 resp. 511 for "not available"
+
+static const char *LOG_TAG = "ais_parser";
+
+// Returns course of a position report (COG, else true heading). Negative if message has none
+static double parse_course(const cJSON *root)
+{
+    const cJSON *message = cJSON_GetObjectItem(root, "Message");
+    const cJSON *report = cJSON_GetObjectItem(message, "PositionReport");
+    const cJSON *cog = cJSON_GetObjectItem(report, "Cog");
+    if (cJSON_IsNumber(cog) && cog->valuedouble >= 0 && cog->valuedouble < AIS_COURSE_NOT_AVAILABLE)
+    {
+        return cog->valuedouble;
+    }
+    const cJSON *heading = cJSON_GetObjectItem(report, "TrueHeading");
+    if (cJSON_IsNumber(heading) && heading->valuedouble >= 0 && heading->valuedouble < AIS_COURSE_NOT_AVAILABLE)
+    {
+        return heading->valuedouble;
+    }
+    return -1;
+}
+
+// Puts another vessel's position into traffic report
+static enum AIS_MESSAGE_TYPE parse_traffic(const int mmsi, const cJSON *meta_data, struct AIS_TRAFFIC_REPORT *traffic)
+{
+    const cJSON *longitude = cJSON_GetObjectItem(meta_data, "Longitude");
+    const cJSON *latitude = cJSON_GetObjectItem(meta_data, "Latitude");
+    if (!cJSON_IsNumber(longitude) || !cJSON_IsNumber(latitude))
+    {
+        ESP_LOGW(LOG_TAG, "Unable to get position of traffic target %d", mmsi);
+        return AIS_MESSAGE_IGNORED;
+    }
+
+    traffic->mmsi = mmsi;
+    traffic->latitude = latitude->valuedouble;
+    traffic->longitude = longitude->valuedouble;
+    traffic->shipName[0] = '\0';
+    const cJSON *shipName = cJSON_GetObjectItem(meta_data, "ShipName");
+    if (cJSON_IsString(shipName) && shipName->valuestring != NULL)
+    {
+        strncpy(traffic->shipName, shipName->valuestring, SHIP_NAME_LENGTH - 1);
+        traffic->shipName[SHIP_NAME_LENGTH - 1] = '\0';
+    }
+    return AIS_MESSAGE_TRAFFIC;
+}
+
+// Updates own vessel's data by metadata. Returns AIS_MESSAGE_CORRUPT if fields are missing
+static enum AIS_MESSAGE_TYPE parse_own(const int mmsi, const cJSON *root, const cJSON *meta_data, struct AIS_DATA *own)
+{
+    enum AIS_MESSAGE_TYPE type = AIS_MESSAGE_OWN;
+
+    // MMSI
+    ESP_LOGI(LOG_TAG, "MMSI: %d", mmsi);
+    own->mmsi = mmsi;
+
+    // Longitude
+    const cJSON *longitude = cJSON_GetObjectItem(meta_data, "Longitude");
+    if (cJSON_IsNumber(longitude))
+    {
+        ESP_LOGI(LOG_TAG, "Longitude: %f", longitude->valuedouble);
+        own->longitude = longitude->valuedouble;
+    }
+    else
+    {
+        ESP_LOGW(LOG_TAG, "Unable to get Longitude");
+        type = AIS_MESSAGE_CORRUPT;
+    }
+
+    // Latitude
+    const cJSON *latitude = cJSON_GetObjectItem(meta_data, "Latitude");
+    if (cJSON_IsNumber(latitude))
+    {
+        ESP_LOGI(LOG_TAG, "Latitude: %f", latitude->valuedouble);
+        own->latitude = latitude->valuedouble;
+    }
+    else
+    {
+        ESP_LOGW(LOG_TAG, "Unable to get Latitude");
+        type = AIS_MESSAGE_CORRUPT;
+    }
+
+    // ShipName
+    const cJSON *shipName = cJSON_GetObjectItem(meta_data, "ShipName");
+    if (cJSON_IsString(shipName))
+    {
+        if (shipName->valuestring != NULL && strlen(shipName->valuestring))
+        {
+            ESP_LOGI(LOG_TAG, "ShipName: %s", shipName->valuestring);
+            strncpy(own->shipName, shipName->valuestring, SHIP_NAME_LENGTH - 1);
+        }
+        else
+        {
+            ESP_LOGW(LOG_TAG, "Empty name. Ignoring it.");
+        }
+    }
+    else
+    {
+        ESP_LOGW(LOG_TAG, "Unable to get ShipName");
+        type = AIS_MESSAGE_CORRUPT;
+    }
+
+    // Course (only in position reports, other messages keep the last one)
+    double course = parse_course(root);
+    if (course >= 0)
+    {
+        ESP_LOGI(LOG_TAG, "Course: %.1f", course);
+        own->course = course;
+    }
+
+    // time_utc
+    const cJSON *timeUTC = cJSON_GetObjectItem(meta_data, "time_utc");
+    if (cJSON_IsString(timeUTC))
+    {
+        ESP_LOGI(LOG_TAG, "timeUTC: %s", timeUTC->valuestring);
+        strncpy(own->time_utc, timeUTC->valuestring, TIME_UTC_LENGTH - 1);
+    }
+    else
+    {
+        ESP_LOGW(LOG_TAG, "Unable to get timeUTC");
+        type = AIS_MESSAGE_CORRUPT;
+    }
+    return type;
+}
+
+enum AIS_MESSAGE_TYPE ais_parse_message(const char *json, const size_t length, const int ownMmsi, const bool trafficMode, struct AIS_MESSAGE *message)
+{
+    // Parses in place, no null-terminated copy needed
+    cJSON *root = cJSON_ParseWithLength(json, length);
+    if (root == NULL)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to parse JSON");
+        return AIS_MESSAGE_INVALID;
+    }
+
+    enum AIS_MESSAGE_TYPE type;
+    const cJSON *error = cJSON_GetObjectItem(root, "error");
+    const cJSON *meta_data = cJSON_GetObjectItem(root, "MetaData");
+    const cJSON *mmsi = cJSON_GetObjectItem(meta_data, "MMSI");
+    if (error != NULL)
+    {
+        ESP_LOGE(LOG_TAG, "Specific error occurred shown in message");
+        message->error[0] = '\0';
+        if (cJSON_IsString(error) && error->valuestring != NULL)
+        {
+            strncpy(message->error, error->valuestring, AIS_ERROR_LENGTH - 1);
+            message->error[AIS_ERROR_LENGTH - 1] = '\0';
+        }
+        type = AIS_MESSAGE_ERROR;
+    }
+    else if (meta_data == NULL)
+    {
+        ESP_LOGE(LOG_TAG, "MetaData object not found");
+        type = AIS_MESSAGE_CORRUPT;
+    }
+    else if (!cJSON_IsNumber(mmsi))
+    {
+        ESP_LOGW(LOG_TAG, "MMSI not found or not a number");
+        type = AIS_MESSAGE_CORRUPT;
+    }
+    else if (trafficMode && mmsi->valueint != ownMmsi)
+    {
+        type = parse_traffic(mmsi->valueint, meta_data, &message->traffic);
+    }
+    else
+    {
+        type = parse_own(mmsi->valueint, root, meta_data, &message->own);
+    }
+
+    cJSON_Delete(root);
+    return type;
+}
@@ -0,0 +1,55 @@
+#ifndef AIS_PARSER_H_
+#define AIS_PARSER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Parser of aisstream.io messages. Only depends on cJSON, also built on host (see host/)
+
+#define SHIP_NAME_LENGTH (20 + 1) // AIS ship names are 20 chars + 1 null terminator
+#define TIME_UTC_LENGTH 48         // e.g. "2024-10-18 12:34:56.123456789 +0000 UTC"
+#define AIS_ERROR_LENGTH 96        // Maximum length (incl. null terminator) of an error reported by aisstream
+
+// Received data via AISStream
+struct AIS_DATA
+{
+    double longitude;                // Current longitude
+    double latitude;                 // Current latitude
+    char time_utc[TIME_UTC_LENGTH];  // Timepoint of last AIS data
+    int mmsi;                        // MMSI of ship
+    char shipName[SHIP_NAME_LENGTH]; // Name of ship
+    double course;                   // Course over ground (degrees, negative if not available)
+};
+
+// Position of another vessel (traffic mode)
+struct AIS_TRAFFIC_REPORT
+{
+    int mmsi;
+    double latitude;
+    double longitude;
+    char shipName[SHIP_NAME_LENGTH]; // Empty if not sent
+};
+
+// Kind of a parsed message
+enum AIS_MESSAGE_TYPE
+{
+    AIS_MESSAGE_INVALID, // No JSON at all
+    AIS_MESSAGE_ERROR,   // aisstream reported an error (e.g. invalid API key)
+    AIS_MESSAGE_CORRUPT, // Metadata or fields of own vessel are missing
+    AIS_MESSAGE_IGNORED, // Nothing usable (e.g. traffic without position)
+    AIS_MESSAGE_OWN,     // Update of own vessel
+    AIS_MESSAGE_TRAFFIC, // Position of another vessel
+};
+
+// Content of a parsed message. Depending on the type only one of the members is valid
+struct AIS_MESSAGE
+{
+    struct AIS_DATA own;                // Has to hold the previous data of the own vessel. Fields missing in the message keep their value
+    struct AIS_TRAFFIC_REPORT traffic;
+    char error[AIS_ERROR_LENGTH];
+};
+
+// Parses one message (needs no null terminator). Messages of other MMSIs than ownMmsi are only reported as traffic in traffic mode
+enum AIS_MESSAGE_TYPE ais_parse_message(const char *json, const size_t length, const int ownMmsi, const bool trafficMode, struct AIS_MESSAGE *message);
+
+#endif // AIS_PARSER_H_
@@ -0,0 +1,232 @@
+#include "ais_targets.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Uniform grid over the indexed area. Targets outside of it are kept in an extra cell
+#define GRID_SIZE 8
+#define GRID_CELLS (GRID_SIZE * GRID_SIZE)
+#define OUTSIDE_CELL GRID_CELLS
+#define NO_TARGET -1
+
+static const char *LOG_TAG = "ais_targets";
+
+// Storage slot of a target
+struct TargetSlot
+{
+    struct AIS_TARGET target; // Actual target data
+    bool used;                // Slot is in use
+    int16_t cell;             // Cell this slot is linked into
+    int16_t next;             // Next slot in same cell (or NO_TARGET)
+};
+
+static struct TargetSlot slots[AIS_TARGETS_MAX];
+static int16_t cellHeads[GRID_CELLS + 1]; // First slot of each cell (+1 for outside cell)
+static struct BoundingBox indexedArea = {.latMin = -90, .lonMin = -180, .latMax = 90, .lonMax = 180};
+static SemaphoreHandle_t targetsMutex = NULL;
+
+// Returns the cell index (clamped) of a latitude/longitude inside indexed area
+static void position_to_cell(const double latitude, const double longitude, int *row, int *column)
+{
+    *row = (int)((latitude - indexedArea.latMin) / (indexedArea.latMax - indexedArea.latMin) * GRID_SIZE);
+    *column = (int)((longitude - indexedArea.lonMin) / (indexedArea.lonMax - indexedArea.lonMin) * GRID_SIZE);
+
+    *row = (*row < 0) ? 0 : ((*row >= GRID_SIZE) ? GRID_SIZE - 1 : *row);
+    *column = (*column < 0) ? 0 : ((*column >= GRID_SIZE) ? GRID_SIZE - 1 : *column);
+}
+
+static bool in_box(const struct BoundingBox *box, const double latitude, const double longitude)
+{
+    return (latitude >= box->latMin) && (latitude <= box->latMax) && (longitude >= box->lonMin) && (longitude <= box->lonMax);
+}
+
+// Returns the cell a position belongs to
+static int16_t cell_of(const double latitude, const double longitude)
+{
+    if (!in_box(&indexedArea, latitude, longitude))
+    {
+        return OUTSIDE_CELL;
+    }
+    int row;
+    int column;
+    position_to_cell(latitude, longitude, &row, &column);
+    return (int16_t)(row * GRID_SIZE + column);
+}
+
+static void link_slot(const int16_t index)
+{
+    struct TargetSlot *slot = &slots[index];
+    slot->cell = cell_of(slot->target.latitude, slot->target.longitude);
+    slot->next = cellHeads[slot->cell];
+    cellHeads[slot->cell] = index;
+}
+
+static void unlink_slot(const int16_t index)
+{
+    int16_t *link = &cellHeads[slots[index].cell];
+    while (*link != NO_TARGET)
+    {
+        if (*link == index)
+        {
+            *link = slots[index].next;
+            return;
+        }
+        link = &slots[*link].next;
+    }
+}
+
+static void remove_slot(const int16_t index)
+{
+    unlink_slot(index);
+    slots[index].used = false;
+}
+
+// Rebuilds all cell lists (e.g. after indexed area changed)
+static void rebuild_index()
+{
+    for (int cell = 0; cell <= GRID_CELLS; cell++)
+    {
+        cellHeads[cell] = NO_TARGET;
+    }
+    for (int16_t i = 0; i < AIS_TARGETS_MAX; i++)
+    {
+        if (slots[i].used)
+        {
+            link_slot(i);
+        }
+    }
+}
+
+void ais_targets_init()
+{
+    targetsMutex = xSemaphoreCreateMutex();
+    memset(slots, 0, sizeof(slots));
+    rebuild_index();
+}
+
+void ais_targets_set_area(const struct BoundingBox *area)
+{
+    xSemaphoreTake(targetsMutex, portMAX_DELAY);
+    indexedArea = *area;
+    rebuild_index();
+    xSemaphoreGive(targetsMutex);
+}
+
+void ais_targets_update(const int mmsi, const double latitude, const double longitude, const char *shipName)
+{
+    xSemaphoreTake(targetsMutex, portMAX_DELAY);
+
+    // Find existing slot of this MMSI, else a free one, else the oldest one
+    int16_t found = NO_TARGET;
+    int16_t freeSlot = NO_TARGET;
+    int16_t oldest = 0;
+    for (int16_t i = 0; i < AIS_TARGETS_MAX; i++)
+    {
+        if (!slots[i].used)
+        {
+            if (freeSlot == NO_TARGET)
+            {
+                freeSlot = i;
+            }
+        }
+        else if (slots[i].target.mmsi == mmsi)
+        {
+            found = i;
+            break;
+        }
+        else if (slots[i].target.lastSeen < slots[oldest].target.lastSeen || !slots[oldest].used)
+        {
+            oldest = i;
+        }
+    }
+
+    if (found != NO_TARGET)
+    {
+        unlink_slot(found);
+    }
+    else if (freeSlot != NO_TARGET)
+    {
+        found = freeSlot;
+        slots[found].target.shipName[0] = '\0';
+    }
+    else
+    {
+        ESP_LOGW(LOG_TAG, "Target storage full, evicting MMSI %d", slots[oldest].target.mmsi);
+        unlink_slot(oldest);
+        found = oldest;
+        slots[found].target.shipName[0] = '\0';
+    }
+
+    struct TargetSlot *slot = &slots[found];
+    slot->used = true;
+    slot->target.mmsi = mmsi;
+    slot->target.latitude = latitude;
+    slot->target.longitude = longitude;
+    slot->target.lastSeen = esp_timer_get_time();
+    if (shipName != NULL && strlen(shipName))
+    {
+        strncpy(slot->target.shipName, shipName, AIS_TARGET_NAME_LENGTH - 1);
+        slot->target.shipName[AIS_TARGET_NAME_LENGTH - 1] = '\0';
+    }
+    link_slot(found);
+
+    xSemaphoreGive(targetsMutex);
+}
+
+// Copies all non-expired targets of one cell which are inside box. Expired ones get removed
+static size_t collect_cell(const int cell, const struct BoundingBox *box, const int64_t oldestAllowed, struct AIS_TARGET *targets, size_t count, const size_t maxCount)
+{
+    int16_t index = cellHeads[cell];
+    while (index != NO_TARGET && count < maxCount)
+    {
+        int16_t next = slots[index].next;
+        const struct AIS_TARGET *target = &slots[index].target;
+        if (target->lastSeen < oldestAllowed)
+        {
+            ESP_LOGI(LOG_TAG, "Evicting MMSI %d (too old)", target->mmsi);
+            remove_slot(index);
+        }
+        else if (in_box(box, target->latitude, target->longitude))
+        {
+            targets[count++] = *target;
+        }
+        index = next;
+    }
+    return count;
+}
+
+size_t ais_targets_collect(const struct BoundingBox *box, const int64_t maxAgeUs, struct AIS_TARGET *targets, const size_t maxCount)
+{
+    const int64_t oldestAllowed = esp_timer_get_time() - maxAgeUs;
+    size_t count = 0;
+
+    xSemaphoreTake(targetsMutex, portMAX_DELAY);
+
+    // Only visit cells overlapping the requested box
+    int rowMin;
+    int columnMin;
+    int rowMax;
+    int columnMax;
+    position_to_cell(box->latMin, box->lonMin, &rowMin, &columnMin);
+    position_to_cell(box->latMax, box->lonMax, &rowMax, &columnMax);
+    for (int row = rowMin; row <= rowMax; row++)
+    {
+        for (int column = columnMin; column <= columnMax; column++)
+        {
+            count = collect_cell(row * GRID_SIZE + column, box, oldestAllowed, targets, count, maxCount);
+        }
+    }
+
+    // Requested box reaches out of indexed area
+    bool boxInside = in_box(&indexedArea, box->latMin, box->lonMin) && in_box(&indexedArea, box->latMax, box->lonMax);
+    if (!boxInside)
+    {
+        count = collect_cell(OUTSIDE_CELL, box, oldestAllowed, targets, count, maxCount);
+    }
+
+    xSemaphoreGive(targetsMutex);
+    return count;
+}
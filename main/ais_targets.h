@@ -0,0 +1,35 @@
+#ifndef AIS_TARGETS_H_
+#define AIS_TARGETS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global.h"
+
+#define AIS_TARGETS_MAX 128       // Maximum amount of vessels (besides own one) kept in memory
+#define AIS_TARGET_NAME_LENGTH 21 // AIS ship names are 20 chars + 1 null terminator
+
+// Other vessel received in traffic mode
+struct AIS_TARGET
+{
+    int mmsi;                                // MMSI of ship
+    double latitude;                         // Last latitude
+    double longitude;                        // Last longitude
+    char shipName[AIS_TARGET_NAME_LENGTH];   // Name of ship (may be empty)
+    int64_t lastSeen;                        // Timepoint of last position (esp_timer, microseconds)
+};
+
+// Sets up target storage and spatial index
+void ais_targets_init();
+
+// Sets the area the targets are indexed for (usually the subscribed bounding box). Rebuilds the index
+void ais_targets_set_area(const struct BoundingBox *area);
+
+// Inserts or updates a target (latest position wins). Evicts the oldest target if storage is full
+void ais_targets_update(const int mmsi, const double latitude, const double longitude, const char *shipName);
+
+// Copies up to maxCount targets inside given box into targets. Removes targets older than maxAgeUs. Returns amount copied
+size_t ais_targets_collect(const struct BoundingBox *box, const int64_t maxAgeUs, struct AIS_TARGET *targets, const size_t maxCount);
+
+#endif // AIS_TARGETS_H_
@@ -1,8 +1,16 @@
 #include "aisstream.h"
 
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "sdkconfig.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_system.h"
 #include "esp_websocket_client.h"
@@ -13,236 +21,512 @@
 
 #include "config.h"
 #include "global.h"
+#include "ais_targets.h"
+#include "histogram.h"
+#include "app_events.h"
+#include "display.h"
+#include "wifi.h"
+#include "power.h"
+#include "heap_stats.h"
+#include "tls_resume.h"
 
-#define WEBSOCKET_URI "wss://stream.aisstream.io/v0/stream"
+#define WEBSOCKET_URI CONFIG_AIS_STREAM_URI
+
+#if CONFIG_AIS_TRAFFIC_MODE
+#define TRAFFIC_MODE true
+#else
+#define TRAFFIC_MODE false
+#endif
+
+#define RECONNECT_BACKOFF_MIN_MS 250          // First retry after a lost connection
+#define RECONNECT_BACKOFF_MAX_MS (60 * 1000) // Backoff doubles per failed attempt up to this
+#define PING_INTERVAL_S 10                    // Interval of WebSocket pings
+#define PINGPONG_TIMEOUT_S 25                 // Connection is considered dead if no pong was received within this time
+#define OWN_AREA_MARGIN_DEG 0.1               // Own vessel is kept at least this far inside the subscribed area (~11 km)
 
 char ship_mmsi[MMSI_LENGTH];
-struct AIS_DATA lastAisData = {
+static int ownMmsi = 0; // ship_mmsi as number, for the parser
+enum Validity validity = NO_CONNECTION; // Current state of connection and data
+struct AIS_DATA latestAisData = {
     .latitude = 0,
     .longitude = 0,
     .time_utc = "",
     .mmsi = 0,
     .shipName = "",
-    .validity = NO_CONNECTION};
+    .course = -1};
+bool aisDataPending = false;                                // latestAisData was not taken by UI yet
+static portMUX_TYPE aisDataLock = portMUX_INITIALIZER_UNLOCKED; // Guards latestAisData and aisDataPending
+
+struct BoundingBox subscriptionBox; // Area to receive traffic of (only used in traffic mode)
+bool subscriptionBoxSet = false;    // Until the view is known only the own vessel is subscribed
+static bool ownPositionKnown = false;  // A position of the current MMSI was received, so the area can be extended by it
+static double ownLatitude = 0;         // Last position of the own vessel
+static double ownLongitude = 0;
+static struct BoundingBox sentArea;    // Area of the last subscription (valid if sentAreaSet)
+static bool sentAreaSet = false;       // Last subscription was an area instead of the own MMSI
+
+static portMUX_TYPE subscriptionLock = portMUX_INITIALIZER_UNLOCKED; // Guards ship_mmsi, ownMmsi and the subscription state
+static TaskHandle_t websocketTaskHandle = NULL; // Gets notified if subscription has to be (re)sent
+
+// Reconnect requests for websocket task (set by event handlers)
+static volatile bool connectionLost = false; // WebSocket got disconnected or could not connect
+static volatile bool linkRestored = false;   // WiFi got (new) IP, reconnect immediately
+static volatile bool linkLost = false;       // WiFi is gone, don't try to connect
+static volatile bool streamHealthy = false;  // Data was received on current connection
+static bool handshakeRunning = false;        // Performance lock is held for the TLS handshake (only used in WebSocket task)
+static int64_t connectStartedAt = 0;         // Timepoint the current connection attempt started (0 once a position arrived, client task only)
 
 bool sendSinceLastConnection = false;
 static const char *LOG_TAG = "aisstream";
-lv_obj_t *lastErrorPopup = NULL;
+static lv_obj_t *lastErrorPopup = NULL; // Only accessed by LVGL task
+static bool errorShown = false;          // Error popup was requested and not closed by us yet
 
-void parseData(const esp_websocket_event_data_t *data)
+#if CONFIG_AIS_STREAM_STATS
+static struct Histogram parseLatency; // Time (us) parseData() took per message
+static atomic_uint_fast32_t receivedMessages = 0; // Messages since last report (counted in client task, reset by websocket task)
+static atomic_uint_fast32_t allocations = 0;      // Heap allocations of cJSON since last report
+static int64_t lastReport = 0;                    // Timepoint of last report
+
+// Prints statistics if interval elapsed and resets them
+static void report_stats()
 {
-    ESP_LOGI(LOG_TAG, "Data Length: %d, OP-Code: %d, Data: %.*s", data->data_len, data->op_code, data->data_len, (char *)data->data_ptr);
-    if (data->op_code != WS_TRANSPORT_OPCODES_TEXT && data->op_code != WS_TRANSPORT_OPCODES_BINARY)
+    int64_t now = esp_timer_get_time();
+    int64_t elapsedUs = now - lastReport;
+    if (elapsedUs < (int64_t)CONFIG_AIS_STREAM_STATS_INTERVAL_S * 1000 * 1000)
     {
-        ESP_LOGW(LOG_TAG, "No data to parse were received");
-        if (lastAisData.validity == NO_CONNECTION) // First connection but no data
-        {
-            lastAisData.validity = CONNECTION_BUT_NO_DATA;
-        }
         return;
     }
 
-    char *json_data = strndup(data->data_ptr, data->data_len); // Create a null-terminated string
-    if (json_data == NULL)
+    uint32_t messages = (uint32_t)atomic_exchange(&receivedMessages, 0);
+    uint32_t messageAllocations = (uint32_t)atomic_exchange(&allocations, 0);
+    ESP_LOGI(LOG_TAG, "Stats: %.1f msg/s, parse latency p50: %" PRIu32 " us, p90: %" PRIu32 " us, p99: %" PRIu32 " us, max: %" PRIu32 " us, allocations/msg: %.1f",
+             messages * 1000000.0 / elapsedUs,
+             histogram_percentile(&parseLatency, 50),
+             histogram_percentile(&parseLatency, 90),
+             histogram_percentile(&parseLatency, 99),
+             (uint32_t)atomic_load(&parseLatency.max),
+             messages ? (double)messageAllocations / messages : 0.0);
+
+    histogram_reset(&parseLatency);
+    lastReport = now;
+}
+#endif
+
+#if CONFIG_AIS_STREAM_STATS || CONFIG_APP_HEAP_STATS
+// malloc of cJSON, counts allocations of parser and accounts them to the JSON heap tag
+static void *json_malloc(size_t size)
+{
+#if CONFIG_AIS_STREAM_STATS
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+#endif
+    return heap_stats_malloc(HEAP_TAG_JSON, size, 0);
+}
+
+static void json_free(void *ptr)
+{
+    heap_stats_free(HEAP_TAG_JSON, ptr);
+}
+#endif
+
+// Replaces the not yet consumed AIS-Data by given one (latest wins)
+static void publish_ais_data(const struct AIS_DATA *update)
+{
+    taskENTER_CRITICAL(&aisDataLock);
+    latestAisData = *update;
+    aisDataPending = true;
+    taskEXIT_CRITICAL(&aisDataLock);
+    app_events_post(APP_EVENT_AIS_DATA);
+}
+
+// Lets websocket task (re)send the subscription
+static void request_subscription()
+{
+    sendSinceLastConnection = false;
+    if (websocketTaskHandle != NULL)
     {
-        ESP_LOGE(LOG_TAG, "Failed to allocate memory for JSON data");
-        return;
+        xTaskNotifyGive(websocketTaskHandle);
     }
+}
 
-    cJSON *root = cJSON_Parse(json_data);
-    if (root == NULL)
+// Shows error reported by aisstream (runs in LVGL task). Only one popup at a time
+static void show_stream_error(const char *message)
+{
+    if (!lv_obj_is_valid(lastErrorPopup)) // e.g. if the pop up got closed by user
     {
-        ESP_LOGE(LOG_TAG, "Failed to parse JSON");
-        if (lastAisData.validity == NO_CONNECTION) // First connection but no data
-        {
-            lastAisData.validity = CONNECTION_BUT_NO_DATA;
-        }
-        cJSON_Delete(root);
-        free(json_data);
-        return;
+        lastErrorPopup = show_error_message(message);
     }
+}
 
-    const cJSON *meta_data = cJSON_GetObjectItem(root, "MetaData");
-
-    if (!lv_obj_is_valid(lastErrorPopup)) // e.g. if the pop up got closed by user
+// Closes error popup again (runs in LVGL task)
+static void close_stream_error(const char *)
+{
+    if (lv_obj_is_valid(lastErrorPopup))
     {
-        lastErrorPopup = NULL;
+        lv_obj_del(lastErrorPopup);
     }
+    lastErrorPopup = NULL;
+}
 
-    const cJSON *error = cJSON_GetObjectItem(root, "error");
-    if (error == NULL)
+// Resubscribes once the own vessel comes close to the border of the subscribed area, so it doesn't drop out of the stream
+static void track_own_position(const double latitude, const double longitude)
+{
+    taskENTER_CRITICAL(&subscriptionLock);
+    const double inner = OWN_AREA_MARGIN_DEG / 2;
+    bool nearBorder = (latitude < sentArea.latMin + inner && sentArea.latMin > -90) ||
+                      (latitude > sentArea.latMax - inner && sentArea.latMax < 90) ||
+                      (longitude < sentArea.lonMin + inner && sentArea.lonMin > -180) ||
+                      (longitude > sentArea.lonMax - inner && sentArea.lonMax < 180); // Borders of the world can't be extended
+    bool resubscribe = subscriptionBoxSet && (!sentAreaSet || nearBorder);
+    ownLatitude = latitude;
+    ownLongitude = longitude;
+    ownPositionKnown = true;
+    taskEXIT_CRITICAL(&subscriptionLock);
+    if (resubscribe)
     {
-        ESP_LOGE("JSON", "Unexpected error");
+        request_subscription();
     }
-    else
+}
+
+void parseData(const esp_websocket_event_data_t *data)
+{
+    ESP_LOGI(LOG_TAG, "Data Length: %d, OP-Code: %d, Data: %.*s", data->data_len, data->op_code, data->data_len, (char *)data->data_ptr);
+    if (data->op_code != WS_TRANSPORT_OPCODES_TEXT && data->op_code != WS_TRANSPORT_OPCODES_BINARY)
     {
-        ESP_LOGE("JSON", "Specific error occurred shown in message");
-        if (lastErrorPopup == NULL)
+        ESP_LOGW(LOG_TAG, "No data to parse were received");
+        if (validity == NO_CONNECTION) // First connection but no data
         {
-            lastErrorPopup = show_error_message(error->valuestring);
+            validity = CONNECTION_BUT_NO_DATA;
         }
-        
-        lastAisData.validity = CONNECTION_BUT_CORRUPT_DATA;
-        cJSON_Delete(root);
-        free(json_data);
         return;
     }
 
-    // At this point there are no AISStream errors anymore
-    if (lastErrorPopup)
-    {
-        lv_obj_del(lastErrorPopup);
-        lastErrorPopup = NULL;
-    }
+    taskENTER_CRITICAL(&subscriptionLock);
+    const int mmsi = ownMmsi;
+    taskEXIT_CRITICAL(&subscriptionLock);
+    struct AIS_MESSAGE message = {.own = latestAisData}; // Fields missing in this message keep their last value
+    enum AIS_MESSAGE_TYPE type = ais_parse_message(data->data_ptr, data->data_len, mmsi, TRAFFIC_MODE, &message);
 
-    if (meta_data == NULL)
+    // Unless there is an AISStream error, close its popup again
+    if (errorShown && type != AIS_MESSAGE_INVALID && type != AIS_MESSAGE_ERROR)
     {
-        ESP_LOGE("JSON", "MetaData object not found");
-        lastAisData.validity = CONNECTION_BUT_CORRUPT_DATA;
-        cJSON_Delete(root);
-        free(json_data);
-        return;
+        errorShown = !display_post(close_stream_error, NULL);
     }
 
-    const cJSON *mmsi = cJSON_GetObjectItem(meta_data, "MMSI");
-    if (cJSON_IsNumber(mmsi))
+    switch (type)
     {
-        // MMSI
-        ESP_LOGI(LOG_TAG, "MMSI: %d", mmsi->valueint);
-        lastAisData.validity = VALID;
-        lastAisData.mmsi = mmsi->valueint;
-
-        // Longitude
-        const cJSON *longitude = cJSON_GetObjectItem(meta_data, "Longitude");
-        if (cJSON_IsNumber(longitude))
-        {
-            ESP_LOGI(LOG_TAG, "Longitude: %f", longitude->valuedouble);
-            lastAisData.longitude = longitude->valuedouble;
-        }
-        else
+    case AIS_MESSAGE_INVALID:
+        if (validity == NO_CONNECTION) // First connection but no data
         {
-            ESP_LOGW(LOG_TAG, "Unable to get Longitude");
-            lastAisData.validity = CONNECTION_BUT_CORRUPT_DATA;
+            validity = CONNECTION_BUT_NO_DATA;
         }
-
-        // Latitude
-        const cJSON *latitude = cJSON_GetObjectItem(meta_data, "Latitude");
-        if (cJSON_IsNumber(latitude))
-        {
-            ESP_LOGI(LOG_TAG, "Latitude: %f", latitude->valuedouble);
-            lastAisData.latitude = latitude->valuedouble;
-        }
-        else
-        {
-            ESP_LOGW(LOG_TAG, "Unable to get Latitude");
-            lastAisData.validity = CONNECTION_BUT_CORRUPT_DATA;
-        }
-
-        // ShipName
-        const cJSON *shipName = cJSON_GetObjectItem(meta_data, "ShipName");
-        if (cJSON_IsString(shipName))
-        {
-            if (shipName->valuestring != NULL && strlen(shipName->valuestring))
-            {
-                ESP_LOGI(LOG_TAG, "ShipName: %s", shipName->valuestring);
-                lastAisData.shipName = strdup(shipName->valuestring);
-            }
-            else
-            {
-                ESP_LOGW(LOG_TAG, "Empty name. Ignoring it.");
-            }
-        }
-        else
+        break;
+    case AIS_MESSAGE_ERROR:
+        if (!errorShown && message.error[0] != '\0')
         {
-            ESP_LOGW(LOG_TAG, "Unable to get ShipName");
-            lastAisData.validity = CONNECTION_BUT_CORRUPT_DATA;
+            errorShown = display_post(show_stream_error, message.error);
         }
-
-        // time_utc
-        const cJSON *timeUTC = cJSON_GetObjectItem(meta_data, "time_utc");
-        if (cJSON_IsString(timeUTC))
+        validity = CONNECTION_BUT_CORRUPT_DATA;
+        break;
+    case AIS_MESSAGE_CORRUPT:
+        validity = CONNECTION_BUT_CORRUPT_DATA;
+        break;
+    case AIS_MESSAGE_IGNORED:
+        break;
+    case AIS_MESSAGE_TRAFFIC:
+#if CONFIG_AIS_TRAFFIC_MODE
+        ais_targets_update(message.traffic.mmsi, message.traffic.latitude, message.traffic.longitude, message.traffic.shipName);
+        app_events_post(APP_EVENT_AIS_TRAFFIC);
+#endif
+        break;
+    case AIS_MESSAGE_OWN:
+        validity = VALID;
+        publish_ais_data(&message.own);
+        if (TRAFFIC_MODE)
         {
-            ESP_LOGI(LOG_TAG, "timeUTC: %s", timeUTC->valuestring);
-            lastAisData.time_utc = strdup(timeUTC->valuestring);
+            track_own_position(message.own.latitude, message.own.longitude);
         }
-        else
+        if (connectStartedAt != 0)
         {
-            ESP_LOGW(LOG_TAG, "Unable to get timeUTC");
-            lastAisData.validity = CONNECTION_BUT_CORRUPT_DATA;
+            ESP_LOGI(LOG_TAG, "First position %" PRId64 " ms after connecting", (esp_timer_get_time() - connectStartedAt) / 1000);
+            connectStartedAt = 0;
         }
+        break;
     }
-    else
-    {
-        ESP_LOGW(LOG_TAG, "MMSI not found or not a number");
-        lastAisData.validity = CONNECTION_BUT_CORRUPT_DATA;
-    }
-
-    // Clean up
-    cJSON_Delete(root);
-    free(json_data);
 }
 
 // WebSocket Event Handler
 static void websocket_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
     const esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+    const enum Validity previousValidity = validity;
+
+    // TLS handshake is the most expensive part of the stream, so it runs at full speed
+    if (event_id == WEBSOCKET_EVENT_BEFORE_CONNECT && !handshakeRunning)
+    {
+        handshakeRunning = true;
+        power_performance_begin();
+    }
+    else if (handshakeRunning && event_id != WEBSOCKET_EVENT_BEGIN && event_id != WEBSOCKET_EVENT_BEFORE_CONNECT)
+    {
+        handshakeRunning = false;
+        power_performance_end();
+    }
 
     switch (event_id)
     {
     case WEBSOCKET_EVENT_BEFORE_CONNECT:
+        connectStartedAt = esp_timer_get_time();
+        ESP_LOGI(LOG_TAG, "Establishing connection");
+        break;
     case WEBSOCKET_EVENT_BEGIN:
         ESP_LOGI(LOG_TAG, "Establishing connection");
         break;
     case WEBSOCKET_EVENT_CONNECTED:
         ESP_LOGI(LOG_TAG, "WebSocket Connected");
+        request_subscription();
         break;
     case WEBSOCKET_EVENT_CLOSED:
     case WEBSOCKET_EVENT_FINISH:
     case WEBSOCKET_EVENT_DISCONNECTED:
         ESP_LOGI(LOG_TAG, "WebSocket Closed/Finish/Disconnected");
         sendSinceLastConnection = false;
-        lastAisData.validity = NO_CONNECTION;
+        validity = NO_CONNECTION;
+        if (event_id != WEBSOCKET_EVENT_FINISH) // FINISH is also sent if the client got stopped on purpose
+        {
+            connectionLost = true;
+            xTaskNotifyGive(websocketTaskHandle);
+        }
         break;
     case WEBSOCKET_EVENT_DATA:
+    {
+#if CONFIG_AIS_CAPTURE
+        int64_t receiveTime = esp_timer_get_time(); // Replay timing, taken before logging
+#endif
         ESP_LOGI(LOG_TAG, "Received WebSocket Data");
+#if CONFIG_AIS_CAPTURE
+        if (data->op_code == WS_TRANSPORT_OPCODES_TEXT || data->op_code == WS_TRANSPORT_OPCODES_BINARY)
+        {
+            printf("AISCAP\t%" PRId64 "\t%.*s\n", receiveTime, data->data_len, (char *)data->data_ptr);
+        }
+#endif
+        power_performance_begin();
+        int64_t parseStart = esp_timer_get_time(); // After logging and capture, so that only parsing is measured
         parseData(data);
+        int64_t parseEnd = esp_timer_get_time();
+        power_performance_end();
+        if (!streamHealthy && validity >= CONNECTION_BUT_CORRUPT_DATA)
+        {
+            streamHealthy = true;
+            xTaskNotifyGive(websocketTaskHandle);
+        }
+#if CONFIG_AIS_STREAM_STATS
+        histogram_record(&parseLatency, (uint32_t)(parseEnd - parseStart));
+        atomic_fetch_add_explicit(&receivedMessages, 1, memory_order_relaxed);
+#endif
+        (void)parseStart;
+        (void)parseEnd;
         break;
+    }
     case WEBSOCKET_EVENT_ERROR:
         ESP_LOGE(LOG_TAG, "WebSocket Error");
-        lastAisData.validity = NO_CONNECTION;
+        validity = NO_CONNECTION;
         break;
     default:
         ESP_LOGE(LOG_TAG, "Unknown Error: %" PRId32, event_id);
-        lastAisData.validity = NO_CONNECTION;
+        validity = NO_CONNECTION;
         break;
     }
+
+    if (validity != previousValidity)
+    {
+        app_events_post(APP_EVENT_AIS_STATE);
+    }
+}
+
+// WiFi/IP Event Handler, lets the websocket follow the link state
+static void link_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    {
+        linkRestored = true;
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+    {
+        linkLost = true;
+    }
+    else
+    {
+        return;
+    }
+
+    if (websocketTaskHandle != NULL)
+    {
+        xTaskNotifyGive(websocketTaskHandle);
+    }
+}
+
+// Returns a random delay in [backoff/2, backoff] so that many devices don't reconnect in lockstep
+static uint32_t jittered(const uint32_t backoffMs)
+{
+    return backoffMs / 2 + esp_random() % (backoffMs / 2 + 1);
 }
 
 void websocket_task(void *)
 {
+    // Reconnects are done by this task (immediately after WiFi came back, else with backoff)
     esp_websocket_client_config_t websocket_cfg = {
         .uri = WEBSOCKET_URI,
-        .skip_cert_common_name_check = true};
+        .skip_cert_common_name_check = true,
+        .disable_auto_reconnect = true,
+        .ping_interval_sec = PING_INTERVAL_S,
+        .pingpong_timeout_sec = PINGPONG_TIMEOUT_S};
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // With TLS the session of the last connection is resumed on reconnects, which saves most of the handshake
+    if (strncmp(WEBSOCKET_URI, "wss://", 6) == 0)
+    {
+        esp_transport_handle_t tls = tls_resume_transport_init();
+        esp_transport_handle_t ws = (tls != NULL) ? esp_transport_ws_init(tls) : NULL;
+        if (ws != NULL)
+        {
+            const char *path = strchr(WEBSOCKET_URI + 6, '/');
+            esp_transport_ws_set_path(ws, (path != NULL) ? path : "/");
+            esp_transport_set_default_port(ws, 443);
+            websocket_cfg.ext_transport = ws;
+        }
+        else if (tls != NULL)
+        {
+            esp_transport_destroy(tls);
+        }
+    }
+#endif
 
     esp_websocket_client_handle_t client = esp_websocket_client_init(&websocket_cfg);
     esp_websocket_register_events(client, WEBSOCKET_EVENT_ANY, websocket_event_handler, NULL);
 
-    // Start the WebSocket client
-    esp_websocket_client_start(client);
+#if CONFIG_AIS_STREAM_STATS
+    const TickType_t wakeupPeriod = pdMS_TO_TICKS(CONFIG_AIS_STREAM_STATS_INTERVAL_S * 1000);
+#else
+    const TickType_t wakeupPeriod = portMAX_DELAY;
+#endif
+
+    bool clientRunning = false;
+    uint32_t backoffMs = RECONNECT_BACKOFF_MIN_MS;
+    int64_t reconnectAt = esp_timer_get_time(); // Timepoint of next connection attempt (0 = none scheduled)
 
     while (true)
     {
+        int64_t now = esp_timer_get_time();
+
+        if (linkLost)
+        {
+            // No need to burn handshakes without a link. linkRestored will trigger reconnect
+            linkLost = false;
+            connectionLost = false;
+            if (clientRunning && wifi_get_state() != CONNECTED)
+            {
+                ESP_LOGI(LOG_TAG, "WiFi lost, stopping WebSocket");
+                esp_websocket_client_stop(client);
+                clientRunning = false;
+                reconnectAt = now;
+            }
+        }
+
+        if (connectionLost)
+        {
+            connectionLost = false;
+            streamHealthy = false;
+            if (clientRunning)
+            {
+                esp_websocket_client_stop(client);
+                clientRunning = false;
+            }
+            uint32_t delayMs = jittered(backoffMs);
+            ESP_LOGI(LOG_TAG, "Reconnecting in %" PRIu32 " ms", delayMs);
+            reconnectAt = now + (int64_t)delayMs * 1000;
+            backoffMs = (backoffMs * 2 > RECONNECT_BACKOFF_MAX_MS) ? RECONNECT_BACKOFF_MAX_MS : backoffMs * 2;
+        }
+
+        if (linkRestored)
+        {
+            // Fast path after a WiFi blip: the server is most likely fine, so don't wait
+            linkRestored = false;
+            backoffMs = RECONNECT_BACKOFF_MIN_MS;
+            if (!clientRunning)
+            {
+                reconnectAt = now;
+            }
+        }
+
+        if (streamHealthy)
+        {
+            backoffMs = RECONNECT_BACKOFF_MIN_MS; // Connection proved to work
+        }
+
+        if (!clientRunning && reconnectAt != 0 && now >= reconnectAt && wifi_get_state() == CONNECTED)
+        {
+            ESP_LOGI(LOG_TAG, "Connecting WebSocket");
+            reconnectAt = 0;
+            clientRunning = (esp_websocket_client_start(client) == ESP_OK);
+            if (!clientRunning)
+            {
+                connectionLost = true;
+                continue;
+            }
+        }
+
         if (esp_websocket_client_is_connected(client) && !sendSinceLastConnection)
         {
-            const uint8_t MAX_SIZE = 255;
+            // Take a consistent copy, setters are called from other tasks
+            char mmsi[MMSI_LENGTH];
+            struct BoundingBox box;
+            taskENTER_CRITICAL(&subscriptionLock);
+            // The area replaces the MMSI filter, so it has to contain the own vessel. Until its position is known, the vessel
+            // is searched globally
+            bool boxSet = subscriptionBoxSet && ownPositionKnown;
+            box = subscriptionBox;
+            if (boxSet)
+            {
+                box.latMin = fmax(fmin(box.latMin, ownLatitude - OWN_AREA_MARGIN_DEG), -90);
+                box.lonMin = fmax(fmin(box.lonMin, ownLongitude - OWN_AREA_MARGIN_DEG), -180);
+                box.latMax = fmin(fmax(box.latMax, ownLatitude + OWN_AREA_MARGIN_DEG), 90);
+                box.lonMax = fmin(fmax(box.lonMax, ownLongitude + OWN_AREA_MARGIN_DEG), 180);
+                sentArea = box;
+            }
+            sentAreaSet = boxSet;
+            strcpy(mmsi, ship_mmsi);
+            taskEXIT_CRITICAL(&subscriptionLock);
+
+            const uint16_t MAX_SIZE = 320;
             char msg[MAX_SIZE];
-            snprintf(msg, MAX_SIZE, "{\"APIKey\":\"" AISSTREAM_API_KEY "\",\"BoundingBoxes\":[[[-90,-180],[90,180]]],\"FiltersShipMMSI\":[\"%s\"]}", ship_mmsi);
+            if (boxSet)
+            {
+                // Everything around the view and the own vessel
+                snprintf(msg, MAX_SIZE, "{\"APIKey\":\"" AISSTREAM_API_KEY "\",\"BoundingBoxes\":[[[%.5f,%.5f],[%.5f,%.5f]]]}",
+                         box.latMin, box.lonMin, box.latMax, box.lonMax);
+            }
+            else
+            {
+                snprintf(msg, MAX_SIZE, "{\"APIKey\":\"" AISSTREAM_API_KEY "\",\"BoundingBoxes\":[[[-90,-180],[90,180]]],\"FiltersShipMMSI\":[\"%s\"]}", mmsi);
+            }
             ESP_LOGI(LOG_TAG, "Sending: %s", msg);
             esp_websocket_client_send_text(client, msg, strlen(msg), portMAX_DELAY);
             sendSinceLastConnection = true;
         }
 
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+#if CONFIG_AIS_STREAM_STATS
+        report_stats();
+#endif
+
+        // Sleep until subscription has to be sent (connected, MMSI or area changed), connection changed or reconnect is due
+        TickType_t waitTicks = wakeupPeriod;
+        if (!clientRunning && reconnectAt != 0 && wifi_get_state() == CONNECTED)
+        {
+            int64_t untilReconnectUs = reconnectAt - esp_timer_get_time();
+            TickType_t reconnectTicks = (untilReconnectUs > 0) ? pdMS_TO_TICKS(untilReconnectUs / 1000) + 1 : 0; // Round up
+            waitTicks = (reconnectTicks < waitTicks) ? reconnectTicks : waitTicks;
+        }
+        ulTaskNotifyTake(pdTRUE, waitTicks);
     }
 
     esp_websocket_client_stop(client);
@@ -251,18 +535,65 @@ void websocket_task(void *)
 
 void set_mmsi(const char mmsi[MMSI_LENGTH])
 {
+    const int number = atoi(mmsi);
+    taskENTER_CRITICAL(&subscriptionLock);
     strcpy(ship_mmsi, mmsi);
-    sendSinceLastConnection = false; // bad way to notify thread
+    ownMmsi = number;
+    subscriptionBoxSet = false; // New vessel may be anywhere, search it globally until the view follows it
+    ownPositionKnown = false;
+    taskEXIT_CRITICAL(&subscriptionLock);
+    request_subscription();
+}
+
+void set_bounding_box(const struct BoundingBox *box)
+{
+#if CONFIG_AIS_TRAFFIC_MODE
+    if (subscriptionBoxSet && memcmp(&subscriptionBox, box, sizeof(subscriptionBox)) == 0)
+    {
+        return; // Already subscribed
+    }
+    taskENTER_CRITICAL(&subscriptionLock);
+    subscriptionBox = *box;
+    subscriptionBoxSet = true;
+    taskEXIT_CRITICAL(&subscriptionLock);
+    ais_targets_set_area(box);
+    request_subscription();
+#endif
 }
 
 void setup_aisstream(const char mmsi[MMSI_LENGTH])
 {
+#if CONFIG_AIS_TRAFFIC_MODE
+    ais_targets_init();
+#endif
+#if CONFIG_AIS_STREAM_STATS || CONFIG_APP_HEAP_STATS
+    cJSON_Hooks hooks = {.malloc_fn = json_malloc, .free_fn = json_free};
+    cJSON_InitHooks(&hooks);
+#endif
+#if CONFIG_AIS_STREAM_STATS
+    lastReport = esp_timer_get_time();
+#endif
     set_mmsi(mmsi);
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, link_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, link_event_handler, NULL));
     // Start WebSocket task
-    xTaskCreate(&websocket_task, "websocket_task", 8192, NULL, 5, NULL);
+    xTaskCreate(&websocket_task, "websocket_task", 8192, NULL, 5, &websocketTaskHandle);
 }
 
-struct AIS_DATA *get_last_ais_data()
+enum Validity get_ais_validity()
 {
-    return &lastAisData;
+    return validity;
+}
+
+bool take_ais_update(struct AIS_DATA *data)
+{
+    taskENTER_CRITICAL(&aisDataLock);
+    bool pending = aisDataPending;
+    if (pending)
+    {
+        *data = latestAisData;
+        aisDataPending = false;
+    }
+    taskEXIT_CRITICAL(&aisDataLock);
+    return pending;
 }
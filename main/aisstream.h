@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include "global.h"
+#include "ais_parser.h"
 
 enum Validity
 {
@@ -12,24 +13,19 @@ enum Validity
     VALID
 };
 
-// Received data via AISStream
-struct AIS_DATA
-{
-    double longitude;       // Current longitude
-    double latitude;        // Current latitude
-    char *time_utc;         // Timepoint of last AIS data
-    int mmsi;               // MMSI of ship
-    char *shipName;         // Name of ship
-    enum Validity validity; // Validity of this struct
-};
-
 // Setup for web socket task
 void setup_aisstream(const char mmsi[MMSI_LENGTH]);
 
 // Sets new MMSI
 void set_mmsi(const char mmsi[MMSI_LENGTH]);
 
-// Returns last AIS-Data struct
-struct AIS_DATA *get_last_ais_data();
+// Sets area to receive surrounding traffic of (only used in traffic mode)
+void set_bounding_box(const struct BoundingBox *box);
+
+// Returns current state of connection and data
+enum Validity get_ais_validity();
+
+// Copies latest valid AIS-Data into data if there was an update since last call. Bursts of updates are coalesced, only the latest one is returned
+bool take_ais_update(struct AIS_DATA *data);
 
 #endif // AISSTREAM_H_
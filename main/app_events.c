@@ -0,0 +1,27 @@
+#include "app_events.h"
+
+static EventGroupHandle_t appEvents = NULL;
+
+void app_events_init()
+{
+    static StaticEventGroup_t appEventsBuffer;
+    appEvents = xEventGroupCreateStatic(&appEventsBuffer);
+}
+
+void app_events_post(const EventBits_t events)
+{
+    if (appEvents != NULL)
+    {
+        xEventGroupSetBits(appEvents, events);
+    }
+}
+
+EventBits_t app_events_wait(const TickType_t timeout)
+{
+    return xEventGroupWaitBits(appEvents, APP_EVENT_ALL, pdTRUE, pdFALSE, timeout) & APP_EVENT_ALL;
+}
+
+EventBits_t app_events_pending()
+{
+    return (appEvents != NULL) ? (xEventGroupGetBits(appEvents) & APP_EVENT_ALL) : 0;
+}
@@ -0,0 +1,30 @@
+#ifndef APP_EVENTS_H_
+#define APP_EVENTS_H_
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+// Events the application core reacts on
+#define APP_EVENT_WIFI BIT0        // WiFi state changed
+#define APP_EVENT_AIS_STATE BIT1   // Validity of AIS connection/data changed
+#define APP_EVENT_AIS_DATA BIT2    // New own vessel data available (see take_ais_update)
+#define APP_EVENT_AIS_TRAFFIC BIT3 // Surrounding traffic changed
+#define APP_EVENT_ZOOM BIT4        // User changed zoom level
+#define APP_EVENT_MAP BIT5         // User panned the map or it follows the ship again
+#define APP_EVENT_FLUSH BIT6       // Stored state is due to be written to NVS (see flush_stored_state)
+#define APP_EVENT_ALL (APP_EVENT_WIFI | APP_EVENT_AIS_STATE | APP_EVENT_AIS_DATA | APP_EVENT_AIS_TRAFFIC | APP_EVENT_ZOOM | APP_EVENT_MAP | \
+                       APP_EVENT_FLUSH)
+
+// Creates the event group. Call this before any other module is set up
+void app_events_init();
+
+// Signals given events to the application core (may be called from any task)
+void app_events_post(const EventBits_t events);
+
+// Waits until at least one event occurred or timeout elapsed. Returns (and clears) occurred events
+EventBits_t app_events_wait(const TickType_t timeout);
+
+// Returns occurred events without clearing them (e.g. to abandon work a new event made obsolete)
+EventBits_t app_events_pending();
+
+#endif // APP_EVENTS_H_
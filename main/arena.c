@@ -0,0 +1,61 @@
+#include "arena.h"
+
+#define ALIGNMENT 8
+
+// Precedes every block, so that realloc knows how much to copy
+struct BlockHeader
+{
+    size_t size;
+    size_t reserved; // Keeps blocks 8 byte aligned on 32 bit targets
+};
+
+_Static_assert(sizeof(struct BlockHeader) % ALIGNMENT == 0, "Header has to keep blocks aligned");
+
+void arena_init(struct Arena *arena, void *memory, const size_t size)
+{
+    // Start aligned, whatever the buffer's alignment is
+    uintptr_t start = ((uintptr_t)memory + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1);
+    size_t skipped = start - (uintptr_t)memory;
+    arena->memory = (uint8_t *)start;
+    arena->size = (size > skipped) ? size - skipped : 0;
+    arena->used = 0;
+    arena->mark = 0;
+    arena->peak = 0;
+}
+
+void *arena_alloc(struct Arena *arena, const size_t size)
+{
+    size_t blockSize = sizeof(struct BlockHeader) + ((size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1));
+    if (size > arena->size || blockSize > arena->size - arena->used)
+    {
+        return NULL;
+    }
+    struct BlockHeader *header = (struct BlockHeader *)(arena->memory + arena->used);
+    header->size = size;
+    arena->used += blockSize;
+    if (arena->used > arena->peak)
+    {
+        arena->peak = arena->used;
+    }
+    return header + 1;
+}
+
+bool arena_contains(const struct Arena *arena, const void *ptr)
+{
+    return (const uint8_t *)ptr >= arena->memory && (const uint8_t *)ptr < arena->memory + arena->size;
+}
+
+size_t arena_block_size(const void *ptr)
+{
+    return ((const struct BlockHeader *)ptr - 1)->size;
+}
+
+void arena_set_mark(struct Arena *arena)
+{
+    arena->mark = arena->used;
+}
+
+void arena_reset(struct Arena *arena)
+{
+    arena->used = arena->mark;
+}
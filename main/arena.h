@@ -0,0 +1,37 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator on a preallocated buffer. Blocks aren't freed one by one, the arena is reset instead. No dependencies, also built on host
+
+struct Arena
+{
+    uint8_t *memory;
+    size_t size;
+    size_t used; // Bytes handed out (including headers)
+    size_t mark; // arena_reset keeps everything below
+    size_t peak; // Most bytes used at once
+};
+
+// Uses given buffer for allocations
+void arena_init(struct Arena *arena, void *memory, const size_t size);
+
+// Returns 8 byte aligned block of given size or NULL if arena is full
+void *arena_alloc(struct Arena *arena, const size_t size);
+
+// Checks if ptr was allocated from arena
+bool arena_contains(const struct Arena *arena, const void *ptr);
+
+// Returns the requested size of a block allocated from arena
+size_t arena_block_size(const void *ptr);
+
+// Keeps everything allocated so far across arena_reset (e.g. state living as long as the arena)
+void arena_set_mark(struct Arena *arena);
+
+// Releases all blocks allocated after the mark
+void arena_reset(struct Arena *arena);
+
+#endif // ARENA_H_
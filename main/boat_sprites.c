@@ -0,0 +1,69 @@
+#include "boat_sprites.h"
+
+#include <math.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "heap_stats.h"
+
+// Sprites are squares fitting the marker in any rotation (diagonal of 29x28 pixels)
+#define SPRITE_SIZE 41
+#define SPRITE_BYTES (SPRITE_SIZE * SPRITE_SIZE * LV_IMG_PX_SIZE_ALPHA_BYTE)
+#define DEGREES_PER_SPRITE (360.0 / BOAT_SPRITE_COUNT)
+
+LV_IMG_DECLARE(smallBoat);
+
+static const char *LOG_TAG = "boat_sprites";
+
+static lv_img_dsc_t sprites[BOAT_SPRITE_COUNT];
+static bool spritesReady = false;
+
+esp_err_t boat_sprites_init()
+{
+    uint8_t *buffer = heap_stats_calloc(HEAP_TAG_DISPLAY, BOAT_SPRITE_COUNT, SPRITE_BYTES, MALLOC_CAP_SPIRAM);
+    if (buffer == NULL)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to allocate memory for boat sprites in PSRAM");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Let LVGL render each rotation into a hidden canvas, once
+    lv_obj_t *canvas = lv_canvas_create(lv_scr_act());
+    lv_obj_add_flag(canvas, LV_OBJ_FLAG_HIDDEN);
+    for (int i = 0; i < BOAT_SPRITE_COUNT; i++)
+    {
+        uint8_t *data = buffer + i * SPRITE_BYTES;
+        lv_canvas_set_buffer(canvas, data, SPRITE_SIZE, SPRITE_SIZE, LV_IMG_CF_TRUE_COLOR_ALPHA);
+        lv_canvas_fill_bg(canvas, lv_color_white(), LV_OPA_TRANSP);
+        lv_canvas_transform(canvas, (lv_img_dsc_t *)&smallBoat, (int16_t)lround(i * DEGREES_PER_SPRITE * 10), LV_IMG_ZOOM_NONE,
+                            (SPRITE_SIZE - smallBoat.header.w) / 2, (SPRITE_SIZE - smallBoat.header.h) / 2,
+                            smallBoat.header.w / 2, smallBoat.header.h / 2, true);
+
+        sprites[i].header.always_zero = 0;
+        sprites[i].header.w = SPRITE_SIZE;
+        sprites[i].header.h = SPRITE_SIZE;
+        sprites[i].header.cf = LV_IMG_CF_TRUE_COLOR_ALPHA;
+        sprites[i].data_size = SPRITE_BYTES;
+        sprites[i].data = data;
+    }
+    lv_obj_del(canvas);
+
+    spritesReady = true;
+    ESP_LOGI(LOG_TAG, "Rendered %d boat sprites (%d bytes)", BOAT_SPRITE_COUNT, BOAT_SPRITE_COUNT * SPRITE_BYTES);
+    return ESP_OK;
+}
+
+const lv_img_dsc_t *boat_sprite_for_course(const double course)
+{
+    if (!spritesReady)
+    {
+        return &smallBoat;
+    }
+    if (course < 0)
+    {
+        return &sprites[0];
+    }
+    int index = (int)lround(course / DEGREES_PER_SPRITE) % BOAT_SPRITE_COUNT;
+    return &sprites[index];
+}
@@ -0,0 +1,15 @@
+#ifndef BOAT_SPRITES_H_
+#define BOAT_SPRITES_H_
+
+#include "esp_err.h"
+#include "lvgl.h"
+
+#define BOAT_SPRITE_COUNT 36 // Pre-rotated variants of the boat marker (every 10 degrees)
+
+// Renders all rotated boat markers once (anti-aliased, into PSRAM). Call with display locked
+esp_err_t boat_sprites_init();
+
+// Returns the pre-rotated boat marker nearest to given course (degrees, clockwise from north). Negative course: unrotated marker
+const lv_img_dsc_t *boat_sprite_for_course(const double course);
+
+#endif // BOAT_SPRITES_H_
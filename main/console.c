@@ -0,0 +1,60 @@
+#include "console.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+static const char *LOG_TAG = "console";
+
+#if CONFIG_APP_CONSOLE
+static esp_console_repl_t *repl = NULL;
+#endif
+
+esp_err_t console_init()
+{
+#if CONFIG_APP_CONSOLE
+    esp_console_repl_config_t replConfig = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    replConfig.prompt = "boat>";
+    esp_console_dev_uart_config_t uartConfig = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    esp_err_t err = esp_console_new_repl_uart(&uartConfig, &replConfig, &repl);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to set up console: %s", esp_err_to_name(err));
+        return err;
+    }
+    return esp_console_register_help_command();
+#else
+    return ESP_OK;
+#endif
+}
+
+esp_err_t console_register(const char *command, const char *help, esp_console_cmd_func_t function)
+{
+#if CONFIG_APP_CONSOLE
+    if (repl == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const esp_console_cmd_t cmd = {
+        .command = command,
+        .help = help,
+        .func = function,
+    };
+    return esp_console_cmd_register(&cmd);
+#else
+    return ESP_OK;
+#endif
+}
+
+esp_err_t console_start()
+{
+#if CONFIG_APP_CONSOLE
+    if (repl == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ESP_LOGI(LOG_TAG, "Starting console, type 'help' for commands");
+    return esp_console_start_repl(repl);
+#else
+    return ESP_OK;
+#endif
+}
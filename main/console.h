@@ -0,0 +1,16 @@
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include "esp_err.h"
+#include "esp_console.h"
+
+// Sets up the serial console. Call this before any module registers commands
+esp_err_t console_init();
+
+// Adds a command to the console (e.g. for statistics of a module)
+esp_err_t console_register(const char *command, const char *help, esp_console_cmd_func_t function);
+
+// Starts reading commands from the serial console in its own task
+esp_err_t console_start();
+
+#endif // CONSOLE_H_
@@ -1,11 +1,16 @@
 #include "display.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_timer.h"
+#include "esp_attr.h"
 #include "esp_lcd_panel_ops.h"
 #include "esp_lcd_panel_rgb.h"
 #include "driver/gpio.h"
@@ -16,6 +21,10 @@
 #include "driver/i2c.h"
 
 #include "global.h"
+#include "frame_stats.h"
+#include "power.h"
+#include "heap_stats.h"
+#include "snapshot.h"
 
 #define DELAY(ms) vTaskDelay(pdMS_TO_TICKS(ms))
 
@@ -34,7 +43,13 @@ static const char *LOG_TAG = "display";
 
 esp_lcd_panel_handle_t panel_handle = NULL; // Handle of panel
 
+#if CONFIG_DISPLAY_PIPELINE_BOUNCE_BUFFER
+#define LCD_PIXEL_CLOCK_HZ (21 * 1000 * 1000) // Bounce buffers decouple PSRAM bandwidth from the pixel clock
+#define LCD_BOUNCE_BUFFER_LINES 10            // Lines per bounce buffer (two of them in internal SRAM)
+#else
 #define LCD_PIXEL_CLOCK_HZ (18 * 1000 * 1000)
+#define LCD_BOUNCE_BUFFER_LINES 0
+#endif
 #define LCD_BK_LIGHT_ON_LEVEL 1
 #define LCD_BK_LIGHT_OFF_LEVEL !LCD_BK_LIGHT_ON_LEVEL
 #define PIN_NUM_BK_LIGHT -1
@@ -60,13 +75,56 @@ esp_lcd_panel_handle_t panel_handle = NULL; // Handle of panel
 #define PIN_NUM_DATA15 40 // R7
 #define PIN_NUM_DISP_EN -1
 
+#if CONFIG_DISPLAY_PIPELINE_DOUBLE_FB
+#define LCD_NUM_FB 2
+#define LVGL_DRAW_BUF_LINES LCD_V_RES // LVGL renders directly into the frame buffers
+#else
 #define LCD_NUM_FB 1
+// One buffer in internal SRAM (64 KB at 800 px): a full redraw takes 12 flushes instead of 5 with the former 100 lines
+// in PSRAM, but rendering into SRAM is faster and the map mostly invalidates smaller areas
+#define LVGL_DRAW_BUF_LINES 40
+#endif
 
 #define LVGL_TICK_PERIOD_MS 2
 #define LVGL_TASK_MAX_DELAY_MS 500
 #define LVGL_TASK_MIN_DELAY_MS 1
-#define LVGL_TASK_STACK_SIZE (4 * 1024)
+#define LVGL_TASK_STACK_SIZE (8 * 1024) // UI callbacks (WiFi scan/connect, NVS) run in this task as well
 #define LVGL_TASK_PRIORITY 2
+#define LVGL_TASK_CORE 1               // Keep rendering away from WiFi/LwIP, which run on core 0
+#define UI_COMMAND_QUEUE_LENGTH 8
+#define TOUCH_MAX_POINTS 2 // Second finger is needed for pinch gestures
+#define DARK_TOUCH_READ_PERIOD_MS 200 // Touch polling while backlight is off
+
+// IO expander (CH422G) controlling backlight and resets
+#define EXPANDER_OUTPUT_ADDRESS 0x38
+#define EXPANDER_OUTPUT_BACKLIGHT_ON 0x2E
+#define EXPANDER_OUTPUT_BACKLIGHT_OFF 0x2A
+
+// UI mutation posted by another task
+struct UiCommand
+{
+    ui_command_t command;              // Function to run in LVGL task
+    char text[UI_COMMAND_TEXT_LENGTH]; // Copy of text passed to command
+};
+
+static SemaphoreHandle_t lvglMutex = NULL;   // Recursive, held by LVGL task while rendering
+static QueueHandle_t uiCommandQueue = NULL;  // Commands waiting for LVGL task
+
+// Pinch gesture state (only used in LVGL task)
+static pinch_callback_t pinchCallback = NULL;
+static bool pinching = false;          // Two fingers are (or were) down, touch is reported released until all are lifted
+static float pinchStartDistance = 0;   // Distance of fingers when second one touched
+static float pinchDistance = 0;        // Latest distance of fingers
+
+static lv_indev_t *touchIndev = NULL;
+static bool backlightOff = false;      // Backlight switched off because of inactivity (only used in LVGL task)
+static bool wakeTouch = false;         // Touch which switched backlight on is still down
+
+#if CONFIG_DISPLAY_PIPELINE_DOUBLE_FB || CONFIG_DISPLAY_AVOID_TEAR_EFFECT_WITH_SEM
+static SemaphoreHandle_t vsyncSemaphore = NULL; // Given by panel driver in each vertical blanking
+#endif
+
+static void lvgl_task(void *);
 
 /**
  * @brief i2c master initialization
@@ -89,16 +147,84 @@ static esp_err_t i2c_master_init(void)
     return i2c_driver_install(i2c_master_port, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0);
 }
 
+#if CONFIG_DISPLAY_PIPELINE_DOUBLE_FB || CONFIG_DISPLAY_AVOID_TEAR_EFFECT_WITH_SEM
+// Gets called by panel driver (ISR) in vertical blanking
+static bool IRAM_ATTR on_vsync(esp_lcd_panel_handle_t panel, const esp_lcd_rgb_panel_event_data_t *edata, void *user_ctx)
+{
+    BaseType_t highTaskAwoken = pdFALSE;
+    xSemaphoreGiveFromISR(vsyncSemaphore, &highTaskAwoken);
+    return highTaskAwoken == pdTRUE;
+}
+
+// Blocks until next vertical blanking started
+static void wait_for_vsync()
+{
+    xSemaphoreTake(vsyncSemaphore, 0); // Drop a vsync which happened before
+    xSemaphoreTake(vsyncSemaphore, portMAX_DELAY);
+}
+#endif
+
+#if CONFIG_DISPLAY_PIPELINE_DOUBLE_FB
+// Copies the areas LVGL just rendered from the shown buffer into the other one, so that both stay in sync
+static void sync_dirty_areas(lv_disp_drv_t *disp, const lv_color_t *shownBuffer)
+{
+    lv_color_t *backBuffer = (disp->draw_buf->buf1 == shownBuffer) ? disp->draw_buf->buf2 : disp->draw_buf->buf1;
+    const lv_disp_t *display = _lv_refr_get_disp_refreshing();
+    for (uint16_t i = 0; i < display->inv_p; i++)
+    {
+        if (display->inv_area_joined[i])
+        {
+            continue; // Part of another area
+        }
+        const lv_area_t *area = &display->inv_areas[i];
+        const size_t lineBytes = lv_area_get_width(area) * sizeof(lv_color_t);
+        for (lv_coord_t y = area->y1; y <= area->y2; y++)
+        {
+            const size_t offset = (size_t)y * LCD_H_RES + area->x1;
+            memcpy(backBuffer + offset, shownBuffer + offset, lineBytes);
+        }
+    }
+}
+#endif
+
 // Function to flush the display
 static void my_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p)
 {
+    const bool lastOfFrame = lv_disp_flush_is_last(disp); // Gets reset by lv_disp_flush_ready
+#if CONFIG_DISPLAY_PERF_LOG
+    const int64_t flushStart = esp_timer_get_time();
+#endif
+#if CONFIG_DISPLAY_PIPELINE_DOUBLE_FB
+#if CONFIG_DISPLAY_PERF_LOG
+    frame_stats_draw_outline(area, color_p + area->y1 * LCD_H_RES + area->x1, LCD_H_RES);
+#endif
+    // LVGL rendered directly into one frame buffer. Once the frame is complete, tell driver to show it
+    if (lastOfFrame)
+    {
+        esp_lcd_panel_draw_bitmap(panel_handle, 0, 0, LCD_H_RES, LCD_V_RES, color_p); // Only switches buffer, no copy
+        wait_for_vsync();                                                            // Switch happens in blanking
+        sync_dirty_areas(disp, color_p);
+    }
+    lv_disp_flush_ready(disp);
+#else
     int offsetx1 = area->x1;
     int offsetx2 = area->x2;
     int offsety1 = area->y1;
     int offsety2 = area->y2;
-    // pass the draw buffer to the driver
+#if CONFIG_DISPLAY_PERF_LOG
+    frame_stats_draw_outline(area, color_p, lv_area_get_width(area));
+#endif
+#if CONFIG_DISPLAY_AVOID_TEAR_EFFECT_WITH_SEM
+    wait_for_vsync();
+#endif
+    // pass the draw buffer to the driver. The RGB driver copies it into the frame buffer before returning (there is no
+    // asynchronous transfer on this target), so LVGL may reuse it right away
     esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, color_p);
     lv_disp_flush_ready(disp);
+#endif
+#if CONFIG_DISPLAY_PERF_LOG
+    frame_stats_flush(area, (uint32_t)(esp_timer_get_time() - flushStart), lastOfFrame);
+#endif
 }
 
 void gpio_init(void)
@@ -116,25 +242,114 @@ void gpio_init(void)
     gpio_config(&io_conf);
 }
 
+#if !CONFIG_LV_TICK_CUSTOM
 static void increase_lvgl_tick(void *arg)
 {
     /* Tell LVGL how many milliseconds has elapsed */
     lv_tick_inc(LVGL_TICK_PERIOD_MS);
 }
+#endif
+
+// Switches backlight via IO expander (CH422G)
+static void set_backlight(const bool on)
+{
+    uint8_t write_buf = on ? EXPANDER_OUTPUT_BACKLIGHT_ON : EXPANDER_OUTPUT_BACKLIGHT_OFF;
+    i2c_master_write_to_device(I2C_MASTER_NUM, EXPANDER_OUTPUT_ADDRESS, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
+}
+
+#if CONFIG_DISPLAY_BACKLIGHT_TIMEOUT_S > 0
+// Switches backlight off after a while without touch and on again on touch (LVGL task)
+static void update_backlight()
+{
+    bool inactive = lv_disp_get_inactive_time(NULL) >= CONFIG_DISPLAY_BACKLIGHT_TIMEOUT_S * 1000;
+    if (inactive == backlightOff)
+    {
+        return;
+    }
+    backlightOff = inactive;
+    set_backlight(!backlightOff);
+
+    // Nothing is visible meanwhile: don't render and poll touch less often
+    lv_disp_t *disp = lv_disp_get_default();
+    if (backlightOff)
+    {
+        lv_timer_pause(disp->refr_timer);
+        lv_timer_set_period(touchIndev->driver->read_timer, DARK_TOUCH_READ_PERIOD_MS);
+    }
+    else
+    {
+        lv_timer_resume(disp->refr_timer);
+        lv_timer_set_period(touchIndev->driver->read_timer, CONFIG_LV_INDEV_DEF_READ_PERIOD);
+        lv_obj_invalidate(lv_scr_act()); // Frame buffer may be outdated
+    }
+    ESP_LOGI(LOG_TAG, "Backlight %s", backlightOff ? "off" : "on");
+}
+#endif
+
+// Returns distance between the first two touch points
+static float touch_distance(const uint16_t *x, const uint16_t *y)
+{
+    float dx = (float)x[1] - x[0];
+    float dy = (float)y[1] - y[0];
+    return sqrtf(dx * dx + dy * dy);
+}
 
 static void example_lvgl_touch_cb(lv_indev_drv_t *drv, lv_indev_data_t *data)
 {
-    uint16_t touchpad_x[1] = {0};
-    uint16_t touchpad_y[1] = {0};
+    uint16_t touchpad_x[TOUCH_MAX_POINTS] = {0};
+    uint16_t touchpad_y[TOUCH_MAX_POINTS] = {0};
     uint8_t touchpad_cnt = 0;
 
     /* Read touch controller data */
     esp_lcd_touch_read_data(drv->user_data);
 
     /* Get coordinates */
-    bool touchpad_pressed = esp_lcd_touch_get_coordinates(drv->user_data, touchpad_x, touchpad_y, NULL, &touchpad_cnt, 1);
+    bool touchpad_pressed = esp_lcd_touch_get_coordinates(drv->user_data, touchpad_x, touchpad_y, NULL, &touchpad_cnt, TOUCH_MAX_POINTS);
+    uint8_t points = touchpad_pressed ? touchpad_cnt : 0;
+
+    // Touch on dark screen only switches backlight on, widgets must not see it
+    if (backlightOff || wakeTouch)
+    {
+        if (points > 0)
+        {
+            lv_disp_trig_activity(NULL);
+        }
+        wakeTouch = points > 0;
+        data->state = LV_INDEV_STATE_REL;
+        return;
+    }
+
+    // Two fingers: pinch. LVGL sees a release, so that the map doesn't pan meanwhile
+    if (points >= 2)
+    {
+        pinchDistance = touch_distance(touchpad_x, touchpad_y);
+        if (!pinching)
+        {
+            pinching = true;
+            pinchStartDistance = pinchDistance;
+        }
+        data->point.x = touchpad_x[0];
+        data->point.y = touchpad_y[0];
+        data->state = LV_INDEV_STATE_REL;
+        return;
+    }
+    if (pinching)
+    {
+        // First finger lifted: gesture is complete. Ignore the remaining one until it is lifted as well
+        if (pinchCallback != NULL && pinchStartDistance > 0)
+        {
+            pinchCallback(pinchDistance / pinchStartDistance);
+            pinchStartDistance = 0;
+        }
+        if (points == 0)
+        {
+            pinching = false;
+        }
+        data->state = LV_INDEV_STATE_REL;
+        return;
+    }
 
-    if (touchpad_pressed && touchpad_cnt > 0)
+    if (points > 0)
     {
         data->point.x = touchpad_x[0];
         data->point.y = touchpad_y[0];
@@ -194,6 +409,7 @@ void init_display()
             .vsync_pulse_width = 4,
             .flags.pclk_active_neg = true,
         },
+        .bounce_buffer_size_px = LCD_BOUNCE_BUFFER_LINES * LCD_H_RES,
         .flags.fb_in_psram = true, // allocate frame buffer in PSRAM
     };
     ESP_ERROR_CHECK(esp_lcd_new_rgb_panel(&panel_config, &panel_handle));
@@ -201,6 +417,7 @@ void init_display()
     ESP_LOGI(LOG_TAG, "Initialize RGB LCD panel");
     ESP_ERROR_CHECK(esp_lcd_panel_reset(panel_handle));
     ESP_ERROR_CHECK(esp_lcd_panel_init(panel_handle));
+    snapshot_restore(panel_handle); // Last map is visible as soon as the backlight is on
 
     ESP_ERROR_CHECK(i2c_master_init());
     ESP_LOGI(LOG_TAG, "I2C initialized successfully");
@@ -217,8 +434,7 @@ void init_display()
     gpio_set_level(GPIO_INPUT_IO_4, 0);
     esp_rom_delay_us(100 * 1000);
 
-    write_buf = 0x2E;
-    i2c_master_write_to_device(I2C_MASTER_NUM, 0x38, &write_buf, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
+    set_backlight(true);
     esp_rom_delay_us(200 * 1000);
 
     esp_lcd_touch_handle_t tp = NULL;
@@ -251,11 +467,24 @@ void init_display()
     lv_init();
     void *buf1 = NULL;
     void *buf2 = NULL;
-    ESP_LOGI(LOG_TAG, "Allocate separate LVGL draw buffers from PSRAM");
-    buf1 = heap_caps_malloc(LCD_H_RES * 100 * sizeof(lv_color_t), MALLOC_CAP_SPIRAM);
+#if CONFIG_DISPLAY_PIPELINE_DOUBLE_FB
+    ESP_LOGI(LOG_TAG, "Use frame buffers as LVGL draw buffers");
+    ESP_ERROR_CHECK(esp_lcd_rgb_panel_get_frame_buffer(panel_handle, 2, &buf1, &buf2));
+#else
+    // Rendering into internal SRAM is faster than into PSRAM. The copy into the frame buffer is synchronous, so render and
+    // transfer don't overlap and a second buffer would only cost SRAM
+    ESP_LOGI(LOG_TAG, "Allocate LVGL draw buffer from internal SRAM");
+    const size_t drawBufSize = LCD_H_RES * LVGL_DRAW_BUF_LINES * sizeof(lv_color_t);
+    buf1 = heap_stats_malloc(HEAP_TAG_DISPLAY, drawBufSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    if (buf1 == NULL)
+    {
+        ESP_LOGW(LOG_TAG, "Not enough internal SRAM, using PSRAM for LVGL draw buffer");
+        buf1 = heap_stats_malloc(HEAP_TAG_DISPLAY, drawBufSize, MALLOC_CAP_SPIRAM);
+    }
     assert(buf1);
+#endif
     // initialize LVGL draw buffers
-    lv_disp_draw_buf_init(&disp_buf, buf1, buf2, LCD_H_RES * 100);
+    lv_disp_draw_buf_init(&disp_buf, buf1, buf2, LCD_H_RES * LVGL_DRAW_BUF_LINES);
 
     ESP_LOGI(LOG_TAG, "Register display driver to LVGL");
     lv_disp_drv_init(&disp_drv);
@@ -264,13 +493,20 @@ void init_display()
     disp_drv.flush_cb = my_disp_flush;
     disp_drv.draw_buf = &disp_buf;
     disp_drv.user_data = panel_handle;
+#if CONFIG_DISPLAY_PIPELINE_DOUBLE_FB
+    disp_drv.direct_mode = true; // Render only dirty areas, but at their final place in the frame buffer
+#endif
     disp = lv_disp_drv_register(&disp_drv);
 
-    ESP_LOGI(LOG_TAG, "Install LVGL tick timer");
-
-    const esp_timer_create_args_t lvgl_tick_timer_args = {
-        .callback = &increase_lvgl_tick,
-        .name = "lvgl_tick"};
+#if CONFIG_DISPLAY_PIPELINE_DOUBLE_FB || CONFIG_DISPLAY_AVOID_TEAR_EFFECT_WITH_SEM
+    ESP_LOGI(LOG_TAG, "Register vsync callback");
+    vsyncSemaphore = xSemaphoreCreateBinary();
+    assert(vsyncSemaphore);
+    esp_lcd_rgb_panel_event_callbacks_t panel_callbacks = {
+        .on_vsync = on_vsync,
+    };
+    ESP_ERROR_CHECK(esp_lcd_rgb_panel_register_event_callbacks(panel_handle, &panel_callbacks, NULL));
+#endif
 
     static lv_indev_drv_t indev_drv; // Input device driver (Touch)
     lv_indev_drv_init(&indev_drv);
@@ -279,11 +515,18 @@ void init_display()
     indev_drv.read_cb = example_lvgl_touch_cb;
     indev_drv.user_data = tp;
 
-    lv_indev_drv_register(&indev_drv);
+    touchIndev = lv_indev_drv_register(&indev_drv);
 
+#if !CONFIG_LV_TICK_CUSTOM
+    // A periodic timer wakes the CPU every tick. With LV_TICK_CUSTOM, LVGL reads esp_timer instead, which allows light sleep
+    ESP_LOGI(LOG_TAG, "Install LVGL tick timer");
+    const esp_timer_create_args_t lvgl_tick_timer_args = {
+        .callback = &increase_lvgl_tick,
+        .name = "lvgl_tick"};
     esp_timer_handle_t lvgl_tick_timer = NULL;
     ESP_ERROR_CHECK(esp_timer_create(&lvgl_tick_timer_args, &lvgl_tick_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(lvgl_tick_timer, LVGL_TICK_PERIOD_MS * 100));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(lvgl_tick_timer, LVGL_TICK_PERIOD_MS * 1000));
+#endif
 
     lv_obj_t *screen = lv_scr_act();
     
@@ -292,9 +535,88 @@ void init_display()
 
     // Load/activate screen
     lv_scr_load(screen);
+    snapshot_show_placeholder();
+#if CONFIG_DISPLAY_PERF_LOG
+    frame_stats_init();
+#endif
+
+    ESP_LOGI(LOG_TAG, "Start LVGL task");
+    lvglMutex = xSemaphoreCreateRecursiveMutex();
+    uiCommandQueue = xQueueCreate(UI_COMMAND_QUEUE_LENGTH, sizeof(struct UiCommand));
+    assert(lvglMutex && uiCommandQueue);
+    xTaskCreatePinnedToCore(lvgl_task, "lvgl", LVGL_TASK_STACK_SIZE, NULL, LVGL_TASK_PRIORITY, NULL, LVGL_TASK_CORE);
 }
 
-void update_display()
+void display_set_pinch_callback(pinch_callback_t callback)
 {
-    lv_timer_handler();
+    pinchCallback = callback;
+}
+
+void display_lock()
+{
+    xSemaphoreTakeRecursive(lvglMutex, portMAX_DELAY);
+}
+
+void display_unlock()
+{
+    xSemaphoreGiveRecursive(lvglMutex);
+}
+
+bool display_post(ui_command_t command, const char *text)
+{
+    struct UiCommand uiCommand = {.command = command};
+    if (text != NULL)
+    {
+        strncpy(uiCommand.text, text, UI_COMMAND_TEXT_LENGTH - 1);
+        uiCommand.text[UI_COMMAND_TEXT_LENGTH - 1] = '\0';
+    }
+    if (xQueueSend(uiCommandQueue, &uiCommand, 0) != pdTRUE)
+    {
+        ESP_LOGW(LOG_TAG, "UI command queue full, dropping command");
+        return false;
+    }
+    return true;
+}
+
+// Runs LVGL timers (rendering, input). Returns milliseconds until it has to be called again
+static uint32_t update_display()
+{
+#if CONFIG_DISPLAY_PERF_LOG
+    int64_t start = esp_timer_get_time();
+    uint32_t nextRunMs = lv_timer_handler();
+    frame_stats_timer_handler_done((uint32_t)(esp_timer_get_time() - start));
+    return nextRunMs;
+#else
+    return lv_timer_handler();
+#endif
+}
+
+// Only task which runs LVGL: executes posted UI commands, then renders
+static void lvgl_task(void *)
+{
+    uint32_t waitMs = LVGL_TASK_MIN_DELAY_MS;
+    while (1)
+    {
+        // Sleep until LVGL has to run again or a command arrives
+        TickType_t waitTicks = pdMS_TO_TICKS(waitMs);
+        struct UiCommand uiCommand;
+        bool received = xQueueReceive(uiCommandQueue, &uiCommand, (waitTicks > 0) ? waitTicks : 1) == pdTRUE;
+
+        display_lock();
+        while (received)
+        {
+            uiCommand.command(uiCommand.text);
+            received = xQueueReceive(uiCommandQueue, &uiCommand, 0) == pdTRUE;
+        }
+        power_performance_begin();
+        waitMs = update_display();
+#if CONFIG_DISPLAY_BACKLIGHT_TIMEOUT_S > 0
+        update_backlight();
+#endif
+        power_performance_end();
+        display_unlock();
+
+        waitMs = (waitMs > LVGL_TASK_MAX_DELAY_MS) ? LVGL_TASK_MAX_DELAY_MS : waitMs;
+        waitMs = (waitMs < LVGL_TASK_MIN_DELAY_MS) ? LVGL_TASK_MIN_DELAY_MS : waitMs;
+    }
 }
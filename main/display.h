@@ -1,11 +1,32 @@
 #ifndef DISPLAY_H_
 #define DISPLAY_H_
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_lcd_types.h"
 
+#define UI_COMMAND_TEXT_LENGTH 96 // Maximum text length (incl. null terminator) passed with a UI command
+
+// UI mutation executed by the LVGL task. Gets a copy of the posted text (empty if none)
+typedef void (*ui_command_t)(const char *text);
+
+// Gets called in LVGL task when a two finger gesture ended. Scale is the ratio of end to start distance of the fingers
+typedef void (*pinch_callback_t)(const float scale);
+
+// Sets up panel, touch and LVGL and starts the LVGL task. Afterwards LVGL may only be used in that task or while locked
 void init_display();
 
 void display_image();
 
-void update_display();
+// Locks LVGL for other tasks (recursive). Keep it short, rendering is blocked meanwhile
+void display_lock();
+
+// Unlocks LVGL again
+void display_unlock();
+
+// Queues a UI mutation for the LVGL task without waiting for LVGL. Can be called from any task. Returns false if queue is full
+bool display_post(ui_command_t command, const char *text);
+
+// Sets the function called on pinch gestures. While two fingers touch, LVGL sees no press
+void display_set_pinch_callback(pinch_callback_t callback);
 
 #endif // DISPLAY_H_
@@ -0,0 +1,211 @@
+#include "frame_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "global.h"
+#include "histogram.h"
+#include "display.h"
+#include "console.h"
+
+#define PERF_LOG_INTERVAL_US (5 * 1000 * 1000) // Statistics window, gets logged and reset afterwards
+#define OVERLAY_UPDATE_PERIOD_MS 1000
+#define SCREEN_PIXELS (LCD_H_RES * LCD_V_RES)
+
+static const char *LOG_TAG = "frame_stats";
+
+static struct Histogram renderTime; // Time (us) LVGL needed to render a frame (without flushing)
+static struct Histogram flushTime;  // Time (us) spent in flush callback per frame
+static struct Histogram dirtyArea;  // Invalidated pixels per frame
+
+// Only written by LVGL task
+static uint32_t windowFrames = 0;   // Frames since window start
+static int64_t windowBusyUs = 0;    // Time spent in lv_timer_handler since window start
+static int64_t windowStart = 0;     // Timepoint window started
+static uint32_t frameFlushUs = 0;   // Flush time of frame in progress
+static uint32_t framePixels = 0;    // Flushed pixels of frame in progress
+static bool frameComplete = false;  // Last area of a frame got flushed
+static uint32_t overlayFrames = 0;  // Frames since last overlay update
+static uint32_t lastFps = 0;        // Frames in last overlay period
+static lv_obj_t *overlay = NULL;    // Label on top layer (NULL if hidden)
+
+static volatile bool outlinesEnabled = false; // Draw outlines of dirty areas
+
+// Colors cycled per frame, so that consecutive redraws of the same area can be told apart
+static const uint32_t OUTLINE_COLORS[] = {0xFF0000, 0x00FF00, 0x0000FF, 0xFF00FF};
+static uint8_t outlineColor = 0;
+
+// Puts a one-line summary of the current window into buffer
+static void format_stats(char *buffer, const size_t length, const int64_t now)
+{
+    int64_t elapsedUs = now - windowStart;
+    elapsedUs = (elapsedUs > 0) ? elapsedUs : 1;
+    snprintf(buffer, length,
+             "%.1f FPS, %.1f %% CPU | render p50 %" PRIu32 " p99 %" PRIu32 " max %" PRIu32 " us | flush p50 %" PRIu32 " p99 %" PRIu32 " us | dirty avg %" PRIu32 " %% p99 %" PRIu32 " %%",
+             windowFrames * 1000000.0 / elapsedUs, windowBusyUs * 100.0 / elapsedUs,
+             histogram_percentile(&renderTime, 50), histogram_percentile(&renderTime, 99), (uint32_t)atomic_load(&renderTime.max),
+             histogram_percentile(&flushTime, 50), histogram_percentile(&flushTime, 99),
+             histogram_average(&dirtyArea) * 100 / SCREEN_PIXELS, histogram_percentile(&dirtyArea, 99) * 100 / SCREEN_PIXELS);
+}
+
+static void reset_window(const int64_t now)
+{
+    histogram_reset(&renderTime);
+    histogram_reset(&flushTime);
+    histogram_reset(&dirtyArea);
+    windowFrames = 0;
+    windowBusyUs = 0;
+    windowStart = now;
+}
+
+// Starts a new window (runs in LVGL task)
+static void reset_stats(const char *)
+{
+    reset_window(esp_timer_get_time());
+}
+
+// Refreshes overlay text (LVGL timer)
+static void update_overlay(lv_timer_t *)
+{
+    lastFps = overlayFrames * 1000 / OVERLAY_UPDATE_PERIOD_MS;
+    overlayFrames = 0;
+    if (overlay == NULL)
+    {
+        return;
+    }
+    lv_label_set_text_fmt(overlay, "%" PRIu32 " FPS\nrender p99 %" PRIu32 " us\nflush p99 %" PRIu32 " us\ndirty p99 %" PRIu32 " %%",
+                          lastFps, histogram_percentile(&renderTime, 99), histogram_percentile(&flushTime, 99),
+                          histogram_percentile(&dirtyArea, 99) * 100 / SCREEN_PIXELS);
+}
+
+// Shows overlay (runs in LVGL task)
+static void show_overlay(const char *)
+{
+    if (overlay != NULL)
+    {
+        return;
+    }
+    overlay = lv_label_create(lv_layer_top());
+    lv_obj_set_style_bg_color(overlay, lv_color_black(), 0);
+    lv_obj_set_style_bg_opa(overlay, LV_OPA_70, 0);
+    lv_obj_set_style_text_color(overlay, lv_color_white(), 0);
+    lv_obj_set_style_pad_all(overlay, 4, 0);
+    lv_obj_align(overlay, LV_ALIGN_TOP_LEFT, 5, 5);
+    update_overlay(NULL);
+}
+
+// Hides overlay (runs in LVGL task)
+static void hide_overlay(const char *)
+{
+    if (overlay != NULL)
+    {
+        lv_obj_del(overlay);
+        overlay = NULL;
+    }
+}
+
+// Console command: perf [reset | overlay on|off | outlines on|off]
+static int perf_command(int argc, char **argv)
+{
+    if (argc == 1)
+    {
+        char summary[256];
+        format_stats(summary, sizeof(summary), esp_timer_get_time());
+        printf("%s\n", summary);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "reset") == 0)
+    {
+        display_post(reset_stats, NULL);
+        return 0;
+    }
+    if (argc == 3 && (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0))
+    {
+        bool on = strcmp(argv[2], "on") == 0;
+        if (strcmp(argv[1], "overlay") == 0)
+        {
+            display_post(on ? show_overlay : hide_overlay, NULL);
+            return 0;
+        }
+        if (strcmp(argv[1], "outlines") == 0)
+        {
+            outlinesEnabled = on;
+            return 0;
+        }
+    }
+    printf("Usage: perf [reset | overlay on|off | outlines on|off]\n");
+    return 1;
+}
+
+void frame_stats_init()
+{
+    reset_window(esp_timer_get_time());
+    lv_timer_create(update_overlay, OVERLAY_UPDATE_PERIOD_MS, NULL);
+#if CONFIG_DISPLAY_PERF_OVERLAY
+    show_overlay(NULL);
+#endif
+    console_register("perf", "Frame statistics: perf [reset | overlay on|off | outlines on|off]", perf_command);
+}
+
+void frame_stats_flush(const lv_area_t *area, const uint32_t flushUs, const bool lastOfFrame)
+{
+    frameFlushUs += flushUs;
+    framePixels += lv_area_get_size(area);
+    if (lastOfFrame)
+    {
+        frameComplete = true;
+    }
+}
+
+void frame_stats_timer_handler_done(const uint32_t durationUs)
+{
+    int64_t now = esp_timer_get_time();
+    windowBusyUs += durationUs;
+
+    if (frameComplete)
+    {
+        histogram_record(&renderTime, (durationUs > frameFlushUs) ? durationUs - frameFlushUs : 0);
+        histogram_record(&flushTime, frameFlushUs);
+        histogram_record(&dirtyArea, framePixels);
+        windowFrames++;
+        overlayFrames++;
+        outlineColor = (outlineColor + 1) % (sizeof(OUTLINE_COLORS) / sizeof(OUTLINE_COLORS[0]));
+        frameFlushUs = 0;
+        framePixels = 0;
+        frameComplete = false;
+    }
+
+    if (now - windowStart >= PERF_LOG_INTERVAL_US)
+    {
+        char summary[256];
+        format_stats(summary, sizeof(summary), now);
+        ESP_LOGI(LOG_TAG, "%s", summary);
+        reset_window(now);
+    }
+}
+
+void frame_stats_draw_outline(const lv_area_t *area, lv_color_t *pixels, const lv_coord_t stride)
+{
+    if (!outlinesEnabled)
+    {
+        return;
+    }
+
+    lv_color_t color = lv_color_hex(OUTLINE_COLORS[outlineColor]);
+    lv_coord_t width = lv_area_get_width(area);
+    lv_coord_t height = lv_area_get_height(area);
+    for (lv_coord_t x = 0; x < width; x++)
+    {
+        pixels[x] = color;
+        pixels[(height - 1) * stride + x] = color;
+    }
+    for (lv_coord_t y = 0; y < height; y++)
+    {
+        pixels[y * stride] = color;
+        pixels[y * stride + width - 1] = color;
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef FRAME_STATS_H_
+#define FRAME_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+
+// Frame statistics of the display pipeline (only available with CONFIG_DISPLAY_PERF_LOG)
+
+// Sets up statistics, the overlay and the "perf" console command. Call with display locked
+void frame_stats_init();
+
+// Records one flushed area (call from flush callback). flushUs is the time the flush took
+void frame_stats_flush(const lv_area_t *area, const uint32_t flushUs, const bool lastOfFrame);
+
+// Records one run of lv_timer_handler. Completes the frame if its last area got flushed meanwhile
+void frame_stats_timer_handler_done(const uint32_t durationUs);
+
+// Draws the outline of a dirty area into the rendered pixels if outlines are enabled. stride is the line width of pixels
+void frame_stats_draw_outline(const lv_area_t *area, lv_color_t *pixels, const lv_coord_t stride);
+
+#endif // FRAME_STATS_H_
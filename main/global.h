@@ -12,6 +12,19 @@
 #define LCD_H_RES 800
 #define LCD_V_RES 480
 
+#define SIDEBAR_WIDTH 100 // Width of the button sidebar on the right side of the screen
+#define INFO_BOX_WIDTH 225 // Size of the boat info box in the lower left corner
+#define INFO_BOX_HEIGHT 120
+
+// Geographic area in decimal degrees
+struct BoundingBox
+{
+    double latMin; // Southern border
+    double lonMin; // Western border
+    double latMax; // Northern border
+    double lonMax; // Eastern border
+};
+
 // Shows an error popup with given message and a close button
 lv_obj_t *show_error_message(const char *message);
 
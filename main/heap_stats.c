@@ -0,0 +1,300 @@
+#include "heap_stats.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mbedtls/platform.h"
+
+#include "console.h"
+
+#define INTERNAL_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define TREND_SAMPLES 30 // Samples leak trends are calculated of
+
+#if CONFIG_APP_HEAP_STATS
+static const char *LOG_TAG = "heap_stats";
+
+static const char *TAG_NAMES[HEAP_TAG_COUNT] = {"tiles", "display", "lvgl", "json", "tls"};
+
+// Trend series: internal SRAM, PSRAM and every tag
+#define SERIES_INTERNAL 0
+#define SERIES_PSRAM 1
+#define SERIES_TAGS 2
+#define SERIES_COUNT (SERIES_TAGS + HEAP_TAG_COUNT)
+
+struct TagStats
+{
+    atomic_int_fast32_t bytes;        // Currently allocated
+    atomic_int_fast32_t peak;         // Most bytes allocated at once
+    atomic_uint_fast32_t allocations; // Allocations since startup
+    atomic_uint_fast32_t failures;    // Failed allocations since startup
+};
+
+static struct TagStats tags[HEAP_TAG_COUNT];
+
+// Samples trends are calculated of, oldest first
+struct TrendWindow
+{
+    uint32_t count;                              // Samples valid (at most TREND_SAMPLES)
+    uint32_t taken;                              // Samples taken since startup
+    int32_t samples[TREND_SAMPLES][SERIES_COUNT];
+};
+
+// Used bytes of every series per sample (ring buffer, written by esp_timer task)
+static int32_t samples[TREND_SAMPLES][SERIES_COUNT];
+static uint32_t sampleCount = 0;                   // Samples taken (index of next one modulo TREND_SAMPLES)
+static uint32_t alertedAt[SERIES_COUNT];           // sampleCount a leak alert was logged at (0: never, only esp_timer task)
+static portMUX_TYPE samplesLock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t sampleTimer = NULL;
+
+static void account(const enum HEAP_TAG tag, void *ptr, const int32_t sign)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    int32_t size = (int32_t)heap_caps_get_allocated_size(ptr) * sign;
+    int_fast32_t bytes = atomic_fetch_add_explicit(&tags[tag].bytes, size, memory_order_relaxed) + size;
+    int_fast32_t peak = atomic_load_explicit(&tags[tag].peak, memory_order_relaxed);
+    while (bytes > peak && !atomic_compare_exchange_weak_explicit(&tags[tag].peak, &peak, bytes, memory_order_relaxed, memory_order_relaxed))
+    {
+        // peak got reloaded, try again
+    }
+}
+
+static void count_allocation(const enum HEAP_TAG tag, void *ptr, const size_t size)
+{
+    atomic_fetch_add_explicit(&tags[tag].allocations, 1, memory_order_relaxed);
+    if (ptr == NULL && size > 0)
+    {
+        atomic_fetch_add_explicit(&tags[tag].failures, 1, memory_order_relaxed);
+        ESP_LOGD(LOG_TAG, "Allocation of %u bytes for %s failed", (unsigned)size, TAG_NAMES[tag]);
+        return;
+    }
+    account(tag, ptr, 1);
+}
+
+// Copies the samples kept into window. Only the copy runs in the critical section, trends are calculated of it afterwards
+static void copy_window(struct TrendWindow *window)
+{
+    taskENTER_CRITICAL(&samplesLock);
+    window->taken = sampleCount;
+    window->count = (sampleCount < TREND_SAMPLES) ? sampleCount : TREND_SAMPLES;
+    for (uint32_t i = 0; i < window->count; i++)
+    {
+        memcpy(window->samples[i], samples[(sampleCount - window->count + i) % TREND_SAMPLES], sizeof(window->samples[i]));
+    }
+    taskEXIT_CRITICAL(&samplesLock);
+}
+
+// Returns growth of series in bytes per hour over the samples of window (least squares fit)
+static int32_t trend(const struct TrendWindow *window, const int series)
+{
+    const uint32_t count = window->count;
+    if (count < 2)
+    {
+        return 0;
+    }
+    double sumX = 0;
+    double sumY = 0;
+    double sumXY = 0;
+    double sumXX = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        double x = (double)i;
+        double y = window->samples[i][series];
+        sumX += x;
+        sumY += y;
+        sumXY += x * y;
+        sumXX += x * x;
+    }
+    double slopePerSample = (count * sumXY - sumX * sumY) / (count * sumXX - sumX * sumX);
+    return (int32_t)(slopePerSample * 3600 / CONFIG_APP_HEAP_STATS_INTERVAL_S);
+}
+
+// Takes a sample of all series and warns about steady growth (esp_timer callback)
+static void take_sample(void *)
+{
+    int32_t sample[SERIES_COUNT];
+    sample[SERIES_INTERNAL] = (int32_t)(heap_caps_get_total_size(INTERNAL_CAPS) - heap_caps_get_free_size(INTERNAL_CAPS));
+    sample[SERIES_PSRAM] = (int32_t)(heap_caps_get_total_size(MALLOC_CAP_SPIRAM) - heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    for (int tag = 0; tag < HEAP_TAG_COUNT; tag++)
+    {
+        sample[SERIES_TAGS + tag] = (int32_t)atomic_load_explicit(&tags[tag].bytes, memory_order_relaxed);
+    }
+
+    taskENTER_CRITICAL(&samplesLock);
+    memcpy(samples[sampleCount % TREND_SAMPLES], sample, sizeof(sample));
+    sampleCount++;
+    taskEXIT_CRITICAL(&samplesLock);
+
+    static struct TrendWindow window; // Only used by the esp_timer task, kept off its small stack
+    copy_window(&window);
+    for (int series = 0; series < SERIES_COUNT; series++)
+    {
+        // Only with a full window and once per window, so that startup and single spikes don't trigger it
+        int32_t growth = trend(&window, series);
+        if (window.taken >= TREND_SAMPLES && growth > CONFIG_APP_HEAP_LEAK_ALERT_BYTES_PER_HOUR &&
+            (alertedAt[series] == 0 || window.taken - alertedAt[series] >= TREND_SAMPLES))
+        {
+            alertedAt[series] = window.taken;
+            const char *name = (series == SERIES_INTERNAL) ? "internal SRAM" : ((series == SERIES_PSRAM) ? "PSRAM" : TAG_NAMES[series - SERIES_TAGS]);
+            ESP_LOGW(LOG_TAG, "Possible leak: %s grows by %" PRId32 " bytes/h (now %" PRId32 " bytes used)", name, growth, sample[series]);
+        }
+    }
+    ESP_LOGD(LOG_TAG, "Internal %" PRId32 " bytes used, PSRAM %" PRId32 " bytes used", sample[SERIES_INTERNAL], sample[SERIES_PSRAM]);
+}
+
+// Prints usage, high-water mark and fragmentation of a heap
+static void print_heap(const char *name, const uint32_t caps, const int32_t trend)
+{
+    size_t total = heap_caps_get_total_size(caps);
+    size_t freeBytes = heap_caps_get_free_size(caps);
+    size_t largest = heap_caps_get_largest_free_block(caps);
+    size_t minimum = heap_caps_get_minimum_free_size(caps);
+    unsigned fragmentation = freeBytes ? (unsigned)(100 - largest * 100 / freeBytes) : 0; // Share of free memory not usable in one block
+    printf("%-9s %9u %9u %9u %9u %6u %% %+10" PRId32 "\n", name, (unsigned)total, (unsigned)(total - freeBytes), (unsigned)(total - minimum),
+           (unsigned)largest, fragmentation, trend);
+}
+
+// Console command: heap [reset]
+static int heap_command(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0)
+    {
+        // Peaks start again at the current usage
+        for (int tag = 0; tag < HEAP_TAG_COUNT; tag++)
+        {
+            atomic_store_explicit(&tags[tag].peak, atomic_load_explicit(&tags[tag].bytes, memory_order_relaxed), memory_order_relaxed);
+        }
+        return 0;
+    }
+    if (argc != 1)
+    {
+        printf("Usage: heap [reset]\n");
+        return 1;
+    }
+
+    static struct TrendWindow window; // Only used by the console task
+    copy_window(&window);
+    int32_t trends[SERIES_COUNT];
+    for (int series = 0; series < SERIES_COUNT; series++)
+    {
+        trends[series] = trend(&window, series);
+    }
+
+    printf("%-9s %9s %9s %9s %9s %8s %10s\n", "heap", "total", "used", "peak", "largest", "frag", "bytes/h");
+    print_heap("internal", INTERNAL_CAPS, trends[SERIES_INTERNAL]);
+    print_heap("psram", MALLOC_CAP_SPIRAM, trends[SERIES_PSRAM]);
+    printf("\n%-9s %9s %9s %9s %9s %10s\n", "tag", "bytes", "peak", "allocs", "failed", "bytes/h");
+    for (int tag = 0; tag < HEAP_TAG_COUNT; tag++)
+    {
+        printf("%-9s %9" PRId32 " %9" PRId32 " %9" PRIu32 " %9" PRIu32 " %+10" PRId32 "\n", TAG_NAMES[tag],
+               (int32_t)atomic_load(&tags[tag].bytes), (int32_t)atomic_load(&tags[tag].peak),
+               (uint32_t)atomic_load(&tags[tag].allocations), (uint32_t)atomic_load(&tags[tag].failures), trends[SERIES_TAGS + tag]);
+    }
+    printf("(trends over the last %" PRIu32 " samples, one every %d s)\n", window.count, CONFIG_APP_HEAP_STATS_INTERVAL_S);
+    return 0;
+}
+
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+// Allocator of mbedTLS, hooked in at startup. Internal SRAM like MBEDTLS_INTERNAL_MEM_ALLOC, accounted to HEAP_TAG_TLS
+static void *tls_calloc(size_t count, size_t size)
+{
+    return heap_stats_calloc(HEAP_TAG_TLS, count, size, INTERNAL_CAPS);
+}
+
+static void tls_free(void *ptr)
+{
+    heap_stats_free(HEAP_TAG_TLS, ptr);
+}
+#endif
+#endif
+
+esp_err_t heap_stats_init()
+{
+#if CONFIG_APP_HEAP_STATS
+    const esp_timer_create_args_t timerArgs = {
+        .callback = take_sample,
+        .name = "heap_stats"};
+    esp_err_t err = esp_timer_create(&timerArgs, &sampleTimer);
+    if (err == ESP_OK)
+    {
+        err = esp_timer_start_periodic(sampleTimer, (uint64_t)CONFIG_APP_HEAP_STATS_INTERVAL_S * 1000 * 1000);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to start sampling: %s", esp_err_to_name(err));
+        return err;
+    }
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+    // Before the first TLS connection, so that every block freed by tls_free was allocated by tls_calloc
+    mbedtls_platform_set_calloc_free(tls_calloc, tls_free);
+#endif
+    return console_register("heap", "Heap usage per subsystem, fragmentation and leak trends: heap [reset]", heap_command);
+#else
+    return ESP_OK;
+#endif
+}
+
+void *heap_stats_malloc(const enum HEAP_TAG tag, const size_t size, const uint32_t caps)
+{
+    void *ptr = (caps == 0) ? malloc(size) : heap_caps_malloc(size, caps);
+#if CONFIG_APP_HEAP_STATS
+    count_allocation(tag, ptr, size);
+#endif
+    return ptr;
+}
+
+void *heap_stats_calloc(const enum HEAP_TAG tag, const size_t count, const size_t size, const uint32_t caps)
+{
+    void *ptr = (caps == 0) ? calloc(count, size) : heap_caps_calloc(count, size, caps);
+#if CONFIG_APP_HEAP_STATS
+    count_allocation(tag, ptr, count * size);
+#endif
+    return ptr;
+}
+
+void heap_stats_free(const enum HEAP_TAG tag, void *ptr)
+{
+#if CONFIG_APP_HEAP_STATS
+    account(tag, ptr, -1);
+#endif
+    free(ptr);
+}
+
+void *heap_stats_lvgl_malloc(size_t size)
+{
+    return heap_stats_malloc(HEAP_TAG_LVGL, size, 0);
+}
+
+void heap_stats_lvgl_free(void *ptr)
+{
+    heap_stats_free(HEAP_TAG_LVGL, ptr);
+}
+
+void *heap_stats_lvgl_realloc(void *ptr, size_t size)
+{
+#if CONFIG_APP_HEAP_STATS
+    account(HEAP_TAG_LVGL, ptr, -1);
+    void *result = realloc(ptr, size);
+    if (result == NULL && size > 0)
+    {
+        account(HEAP_TAG_LVGL, ptr, 1); // Old block is still valid
+        atomic_fetch_add_explicit(&tags[HEAP_TAG_LVGL].failures, 1, memory_order_relaxed);
+        return NULL;
+    }
+    count_allocation(HEAP_TAG_LVGL, result, size);
+    return result;
+#else
+    return realloc(ptr, size);
+#endif
+}
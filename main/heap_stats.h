@@ -0,0 +1,39 @@
+#ifndef HEAP_STATS_H_
+#define HEAP_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Heap telemetry: bytes per subsystem, high-water marks and fragmentation of internal SRAM and PSRAM, leak trends.
+// Without CONFIG_APP_HEAP_STATS the allocation functions only forward to the heap
+
+// Subsystems allocations are accounted to
+enum HEAP_TAG
+{
+    HEAP_TAG_TILES,   // Tile image and decode buffers
+    HEAP_TAG_DISPLAY, // LVGL draw buffers and boat sprites
+    HEAP_TAG_LVGL,    // Objects and styles of LVGL (only if LVGL is routed through heap_stats, see main/CMakeLists.txt)
+    HEAP_TAG_JSON,    // cJSON (AIS messages and subscriptions)
+    HEAP_TAG_TLS,     // mbedTLS (hooked in by heap_stats_init)
+    HEAP_TAG_COUNT
+};
+
+// Starts periodic sampling and sets up the "heap" console command
+esp_err_t heap_stats_init();
+
+// Allocates memory with given capabilities (0: like malloc) and accounts it to tag
+void *heap_stats_malloc(const enum HEAP_TAG tag, const size_t size, const uint32_t caps);
+
+// Allocates zeroed memory with given capabilities (0: like calloc) and accounts it to tag
+void *heap_stats_calloc(const enum HEAP_TAG tag, const size_t count, const size_t size, const uint32_t caps);
+
+// Frees memory allocated by heap_stats_malloc/calloc with the same tag
+void heap_stats_free(const enum HEAP_TAG tag, void *ptr);
+
+// Allocation hooks of LVGL (LV_MEM_CUSTOM_ALLOC/FREE/REALLOC)
+void *heap_stats_lvgl_malloc(size_t size);
+void heap_stats_lvgl_free(void *ptr);
+void *heap_stats_lvgl_realloc(void *ptr, size_t size);
+
+#endif // HEAP_STATS_H_
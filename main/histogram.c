@@ -0,0 +1,64 @@
+#include "histogram.h"
+
+// Returns bucket index of value (position of highest set bit)
+static uint8_t bucket_of(const uint32_t value)
+{
+    return (value == 0) ? 0 : (uint8_t)(31 - __builtin_clz(value));
+}
+
+void histogram_record(struct Histogram *histogram, const uint32_t value)
+{
+    atomic_fetch_add_explicit(&histogram->buckets[bucket_of(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+
+    uint_fast32_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed))
+    {
+        // max got reloaded, try again
+    }
+}
+
+uint32_t histogram_percentile(const struct Histogram *histogram, const uint8_t percent)
+{
+    uint32_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // Find bucket containing the wanted rank and interpolate linearly inside it
+    uint32_t rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (uint8_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        uint32_t inBucket = atomic_load_explicit(&histogram->buckets[bucket], memory_order_relaxed);
+        if (inBucket && seen + inBucket >= rank)
+        {
+            uint32_t lower = (bucket == 0) ? 0 : (1u << bucket);
+            uint32_t width = (bucket == 0) ? 2 : (1u << bucket);
+            uint32_t estimate = lower + (uint32_t)((uint64_t)width * (rank - seen) / inBucket);
+            uint32_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+            return (estimate > max) ? max : estimate;
+        }
+        seen += inBucket;
+    }
+    return atomic_load_explicit(&histogram->max, memory_order_relaxed);
+}
+
+uint32_t histogram_average(const struct Histogram *histogram)
+{
+    uint32_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    return (count == 0) ? 0 : atomic_load_explicit(&histogram->sum, memory_order_relaxed) / count;
+}
+
+void histogram_reset(struct Histogram *histogram)
+{
+    for (uint8_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        atomic_store_explicit(&histogram->buckets[bucket], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&histogram->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram->max, 0, memory_order_relaxed);
+}
@@ -0,0 +1,30 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define HISTOGRAM_BUCKETS 32 // One bucket per power of two: [0,1], [2,3], [4,7], ...
+
+// Lock-free histogram of (e.g. microsecond) values. Can be recorded from any task, read from another one
+struct Histogram
+{
+    atomic_uint_fast32_t buckets[HISTOGRAM_BUCKETS]; // Amount of values per power of two
+    atomic_uint_fast32_t count;                      // Amount of recorded values
+    atomic_uint_fast32_t sum;                        // Sum of recorded values (may wrap if not reset regularly)
+    atomic_uint_fast32_t max;                        // Biggest recorded value
+};
+
+// Adds a value to the histogram
+void histogram_record(struct Histogram *histogram, const uint32_t value);
+
+// Returns an estimation of the given percentile (0-100)
+uint32_t histogram_percentile(const struct Histogram *histogram, const uint8_t percent);
+
+// Returns the average of all recorded values
+uint32_t histogram_average(const struct Histogram *histogram);
+
+// Clears all values
+void histogram_reset(struct Histogram *histogram);
+
+#endif // HISTOGRAM_H_
@@ -1,23 +1,31 @@
-#include <math.h>
 #include <stdio.h>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "lvgl.h"
 
 #include "display.h"
 #include "global.h"
 #include "wifi.h"
 #include "wifi_ui.h"
+#include "snapshot.h"
 #include "nvs_wrapper.h"
 #include "mmsi_setup_ui.h"
 #include "aisstream.h"
 #include "tile_downloader.h"
+#include "app_events.h"
+#include "console.h"
+#include "power.h"
+#include "heap_stats.h"
+#include "view_model.h"
 
 // Tag for ESP-log functions
 static const char *LOG_TAG = "main";
 
-#define MAX_ZOOM_LEVEL 19 // Actually it's 20, but then we have a problem that it won't fit in 2*3 tiles
+#define MAX_ZOOM_LEVEL 19 // Actually it's 20, but then we have a problem that it won't fit in the tile grid
 #define MIN_ZOOM_LEVEL 0  // Minimum
+#define DOWNLOAD_RETRY_INTERVAL_US (2 * 1000 * 1000) // Time to wait before retrying a failed tile download
 int currentZoom = 10;     // Current zoom Level (needs to be stored outside for zoom button callbacks)
 
 // Gets called if zoom in button event occurred. Increases zoom
@@ -26,6 +34,7 @@ void zoom_in_button_callback(lv_event_t *)
     if (currentZoom <= MAX_ZOOM_LEVEL)
     {
         currentZoom++;
+        app_events_post(APP_EVENT_ZOOM);
     }
     ESP_LOGI(LOG_TAG, "zoom_in_button_callback! Zoom: %d", currentZoom);
 }
@@ -36,35 +45,11 @@ void zoom_out_button_callback(lv_event_t *)
     if (currentZoom >= MIN_ZOOM_LEVEL)
     {
         currentZoom--;
+        app_events_post(APP_EVENT_ZOOM);
     }
     ESP_LOGI(LOG_TAG, "zoom_out_button_callback! Zoom: %d", currentZoom);
 }
 
-// Puts decimal position to a degree position string with N/S or E/W char infront
-void decimal_to_dms(const double decimal, char *result, const bool isLat)
-{
-    char direction;
-    int degrees;
-    int minutes;
-    double seconds;
-
-    if (isLat)
-    {
-        direction = (decimal >= 0) ? 'N' : 'S';
-    }
-    else
-    {
-        direction = (decimal >= 0) ? 'E' : 'W';
-    }
-
-    double abs_decimal = fabs(decimal);
-    degrees = (int)abs_decimal;
-    double fractional_part = abs_decimal - degrees;
-    minutes = (int)(fractional_part * 60);
-    seconds = (fractional_part * 60 - minutes) * 60;
-    sprintf(result, "%c %d°%02d'%02.0f", direction, degrees, minutes, seconds);
-}
-
 lv_obj_t *create_button(lv_obj_t *parent, const void *icon, const lv_coord_t x_pos, const lv_coord_t y_pos, lv_event_cb_t event_cb)
 {
     // Create a button on the screen
@@ -95,42 +80,12 @@ lv_obj_t *setup_state_marker()
     return stateMarker;
 }
 
-// Updates the state marker depending on the validity
-void update_state_marker(lv_obj_t *stateMarker, const enum WIFI_STATE wifiState, const enum Validity validity)
-{
-    if (wifiState != CONNECTED)
-    {
-        lv_obj_set_style_bg_color(stateMarker, lv_color_hex(0x000000), 0); // Black color
-    }
-    else
-    {
-        switch (validity)
-        {
-        case NO_CONNECTION:
-            lv_obj_set_style_bg_color(stateMarker, lv_color_hex(0xFF0000), 0); // Red color
-            break;
-        case CONNECTION_BUT_NO_DATA:
-            lv_obj_set_style_bg_color(stateMarker, lv_color_hex(0xFFA500), 0); // Orange color
-            break;
-        case CONNECTION_BUT_CORRUPT_DATA:
-            lv_obj_set_style_bg_color(stateMarker, lv_color_hex(0xFFFF00), 0); // Yellow color
-            break;
-        case VALID:
-            lv_obj_set_style_bg_color(stateMarker, lv_color_hex(0x00FF00), 0); // Green color
-            break;
-        default:
-            lv_obj_set_style_bg_color(stateMarker, lv_color_hex(0xFFFFFF), 0); // Black color
-            break;
-        }
-    }
-}
-
 // Creates a white text-label which will hold the ship's name, position and last timepoint
 lv_obj_t *setup_boat_info_box()
 {
     // Create white container
-    lv_coord_t containerXSize = 225;
-    lv_coord_t containerYSize = 120;
+    lv_coord_t containerXSize = INFO_BOX_WIDTH;
+    lv_coord_t containerYSize = INFO_BOX_HEIGHT;
     lv_coord_t containerYPos = LCD_V_RES - containerYSize;
     lv_obj_t *boat_info_box = lv_obj_create(lv_scr_act());
     lv_obj_set_scroll_dir(boat_info_box, LV_DIR_HOR); // Allow horizontal scrolling only
@@ -143,31 +98,12 @@ lv_obj_t *setup_boat_info_box()
     return label;
 }
 
-// Puts ship's name, position and last timepoint into given text label
-void update_text_label(lv_obj_t *label, const struct AIS_DATA *aisData)
-{
-    char labelBuffer[100];
-    char latitudeBuffer[20];
-    char longitudeBuffer[20];
-
-    decimal_to_dms(aisData->latitude, latitudeBuffer, true);
-    decimal_to_dms(aisData->longitude, longitudeBuffer, false);
-
-    char timeBuffer[9]; // HH:MM:SS is 8 characters + 1 for null terminator
-    strncpy(timeBuffer, aisData->time_utc + 11, 8);
-    timeBuffer[8] = '\0';
-
-    snprintf(labelBuffer, sizeof(labelBuffer), "%s\n%s\n%s\n%s %s", aisData->shipName, latitudeBuffer, longitudeBuffer, timeBuffer, "UTC");
-    lv_label_set_text(label, labelBuffer);
-}
-
 // Creates a black sidebar with setup and zoom buttons
 void create_sidebar_with_buttons()
 {
     // Create a sidebar container
     lv_obj_t *sidebar = lv_obj_create(lv_scr_act());
-    uint8_t sideBarWidth = 100;
-    lv_obj_set_size(sidebar, sideBarWidth, lv_pct(100)); // 100 pixels wide, full height
+    lv_obj_set_size(sidebar, SIDEBAR_WIDTH, lv_pct(100)); // Full height
     lv_obj_set_style_bg_color(sidebar, lv_color_black(), 0);
     lv_obj_align(sidebar, LV_ALIGN_RIGHT_MID, 0, 0); // Align to the right side
 
@@ -186,34 +122,66 @@ void create_sidebar_with_buttons()
     create_button(sidebar, LV_SYMBOL_MINUS, btnXPos, 286, zoom_out_button_callback);
 }
 
+// Subscribes to traffic around the currently visible area
+void update_traffic_area()
+{
+#if CONFIG_AIS_TRAFFIC_MODE
+    struct BoundingBox view;
+    if (!get_visible_bounding_box(&view))
+    {
+        return;
+    }
+
+    // Add half a view as margin on each side so that vessels are already known when they enter the view
+    double latMargin = (view.latMax - view.latMin) / 2;
+    double lonMargin = (view.lonMax - view.lonMin) / 2;
+    struct BoundingBox area = {
+        .latMin = fmax(view.latMin - latMargin, -90),
+        .lonMin = fmax(view.lonMin - lonMargin, -180),
+        .latMax = fmin(view.latMax + latMargin, 90),
+        .lonMax = fmin(view.lonMax + lonMargin, 180)};
+    set_bounding_box(&area);
+#endif
+}
+
 // Downloads tiles while showing a loading spinner
 esp_err_t download_tiles(const double latitude, const double longitude, const int zoom)
 {
     // Create a spinner
+    display_lock();
     lv_obj_t *spinner = lv_spinner_create(lv_scr_act(), 10000, 200);
     lv_obj_set_size(spinner, 100, 100);
     lv_obj_center(spinner);
+    display_unlock();
 
-    // Download tiles
+    // Download tiles (LVGL task keeps the spinner spinning meanwhile)
     esp_err_t error = download_and_display_image(latitude, longitude, zoom);
 
     // Delete spinner
+    display_lock();
     lv_obj_del(spinner);
+    display_unlock();
     return error;
 }
 
 void app_main(void)
 {
     ESP_LOGI(LOG_TAG, "Starting up");
+    app_events_init();
+    console_init();
+    power_init();
+    heap_stats_init();
+    init_display(); // Shows the last map snapshot right away
+    tile_math_init();
     double prevLatitude = 0;
     double prevLongitude = 0;
     int prevZoom = currentZoom;
 
-    wifi_init();
-    wifi_connect_last_saved(false);
+    init_nvs();
+    wifi_init(); // Connects to the saved network as soon as WiFi is started
 
-    init_display();
     setup_tile_downloader();
+    snapshot_start();
     char mmsi[MMSI_LENGTH];
     if (get_last_stored_mmsi(mmsi) != ESP_OK)
     {
@@ -224,10 +192,12 @@ void app_main(void)
     setup_aisstream(mmsi);
 
     // Add small widgets
+    display_lock();
     create_sidebar_with_buttons();
     lv_obj_t *stateMarker = setup_state_marker();
     lv_obj_t *boat_info_box = setup_boat_info_box();
-    update_display();
+    display_unlock();
+    view_model_init(stateMarker, boat_info_box);
 
     // Try to load last positions
     if (get_last_stored_position(&prevLatitude, &prevLongitude) != ESP_OK)
@@ -237,66 +207,184 @@ void app_main(void)
         prevLongitude = 9.6826;
     }
     ESP_LOGI(LOG_TAG, "Loaded last position: %f / %f", prevLatitude, prevLongitude);
+    console_start();
 
     bool initialDownload = false;
+    bool aisDataReceived = false;   // Whether aisData holds a valid position
+    struct AIS_DATA aisData;        // Latest AIS-Data taken from aisstream
+    int64_t nextDownloadRetry = 0;  // Timepoint to retry a failed download (0 if none failed)
+    bool trafficPending = false;    // Traffic markers have more changes than allowed in one frame
+    bool wasFollowing = true;       // Whether map followed the ship in the last iteration
+    EventBits_t events = APP_EVENT_WIFI | APP_EVENT_AIS_STATE; // Initial state has to be shown
 
-    esp_err_t downloadRet = ESP_OK;
     while (1)
     {
+        bool retryDue = (nextDownloadRetry != 0) && (esp_timer_get_time() >= nextDownloadRetry);
         enum WIFI_STATE wifiState = wifi_get_state();
-        enum Validity aisValidity = NO_CONNECTION;
-        if (wifiState == CONNECTED)
+
+        // Apply zoom levels requested by pinch gestures
+        if (events & APP_EVENT_ZOOM)
+        {
+            int zoom = currentZoom + map_take_zoom_steps();
+            currentZoom = (zoom < MIN_ZOOM_LEVEL) ? MIN_ZOOM_LEVEL : ((zoom > MAX_ZOOM_LEVEL) ? MAX_ZOOM_LEVEL : zoom);
+        }
+
+        // Map got panned by the user: ship marker moves on its own, tiles are loaded around the view
+        bool following = map_is_following();
+        bool followResumed = following && !wasFollowing; // Jump back to the ship
+        wasFollowing = following;
+        if (wifiState != CONNECTED)
+        {
+            // Offline: zooming and panning show cached tiles or ones built from the neighbouring zoom level
+            if (events & (APP_EVENT_ZOOM | APP_EVENT_MAP))
+            {
+                esp_err_t downloadRet;
+                double viewLatitude;
+                double viewLongitude;
+                if ((prevZoom != currentZoom) && map_get_view_center(&viewLatitude, &viewLongitude))
+                {
+                    downloadRet = download_tiles(viewLatitude, viewLongitude, currentZoom);
+                    prevZoom = currentZoom;
+                }
+                else
+                {
+                    downloadRet = download_missing_tiles();
+                }
+                trafficPending = true;
+                nextDownloadRetry = (downloadRet == ESP_OK) ? 0 : esp_timer_get_time() + DOWNLOAD_RETRY_INTERVAL_US;
+            }
+        }
+        else if (!following)
         {
-            const struct AIS_DATA *aisData = get_last_ais_data();
+            if ((wifiState == CONNECTED) && ((events & (APP_EVENT_WIFI | APP_EVENT_AIS_DATA | APP_EVENT_ZOOM | APP_EVENT_MAP)) || retryDue))
+            {
+                if (take_ais_update(&aisData))
+                {
+                    aisDataReceived = true;
+                    if ((!AreEqual(prevLatitude, aisData.latitude)) || (!AreEqual(prevLongitude, aisData.longitude)))
+                    {
+                        store_position(aisData.latitude, aisData.longitude);
+                        prevLatitude = aisData.latitude;
+                        prevLongitude = aisData.longitude;
+                    }
+                    display_lock();
+                    update_ship_marker(aisData.latitude, aisData.longitude);
+                    set_ship_course(aisData.course);
+                    view_model_set_ais_data(&aisData);
+                    display_unlock();
+                }
 
-            // If data is valid and a new map has to be downloaded
-            if (aisData->validity == VALID)
+                esp_err_t downloadRet;
+                double viewLatitude;
+                double viewLongitude;
+                if ((prevZoom != currentZoom) && map_get_view_center(&viewLatitude, &viewLongitude))
+                {
+                    ESP_LOGI(LOG_TAG, "Zoom changed, reloading map around view...");
+                    downloadRet = download_tiles(viewLatitude, viewLongitude, currentZoom);
+                    prevZoom = currentZoom;
+                }
+                else
+                {
+                    downloadRet = download_missing_tiles(); // Exposed by panning
+                }
+                trafficPending = true; // Grid may have been shifted
+                update_traffic_area();
+                nextDownloadRetry = (downloadRet == ESP_OK) ? 0 : esp_timer_get_time() + DOWNLOAD_RETRY_INTERVAL_US;
+            }
+        }
+        else if ((wifiState == CONNECTED) && ((events & (APP_EVENT_WIFI | APP_EVENT_AIS_DATA | APP_EVENT_ZOOM)) || retryDue || followResumed))
+        {
+            // Takes at most one (the latest) update, no matter how many were received meanwhile
+            bool newAisData = take_ais_update(&aisData);
+            aisDataReceived |= newAisData;
+            esp_err_t downloadRet = ESP_OK;
+
+            // If there is valid data and position/zoom changed (or last download failed)
+            if (aisDataReceived && (newAisData || (prevZoom != currentZoom) || retryDue || followResumed))
             {
-                bool positionChanged = (!AreEqual(prevLatitude, aisData->latitude)) || (!AreEqual(prevLongitude, aisData->longitude));
+                bool positionChanged = (!AreEqual(prevLatitude, aisData.latitude)) || (!AreEqual(prevLongitude, aisData.longitude));
 
                 // If position changed, update NVS
                 if (positionChanged)
                 {
-                    store_position(aisData->latitude, aisData->longitude);
+                    store_position(aisData.latitude, aisData.longitude);
                 }
 
-                if (new_tiles_for_position_needed(prevLatitude, prevLongitude, prevZoom, aisData->latitude, aisData->longitude, currentZoom))
+                display_lock();
+                update_ship_marker(aisData.latitude, aisData.longitude);
+                display_unlock();
+
+                if (new_tiles_for_position_needed(prevLatitude, prevLongitude, prevZoom, aisData.latitude, aisData.longitude, currentZoom) || retryDue || followResumed)
                 {
                     ESP_LOGI(LOG_TAG, "New position, updating map with new tiles...");
-                    downloadRet = download_tiles(aisData->latitude, aisData->longitude, currentZoom);
+                    downloadRet = download_tiles(aisData.latitude, aisData.longitude, currentZoom);
+                    trafficPending = true; // All traffic markers moved
                 }
                 // Position changed (zoom didn't) but not enough for new tiles to download
                 else if (positionChanged)
                 {
-                    ESP_LOGI(LOG_TAG, "New position, only updating marker...");
-                    update_ship_marker(aisData->latitude, aisData->longitude, currentZoom);
+                    ESP_LOGI(LOG_TAG, "New position, only updated marker");
                 }
                 else
                 {
                     // AIS Data are valid but nothing (position or zoom) changed
                 }
 
-                update_text_label(boat_info_box, aisData);
+                display_lock();
+                set_ship_course(aisData.course);
+                view_model_set_ais_data(&aisData);
+                display_unlock();
+                update_traffic_area();
 
                 prevZoom = currentZoom;
                 if (downloadRet == ESP_OK)
                 {
-                    prevLatitude = aisData->latitude;
-                    prevLongitude = aisData->longitude;
+                    prevLatitude = aisData.latitude;
+                    prevLongitude = aisData.longitude;
                 }
+                nextDownloadRetry = (downloadRet == ESP_OK) ? 0 : esp_timer_get_time() + DOWNLOAD_RETRY_INTERVAL_US;
             }
-            // Invalid data, but: zoom changed or there was no initial download yet
-            else if (((prevZoom != currentZoom) || (!initialDownload)) && (download_tiles(prevLatitude, prevLongitude, currentZoom) == ESP_OK))
+            // No data yet, but: zoom changed or there was no initial download yet
+            else if (!aisDataReceived && ((prevZoom != currentZoom) || (!initialDownload) || retryDue || followResumed))
             {
-                initialDownload = true;
-                prevZoom = currentZoom;
+                downloadRet = download_tiles(prevLatitude, prevLongitude, currentZoom);
+                if (downloadRet == ESP_OK)
+                {
+                    initialDownload = true;
+                    prevZoom = currentZoom;
+                }
+                trafficPending = true;
+                nextDownloadRetry = (downloadRet == ESP_OK) ? 0 : esp_timer_get_time() + DOWNLOAD_RETRY_INTERVAL_US;
             }
-            aisValidity = aisData->validity;
         }
-        update_state_marker(stateMarker, wifiState, aisValidity);
 
-        update_display();
+        if (events & APP_EVENT_FLUSH)
+        {
+            flush_stored_state();
+        }
 
-        vTaskDelay(100 / portTICK_PERIOD_MS); // Adjust for the actual delay if necessary
+        if (events & (APP_EVENT_WIFI | APP_EVENT_AIS_STATE))
+        {
+            display_lock();
+            view_model_set_state(wifiState, (wifiState == CONNECTED) ? get_ais_validity() : NO_CONNECTION);
+            display_unlock();
+        }
+
+        if ((events & APP_EVENT_AIS_TRAFFIC) || trafficPending)
+        {
+            display_lock();
+            trafficPending = update_traffic_markers();
+            display_unlock();
+        }
+
+        // Sleep until something happens or a download has to be retried. Pending traffic markers continue in next frame
+        TickType_t waitTicks = trafficPending ? pdMS_TO_TICKS(CONFIG_LV_DISP_DEF_REFR_PERIOD) : portMAX_DELAY;
+        if (nextDownloadRetry != 0)
+        {
+            int64_t untilRetryUs = nextDownloadRetry - esp_timer_get_time();
+            TickType_t retryTicks = (untilRetryUs > 0) ? pdMS_TO_TICKS(untilRetryUs / 1000) : 0;
+            waitTicks = (retryTicks < waitTicks) ? retryTicks : waitTicks;
+        }
+        events = app_events_wait(waitTicks);
     }
 }
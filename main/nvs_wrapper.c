@@ -1,178 +1,327 @@
+#include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
+#include "app_events.h"
 #include "nvs_wrapper.h"
+#include "stored_state.h"
+
+#define STORAGE_NAMESPACE "storage"
+#define STATE_KEY "state"
+
+#define SETTINGS_FLUSH_DELAY_US (2 * 1000 * 1000) // Settings are written soon, but still coalesced with following changes
+#define POSITION_FLUSH_DELAY_US ((int64_t)CONFIG_APP_STATE_POSITION_FLUSH_INTERVAL_S * 1000 * 1000)
+#define RETRY_MAX_DELAY_US ((int64_t)5 * 60 * 1000 * 1000) // Failed writes are retried with doubling delay up to this
 
 static const char *LOG_TAG = "NVS";
 
-esp_err_t init_nvs()
+_Static_assert(STORED_MMSI_LENGTH == MMSI_LENGTH, "Stored MMSI has to fit MMSI_LENGTH");
+
+static struct StoredState state;                                // RAM copy, source of truth while running
+static portMUX_TYPE stateLock = portMUX_INITIALIZER_UNLOCKED;   // Guards state, stateLoaded and schedule
+static bool stateLoaded = false;
+static struct FlushSchedule schedule = {0};
+static esp_timer_handle_t flushTimer = NULL;
+static SemaphoreHandle_t flushMutex = NULL; // Only one flush at a time (main loop, shutdown)
+static uint32_t flushCount = 0;     // Flash writes since startup
+static int64_t retryDelayUs = SETTINGS_FLUSH_DELAY_US; // Delay of the next retry after a failed write
+
+// Reads the record written by versions which stored every value in its own key
+static void load_legacy_state(nvs_handle_t handle)
 {
-    esp_err_t err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    size_t size = sizeof(double);
+    if (nvs_get_blob(handle, "latitude", &state.latitude, &size) == ESP_OK)
     {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
+        size = sizeof(double);
+        state.positionValid = nvs_get_blob(handle, "longitude", &state.longitude, &size) == ESP_OK;
     }
-    ESP_ERROR_CHECK(err);
-    return err;
+
+    size = MMSI_LENGTH;
+    state.mmsiValid = (nvs_get_str(handle, "mmsi", state.mmsi, &size) == ESP_OK) && (size == MMSI_LENGTH);
 }
 
-// Returns last store position
-esp_err_t get_last_stored_position(double *latitude, double *longitude)
+// Loads state from NVS (migrating an old one)
+static esp_err_t load_state()
 {
-    nvs_handle_t my_handle;
-    esp_err_t err;
-
-    // Open NVS handle
-    err = nvs_open("storage", NVS_READONLY, &my_handle);
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &handle);
     if (err != ESP_OK)
     {
         ESP_LOGE(LOG_TAG, "Error opening NVS handle!");
         return err;
     }
 
-    // Read latitude
-    size_t size = sizeof(double);
-    err = nvs_get_blob(my_handle, "latitude", latitude, &size);
-    if (err != ESP_OK)
+    struct StoredState blob;
+    size_t size = sizeof(blob);
+    err = nvs_get_blob(handle, STATE_KEY, &blob, &size);
+    memset(&state, 0, sizeof(state));
+    if (err == ESP_OK && stored_state_decode(&blob, size, &state))
     {
-        ESP_LOGE(LOG_TAG, "Error reading latitude!");
-        nvs_close(my_handle);
-        return err;
+        ESP_LOGI(LOG_TAG, "Loaded state (version %" PRIu32 ")", state.version);
     }
-
-    // Read longitude
-    err = nvs_get_blob(my_handle, "longitude", longitude, &size);
-    if (err != ESP_OK)
+    else
     {
-        ESP_LOGE(LOG_TAG, "Error reading longitude!");
-        nvs_close(my_handle);
-        return err;
+        memset(&state, 0, sizeof(state));
+        load_legacy_state(handle);
+        if (state.positionValid || state.mmsiValid)
+        {
+            // Write it in new format right away, old keys aren't needed anymore
+            ESP_LOGI(LOG_TAG, "Migrating old state");
+            state.version = STORED_STATE_VERSION;
+            err = nvs_set_blob(handle, STATE_KEY, &state, sizeof(state));
+            if (err == ESP_OK)
+            {
+                nvs_erase_key(handle, "latitude");
+                nvs_erase_key(handle, "longitude");
+                nvs_erase_key(handle, "mmsi");
+                err = nvs_commit(handle);
+            }
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(LOG_TAG, "Error migrating state: %s", esp_err_to_name(err));
+            }
+        }
     }
-
-    // Close NVS handle
-    nvs_close(my_handle);
+    state.version = STORED_STATE_VERSION;
+    nvs_close(handle);
     return ESP_OK;
 }
 
-// Stores both positions in nsv
-esp_err_t store_position(const double latitude, const double longitude)
+// Marks state as changed and makes sure it gets written within given time. Call with stateLock taken
+static bool schedule_flush_locked(const int64_t delayUs, int64_t *due)
 {
-    nvs_handle_t my_handle;
-    esp_err_t err;
+    bool start = flush_schedule_mark(&schedule, esp_timer_get_time(), delayUs);
+    *due = schedule.due;
+    return start;
+}
 
-    // Open NVS handle
-    err = nvs_open("storage", NVS_READWRITE, &my_handle);
-    if (err != ESP_OK)
-    {
-        ESP_LOGE(LOG_TAG, "Error opening NVS handle!");
-        return err;
-    }
+// (Re)starts flush timer to fire at given timepoint
+static void start_flush_timer(const int64_t due)
+{
+    int64_t delayUs = due - esp_timer_get_time();
+    esp_timer_stop(flushTimer); // Fails if not running, doesn't matter
+    esp_timer_start_once(flushTimer, (delayUs > 0) ? delayUs : 0);
+}
 
-    // Write latitude
-    err = nvs_set_blob(my_handle, "latitude", &latitude, sizeof(latitude));
-    if (err != ESP_OK)
+esp_err_t flush_stored_state()
+{
+    if (flushMutex == NULL || xSemaphoreTake(flushMutex, pdMS_TO_TICKS(1000)) != pdTRUE)
     {
-        ESP_LOGE(LOG_TAG, "Error writing latitude!");
-        nvs_close(my_handle);
-        return err;
+        return ESP_ERR_INVALID_STATE;
     }
 
-    // Write longitude
-    err = nvs_set_blob(my_handle, "longitude", &longitude, sizeof(longitude));
-    if (err != ESP_OK)
-    {
-        ESP_LOGE(LOG_TAG, "Error writing longitude!");
-        nvs_close(my_handle);
-        return err;
-    }
+    // Write a copy, so that the lock isn't held during the flash write
+    struct StoredState copy;
+    taskENTER_CRITICAL(&stateLock);
+    bool dirty = flush_schedule_take(&schedule);
+    copy = state;
+    taskEXIT_CRITICAL(&stateLock);
 
-    // Commit changes
-    err = nvs_commit(my_handle);
-    if (err != ESP_OK)
+    esp_err_t err = ESP_OK;
+    if (dirty)
     {
-        ESP_LOGE(LOG_TAG, "Error committing changes!");
-        nvs_close(my_handle);
-        return err;
+        nvs_handle_t handle;
+        err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &handle);
+        if (err == ESP_OK)
+        {
+            err = nvs_set_blob(handle, STATE_KEY, &copy, sizeof(copy));
+            if (err == ESP_OK)
+            {
+                err = nvs_commit(handle);
+            }
+            nvs_close(handle);
+        }
+
+        if (err == ESP_OK)
+        {
+            flushCount++;
+            retryDelayUs = SETTINGS_FLUSH_DELAY_US;
+            ESP_LOGI(LOG_TAG, "State written (%" PRIu32 " writes since startup)", flushCount);
+        }
+        else
+        {
+            // Try again later
+            ESP_LOGE(LOG_TAG, "Error writing state: %s, retry in %" PRId64 " s", esp_err_to_name(err), retryDelayUs / 1000000);
+            int64_t due = 0;
+            taskENTER_CRITICAL(&stateLock);
+            bool start = schedule_flush_locked(retryDelayUs, &due);
+            taskEXIT_CRITICAL(&stateLock);
+            if (start)
+            {
+                start_flush_timer(due);
+            }
+            retryDelayUs = (2 * retryDelayUs < RETRY_MAX_DELAY_US) ? 2 * retryDelayUs : RETRY_MAX_DELAY_US;
+        }
     }
+    xSemaphoreGive(flushMutex);
+    return err;
+}
 
-    // Close NVS handle
-    nvs_close(my_handle);
-    return ESP_OK;
+// Runs in the esp_timer task, which must not block on flash writes. The main loop writes on APP_EVENT_FLUSH
+static void flush_timer_cb(void *)
+{
+    app_events_post(APP_EVENT_FLUSH);
 }
 
-esp_err_t get_last_stored_mmsi(char mmsi[MMSI_LENGTH])
+// Writes pending changes before restarting
+static void shutdown_handler()
 {
-    nvs_handle_t my_handle;
-    esp_err_t err;
+    flush_stored_state();
+}
 
-    // Open NVS handle
-    err = nvs_open("storage", NVS_READONLY, &my_handle);
-    if (err != ESP_OK)
+esp_err_t init_nvs()
+{
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
-        ESP_LOGE(LOG_TAG, "Error opening NVS handle!");
-        return err;
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
     }
+    ESP_ERROR_CHECK(err);
 
-    // Get the string
-    size_t required_size;
-    err = nvs_get_str(my_handle, "mmsi", NULL, &required_size); // Get required size
-    if (err != ESP_OK)
+    flushMutex = xSemaphoreCreateMutex();
+    const esp_timer_create_args_t timerArgs = {
+        .callback = flush_timer_cb,
+        .name = "nvs_flush"};
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &flushTimer));
+    esp_register_shutdown_handler(shutdown_handler);
+
+    err = load_state();
+    stateLoaded = (err == ESP_OK);
+    return err;
+}
+
+// Returns last store position
+esp_err_t get_last_stored_position(double *latitude, double *longitude)
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    taskENTER_CRITICAL(&stateLock);
+    if (!stateLoaded)
     {
-        ESP_LOGE(LOG_TAG, "Error getting string size");
-        nvs_close(my_handle);
-        return err;
+        err = ESP_ERR_INVALID_STATE;
     }
-    if (required_size != MMSI_LENGTH) {
-        ESP_LOGE(LOG_TAG, "Weird required size: %d", required_size);
-        nvs_close(my_handle);
-        return err;
+    else if (state.positionValid)
+    {
+        *latitude = state.latitude;
+        *longitude = state.longitude;
+        err = ESP_OK;
     }
+    taskEXIT_CRITICAL(&stateLock);
+    return err;
+}
 
-    err = nvs_get_str(my_handle, "mmsi", mmsi, &required_size); // Retrieve the string
-    if (err != ESP_OK)
+// Keeps position in RAM. It gets written at most every APP_STATE_POSITION_FLUSH_INTERVAL_S
+esp_err_t store_position(const double latitude, const double longitude)
+{
+    int64_t due = 0;
+    bool start = false;
+    taskENTER_CRITICAL(&stateLock);
+    if (stateLoaded)
     {
-        ESP_LOGE(LOG_TAG, "Error getting string");
-        nvs_close(my_handle);
-        return err;
+        state.latitude = latitude;
+        state.longitude = longitude;
+        state.positionValid = true;
+        start = schedule_flush_locked(POSITION_FLUSH_DELAY_US, &due);
     }
+    bool loaded = stateLoaded;
+    taskEXIT_CRITICAL(&stateLock);
 
-    // Close NVS handle
-    nvs_close(my_handle);
-    return ESP_OK;
+    if (start)
+    {
+        start_flush_timer(due);
+    }
+    return loaded ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t get_last_stored_mmsi(char mmsi[MMSI_LENGTH])
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    taskENTER_CRITICAL(&stateLock);
+    if (!stateLoaded)
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    else if (state.mmsiValid)
+    {
+        memcpy(mmsi, state.mmsi, MMSI_LENGTH);
+        err = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&stateLock);
+    return err;
 }
 
 esp_err_t store_mmsi(const char mmsi[MMSI_LENGTH])
 {
-    nvs_handle_t my_handle;
-    esp_err_t err;
+    int64_t due = 0;
+    bool start = false;
+    taskENTER_CRITICAL(&stateLock);
+    if (stateLoaded)
+    {
+        strncpy(state.mmsi, mmsi, MMSI_LENGTH - 1);
+        state.mmsi[MMSI_LENGTH - 1] = '\0';
+        state.mmsiValid = true;
+        start = schedule_flush_locked(SETTINGS_FLUSH_DELAY_US, &due);
+    }
+    bool loaded = stateLoaded;
+    taskEXIT_CRITICAL(&stateLock);
 
-    // Open NVS handle
-    err = nvs_open("storage", NVS_READWRITE, &my_handle);
-    if (err != ESP_OK)
+    if (start)
     {
-        ESP_LOGE(LOG_TAG, "Error opening NVS handle!");
-        return err;
+        start_flush_timer(due);
     }
+    return loaded ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
 
-    // Write mmsi
-    err = nvs_set_str(my_handle, "mmsi", mmsi);
-    if (err != ESP_OK)
+esp_err_t get_last_access_point(struct StoredAccessPoint *accessPoint)
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    taskENTER_CRITICAL(&stateLock);
+    if (!stateLoaded)
     {
-        ESP_LOGE(LOG_TAG, "Error writing longitude!");
-        return err;
+        err = ESP_ERR_INVALID_STATE;
+    }
+    else if (state.accessPointValid)
+    {
+        *accessPoint = state.accessPoint;
+        err = ESP_OK;
     }
+    taskEXIT_CRITICAL(&stateLock);
+    return err;
+}
 
-    // Commit changes
-    err = nvs_commit(my_handle);
-    if (err != ESP_OK)
+// Only written if it changed, so reconnecting to the same access point costs no flash write
+esp_err_t store_access_point(const struct StoredAccessPoint *accessPoint)
+{
+    int64_t due = 0;
+    bool start = false;
+    taskENTER_CRITICAL(&stateLock);
+    if (stateLoaded)
     {
-        ESP_LOGE(LOG_TAG, "Error committing changes!");
-        return err;
+        bool valid = accessPoint != NULL;
+        if (valid != state.accessPointValid || (valid && memcmp(&state.accessPoint, accessPoint, sizeof(*accessPoint)) != 0))
+        {
+            state.accessPointValid = valid;
+            memset(&state.accessPoint, 0, sizeof(state.accessPoint));
+            if (valid)
+            {
+                state.accessPoint = *accessPoint;
+            }
+            start = schedule_flush_locked(SETTINGS_FLUSH_DELAY_US, &due);
+        }
     }
+    bool loaded = stateLoaded;
+    taskEXIT_CRITICAL(&stateLock);
 
-    // Close NVS handle
-    nvs_close(my_handle);
-    return ESP_OK;
-}
\ No newline at end of file
+    if (start)
+    {
+        start_flush_timer(due);
+    }
+    return loaded ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
@@ -4,20 +4,30 @@
 #include "esp_err.h"
 
 #include "global.h"
+#include "stored_state.h"
 
-// Initializes NVS
+// Initializes NVS and loads the stored state into RAM. Call this before any other function of this module
 esp_err_t init_nvs();
 
-// Returns last store position
+// Returns last store position (from RAM)
 esp_err_t get_last_stored_position(double *latitude, double *longitude);
 
-// Stores both positions in NVS
+// Stores both positions. Written to NVS delayed (APP_STATE_POSITION_FLUSH_INTERVAL_S), so frequent changes only cost one write
 esp_err_t store_position(const double latitude, const double longitude);
 
-// Returns last store MMSI
+// Returns last store MMSI (from RAM)
 esp_err_t get_last_stored_mmsi(char mmsi[MMSI_LENGTH]);
 
-// Stores MMSI in NVS
+// Stores MMSI. Written to NVS after a few seconds
 esp_err_t store_mmsi(const char mmsi[MMSI_LENGTH]);
 
+// Returns access point of the last successful WiFi connection (from RAM)
+esp_err_t get_last_access_point(struct StoredAccessPoint *accessPoint);
+
+// Stores access point of a successful WiFi connection (NULL forgets it). Written to NVS after a few seconds if it changed
+esp_err_t store_access_point(const struct StoredAccessPoint *accessPoint);
+
+// Writes pending changes to NVS now. Called by the main loop on APP_EVENT_FLUSH (and automatically on esp_restart)
+esp_err_t flush_stored_state();
+
 #endif // NVS_WRAPPER_H_
@@ -0,0 +1,70 @@
+#include "power.h"
+
+#include <stdio.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+
+#include "console.h"
+
+static const char *LOG_TAG = "power";
+
+#if CONFIG_APP_POWER_SAVE
+static esp_pm_lock_handle_t performanceLock = NULL; // Held while decoding, rendering or during TLS handshakes
+
+// Console command: power (lists PM locks and how long they were held)
+static int power_command(int, char **)
+{
+    esp_pm_dump_locks(stdout);
+    return 0;
+}
+#endif
+
+esp_err_t power_init()
+{
+#if CONFIG_APP_POWER_SAVE
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_APP_POWER_MIN_CPU_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "performance", &performanceLock);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create performance lock: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(LOG_TAG, "CPU runs at %d-%d MHz, light sleep %s", config.min_freq_mhz, config.max_freq_mhz, config.light_sleep_enable ? "enabled" : "disabled");
+    return console_register("power", "Lists power management locks", power_command);
+#else
+    return ESP_OK;
+#endif
+}
+
+void power_performance_begin()
+{
+#if CONFIG_APP_POWER_SAVE
+    if (performanceLock != NULL)
+    {
+        esp_pm_lock_acquire(performanceLock);
+    }
+#endif
+}
+
+void power_performance_end()
+{
+#if CONFIG_APP_POWER_SAVE
+    if (performanceLock != NULL)
+    {
+        esp_pm_lock_release(performanceLock);
+    }
+#endif
+}
@@ -0,0 +1,15 @@
+#ifndef POWER_H_
+#define POWER_H_
+
+#include "esp_err.h"
+
+// Configures frequency scaling and automatic light sleep. Call this before other modules take performance locks
+esp_err_t power_init();
+
+// Keeps the CPU at maximum frequency until power_performance_end is called (may be nested and called from any task)
+void power_performance_begin();
+
+// Releases the lock taken by power_performance_begin
+void power_performance_end();
+
+#endif // POWER_H_
@@ -0,0 +1,274 @@
+#include "snapshot.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_lcd_panel_ops.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "global.h"
+#include "display.h"
+#include "heap_stats.h"
+#include "tile_downloader.h"
+#include "tile_rle.h"
+
+#define SNAPSHOT_MAGIC 0x50414E53u                      // "SNAP"
+#define SNAPSHOT_PIXELS (LCD_H_RES * LCD_V_RES)
+#define SNAPSHOT_BLOCK_PIXELS (LCD_H_RES * 16)          // Encoded at once (packets don't cross blocks)
+#define SNAPSHOT_READ_CHUNK 4096                        // Read from flash at once when restoring
+#define SNAPSHOT_SECTOR_SIZE 4096
+#define SNAPSHOT_TASK_STACK_SIZE 4096
+#define SNAPSHOT_TASK_PRIORITY 1 // Below everything else, it only writes flash now and then
+
+_Static_assert(SNAPSHOT_PIXELS % SNAPSHOT_BLOCK_PIXELS == 0, "Frame has to consist of whole blocks");
+
+#if CONFIG_APP_SNAPSHOT
+static const char *LOG_TAG = "snapshot";
+
+// At the start of the partition, followed by the RLE stream (TILE_RLE_MAGIC and packets). Written last, so an interrupted
+// write leaves no valid snapshot
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint16_t width;
+    uint16_t height;
+    uint32_t length;   // Bytes of RLE stream
+    uint32_t checksum; // FNV-1a of RLE stream
+};
+
+static const esp_partition_t *partition = NULL;
+static uint16_t *placeholderPixels = NULL; // Restored snapshot (PSRAM), until the map is loaded
+static lv_obj_t *placeholder = NULL;
+static lv_img_dsc_t placeholderDesc;
+static uint32_t savedChecksum = 0; // Checksum of the snapshot in flash (0: none)
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, const size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns the header of the stored snapshot if it is valid for this display
+static bool read_header(struct SnapshotHeader *header)
+{
+    const size_t maxLength = TILE_RLE_MAGIC_LENGTH + TILE_RLE_MAX_ENCODED(SNAPSHOT_PIXELS);
+    return esp_partition_read(partition, 0, header, sizeof(*header)) == ESP_OK && header->magic == SNAPSHOT_MAGIC &&
+           header->width == LCD_H_RES && header->height == LCD_V_RES && header->length <= maxLength &&
+           sizeof(*header) + header->length <= partition->size;
+}
+#endif
+
+esp_err_t snapshot_restore(esp_lcd_panel_handle_t panel)
+{
+#if CONFIG_APP_SNAPSHOT
+    int64_t start = esp_timer_get_time();
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "snapshot");
+    if (partition == NULL)
+    {
+        ESP_LOGW(LOG_TAG, "No snapshot partition (see partitions.csv)");
+        return ESP_ERR_NOT_FOUND;
+    }
+    struct SnapshotHeader header;
+    if (!read_header(&header))
+    {
+        ESP_LOGI(LOG_TAG, "No snapshot stored");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    placeholderPixels = heap_stats_malloc(HEAP_TAG_DISPLAY, SNAPSHOT_PIXELS * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    uint8_t *chunk = heap_stats_malloc(HEAP_TAG_DISPLAY, SNAPSHOT_READ_CHUNK, 0);
+    if (placeholderPixels == NULL || chunk == NULL)
+    {
+        heap_stats_free(HEAP_TAG_DISPLAY, placeholderPixels);
+        heap_stats_free(HEAP_TAG_DISPLAY, chunk);
+        placeholderPixels = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    struct TileRleDecoder decoder;
+    tile_rle_begin(&decoder, placeholderPixels, SNAPSHOT_PIXELS);
+    uint32_t checksum = 2166136261u;
+    esp_err_t err = ESP_OK;
+    for (size_t offset = 0; offset < header.length && err == ESP_OK; offset += SNAPSHOT_READ_CHUNK)
+    {
+        size_t size = (header.length - offset < SNAPSHOT_READ_CHUNK) ? header.length - offset : SNAPSHOT_READ_CHUNK;
+        err = esp_partition_read(partition, sizeof(header) + offset, chunk, size);
+        if (err == ESP_OK && !tile_rle_feed(&decoder, chunk, size))
+        {
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+        checksum = fnv1a(checksum, chunk, size);
+    }
+    heap_stats_free(HEAP_TAG_DISPLAY, chunk);
+    if (err == ESP_OK && (!tile_rle_finish(&decoder) || checksum != header.checksum))
+    {
+        err = ESP_ERR_INVALID_CRC;
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(LOG_TAG, "Stored snapshot is invalid: %s", esp_err_to_name(err));
+        heap_stats_free(HEAP_TAG_DISPLAY, placeholderPixels);
+        placeholderPixels = NULL;
+        return err;
+    }
+    savedChecksum = header.checksum;
+
+    // Driver copies it into the frame buffer (and writes it back from cache, so the panel DMA sees it)
+    err = esp_lcd_panel_draw_bitmap(panel, 0, 0, LCD_H_RES, LCD_V_RES, placeholderPixels);
+    ESP_LOGI(LOG_TAG, "Restored snapshot (%" PRIu32 " bytes) in %" PRId64 " ms", header.length, (esp_timer_get_time() - start) / 1000);
+    return err;
+#else
+    return ESP_OK;
+#endif
+}
+
+void snapshot_show_placeholder()
+{
+#if CONFIG_APP_SNAPSHOT
+    if (placeholderPixels == NULL)
+    {
+        return;
+    }
+    memset(&placeholderDesc, 0, sizeof(placeholderDesc));
+    placeholderDesc.header.cf = LV_IMG_CF_TRUE_COLOR;
+    placeholderDesc.header.w = LCD_H_RES;
+    placeholderDesc.header.h = LCD_V_RES;
+    placeholderDesc.data_size = SNAPSHOT_PIXELS * sizeof(lv_color_t);
+    placeholderDesc.data = (const uint8_t *)placeholderPixels;
+    placeholder = lv_img_create(lv_scr_act());
+    lv_img_set_src(placeholder, &placeholderDesc);
+    lv_obj_set_pos(placeholder, 0, 0);
+    lv_obj_clear_flag(placeholder, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_move_background(placeholder);
+#endif
+}
+
+void snapshot_move_placeholder_to_background()
+{
+#if CONFIG_APP_SNAPSHOT
+    if (placeholder != NULL)
+    {
+        lv_obj_move_background(placeholder); // Map view has no background, so its tiles cover the placeholder once loaded
+    }
+#endif
+}
+
+void snapshot_hide_placeholder()
+{
+#if CONFIG_APP_SNAPSHOT
+    if (placeholder == NULL)
+    {
+        return;
+    }
+    lv_obj_del(placeholder);
+    placeholder = NULL;
+    heap_stats_free(HEAP_TAG_DISPLAY, placeholderPixels);
+    placeholderPixels = NULL;
+#endif
+}
+
+#if CONFIG_APP_SNAPSHOT
+// Encodes frame and returns checksum and length of the stream. Writes it behind the header if write is set
+static esp_err_t encode_frame(const uint16_t *frame, uint8_t *block, const bool write, uint32_t *checksum, uint32_t *length)
+{
+    *checksum = fnv1a(2166136261u, (const uint8_t *)TILE_RLE_MAGIC, TILE_RLE_MAGIC_LENGTH);
+    *length = TILE_RLE_MAGIC_LENGTH;
+    esp_err_t err = write ? esp_partition_write(partition, sizeof(struct SnapshotHeader), TILE_RLE_MAGIC, TILE_RLE_MAGIC_LENGTH) : ESP_OK;
+    for (size_t offset = 0; offset < SNAPSHOT_PIXELS && err == ESP_OK; offset += SNAPSHOT_BLOCK_PIXELS)
+    {
+        size_t size = tile_rle_encode(&frame[offset], SNAPSHOT_BLOCK_PIXELS, block);
+        *checksum = fnv1a(*checksum, block, size);
+        if (write)
+        {
+            err = esp_partition_write(partition, sizeof(struct SnapshotHeader) + *length, block, size);
+        }
+        *length += size;
+    }
+    return err;
+}
+
+// Writes the shown map to flash if it differs from the stored one. Only the tiles count: the ship, traffic and status widgets
+// change all the time and are drawn over the placeholder anyway
+static void save_snapshot()
+{
+    const size_t frameSize = SNAPSHOT_PIXELS * sizeof(uint16_t);
+    uint16_t *frame = heap_stats_malloc(HEAP_TAG_DISPLAY, frameSize, MALLOC_CAP_SPIRAM);
+    uint8_t *block = heap_stats_malloc(HEAP_TAG_DISPLAY, TILE_RLE_MAX_ENCODED(SNAPSHOT_BLOCK_PIXELS), MALLOC_CAP_SPIRAM);
+    if (frame == NULL || block == NULL)
+    {
+        ESP_LOGW(LOG_TAG, "Not enough memory for snapshot");
+        heap_stats_free(HEAP_TAG_DISPLAY, frame);
+        heap_stats_free(HEAP_TAG_DISPLAY, block);
+        return;
+    }
+
+    // Tiles mustn't change while being copied
+    display_lock();
+    bool mapShown = placeholder == NULL && map_copy_view(frame);
+    display_unlock();
+
+    uint32_t checksum = 0;
+    uint32_t length = 0;
+    esp_err_t err = ESP_OK;
+    if (mapShown)
+    {
+        encode_frame(frame, block, false, &checksum, &length);
+    }
+    if (mapShown && checksum != savedChecksum)
+    {
+        int64_t start = esp_timer_get_time();
+        const struct SnapshotHeader header = {
+            .magic = SNAPSHOT_MAGIC,
+            .width = LCD_H_RES,
+            .height = LCD_V_RES,
+            .length = length,
+            .checksum = checksum};
+        size_t eraseSize = (sizeof(header) + length + SNAPSHOT_SECTOR_SIZE - 1) / SNAPSHOT_SECTOR_SIZE * SNAPSHOT_SECTOR_SIZE;
+        err = esp_partition_erase_range(partition, 0, eraseSize);
+        if (err == ESP_OK)
+        {
+            err = encode_frame(frame, block, true, &checksum, &length);
+        }
+        if (err == ESP_OK)
+        {
+            err = esp_partition_write(partition, 0, &header, sizeof(header));
+        }
+        if (err == ESP_OK)
+        {
+            savedChecksum = checksum;
+            ESP_LOGI(LOG_TAG, "Snapshot written (%" PRIu32 " bytes) in %" PRId64 " ms", length, (esp_timer_get_time() - start) / 1000);
+        }
+        else
+        {
+            ESP_LOGE(LOG_TAG, "Error writing snapshot: %s", esp_err_to_name(err));
+        }
+    }
+    heap_stats_free(HEAP_TAG_DISPLAY, frame);
+    heap_stats_free(HEAP_TAG_DISPLAY, block);
+}
+
+static void snapshot_task(void *)
+{
+    while (1)
+    {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_APP_SNAPSHOT_INTERVAL_S * 1000));
+        save_snapshot();
+    }
+}
+#endif
+
+void snapshot_start()
+{
+#if CONFIG_APP_SNAPSHOT
+    if (partition != NULL)
+    {
+        xTaskCreate(snapshot_task, "snapshot", SNAPSHOT_TASK_STACK_SIZE, NULL, SNAPSHOT_TASK_PRIORITY, NULL);
+    }
+#endif
+}
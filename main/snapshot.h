@@ -0,0 +1,26 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+// Snapshot of the shown map in the "snapshot" flash partition, shown right after power-on until the map is loaded again
+// (only with CONFIG_APP_SNAPSHOT, otherwise all functions do nothing)
+
+// Decodes the last snapshot and puts it into the panel's frame buffer. Call right after the panel is initialized
+esp_err_t snapshot_restore(esp_lcd_panel_handle_t panel);
+
+// Shows the restored snapshot behind all LVGL objects, so rendering doesn't replace it. Call with display locked
+void snapshot_show_placeholder();
+
+// Moves the placeholder behind all LVGL objects again, e.g. after the map view moved itself to the background. Call with
+// display locked
+void snapshot_move_placeholder_to_background();
+
+// Removes the placeholder as soon as the map shows real content and frees its memory. Call with display locked
+void snapshot_hide_placeholder();
+
+// Starts a task which writes the shown map (without overlays) to flash every CONFIG_APP_SNAPSHOT_INTERVAL_S if it changed
+void snapshot_start();
+
+#endif // SNAPSHOT_H_
@@ -0,0 +1,69 @@
+#include "stored_state.h"
+
+#include <string.h>
+
+// Version 1: without access point
+struct StoredStateV1
+{
+    uint32_t version;
+    bool positionValid;
+    bool mmsiValid;
+    double latitude;
+    double longitude;
+    char mmsi[STORED_MMSI_LENGTH];
+};
+
+bool stored_state_decode(const void *blob, const size_t size, struct StoredState *state)
+{
+    struct StoredState decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    if (size == sizeof(struct StoredStateV1))
+    {
+        struct StoredStateV1 old;
+        memcpy(&old, blob, sizeof(old));
+        decoded.version = (old.version == 1) ? STORED_STATE_VERSION : 0;
+        decoded.positionValid = old.positionValid;
+        decoded.mmsiValid = old.mmsiValid;
+        decoded.latitude = old.latitude;
+        decoded.longitude = old.longitude;
+        memcpy(decoded.mmsi, old.mmsi, STORED_MMSI_LENGTH);
+    }
+    else if (size == sizeof(struct StoredState))
+    {
+        memcpy(&decoded, blob, sizeof(decoded));
+    }
+    if (decoded.version != STORED_STATE_VERSION)
+    {
+        return false;
+    }
+    if (decoded.mmsiValid && memchr(decoded.mmsi, '\0', STORED_MMSI_LENGTH) == NULL)
+    {
+        return false; // Not terminated, must not be used as string
+    }
+    if (decoded.accessPointValid && memchr(decoded.accessPoint.ssid, '\0', STORED_SSID_LENGTH) == NULL)
+    {
+        return false;
+    }
+    *state = decoded;
+    return true;
+}
+
+bool flush_schedule_mark(struct FlushSchedule *schedule, const int64_t now, const int64_t delayUs)
+{
+    schedule->dirty = true;
+    int64_t wanted = now + delayUs;
+    if (schedule->due != 0 && schedule->due <= wanted)
+    {
+        return false; // Already scheduled earlier, change gets written with it
+    }
+    schedule->due = wanted;
+    return true;
+}
+
+bool flush_schedule_take(struct FlushSchedule *schedule)
+{
+    bool dirty = schedule->dirty;
+    schedule->dirty = false;
+    schedule->due = 0;
+    return dirty;
+}
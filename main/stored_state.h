@@ -0,0 +1,51 @@
+#ifndef STORED_STATE_H_
+#define STORED_STATE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Record persisted by nvs_wrapper and its write scheduling. No dependencies, also built on host (see host/)
+
+#define STORED_STATE_VERSION 2 // Increase if StoredState changes (and migrate the old one in stored_state_decode)
+#define STORED_MMSI_LENGTH (9 + 1) // Same as MMSI_LENGTH
+#define STORED_SSID_LENGTH (32 + 1)
+
+// Access point of the last successful connection, connected to directly at next start (no scan)
+struct StoredAccessPoint
+{
+    char ssid[STORED_SSID_LENGTH];
+    uint8_t bssid[6];
+    uint8_t channel;
+};
+
+// Everything that survives a restart. Stored as one blob, so it is always consistent
+struct StoredState
+{
+    uint32_t version;
+    bool positionValid;
+    bool mmsiValid;
+    double latitude;
+    double longitude;
+    char mmsi[STORED_MMSI_LENGTH];
+    bool accessPointValid;
+    struct StoredAccessPoint accessPoint;
+};
+
+// Pending write of the state
+struct FlushSchedule
+{
+    bool dirty;  // RAM copy differs from flash
+    int64_t due; // Timepoint the pending write is scheduled for (0 if none)
+};
+
+// Checks a blob read from flash and copies it into state (records of older versions get migrated). Returns false if it is no valid record
+bool stored_state_decode(const void *blob, const size_t size, struct StoredState *state);
+
+// Marks state as changed, it has to be written within delayUs. Returns true if the write timer has to be (re)started for schedule->due
+bool flush_schedule_mark(struct FlushSchedule *schedule, const int64_t now, const int64_t delayUs);
+
+// Takes the pending write. Returns false if nothing changed since last write
+bool flush_schedule_take(struct FlushSchedule *schedule);
+
+#endif // STORED_STATE_H_
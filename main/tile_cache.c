@@ -0,0 +1,77 @@
+#include "tile_cache.h"
+
+#include <string.h>
+
+#include "tile_decoder.h"
+
+struct CacheEntry
+{
+    int zoom; // -1 if unused
+    int x;
+    int y;
+    uint32_t lastUse; // Value of useCounter at last access
+};
+
+static struct CacheEntry *entries = NULL;
+static uint16_t *pixelMemory = NULL; // TILE_PIXELS per entry
+static size_t entryCount = 0;
+static uint32_t useCounter = 0;
+
+size_t tile_cache_memory_size(const size_t tiles)
+{
+    return tiles * (TILE_PIXELS * sizeof(uint16_t) + sizeof(struct CacheEntry));
+}
+
+void tile_cache_init(void *memory, const size_t tiles)
+{
+    // Pixels first, they keep the alignment of memory
+    pixelMemory = (uint16_t *)memory;
+    entries = (struct CacheEntry *)(pixelMemory + tiles * TILE_PIXELS);
+    entryCount = tiles;
+    for (size_t i = 0; i < entryCount; i++)
+    {
+        entries[i].zoom = -1;
+        entries[i].lastUse = 0;
+    }
+}
+
+const uint16_t *tile_cache_find(const int zoom, const int x, const int y)
+{
+    for (size_t i = 0; i < entryCount; i++)
+    {
+        if (entries[i].zoom == zoom && entries[i].x == x && entries[i].y == y)
+        {
+            entries[i].lastUse = ++useCounter;
+            return &pixelMemory[i * TILE_PIXELS];
+        }
+    }
+    return NULL;
+}
+
+void tile_cache_put(const int zoom, const int x, const int y, const uint16_t *pixels)
+{
+    if (entryCount == 0)
+    {
+        return;
+    }
+
+    // Same tile again or least recently used entry (unused ones have lastUse 0)
+    size_t victim = 0;
+    for (size_t i = 0; i < entryCount; i++)
+    {
+        if (entries[i].zoom == zoom && entries[i].x == x && entries[i].y == y)
+        {
+            victim = i;
+            break;
+        }
+        if (entries[i].lastUse < entries[victim].lastUse)
+        {
+            victim = i;
+        }
+    }
+    memcpy(&pixelMemory[victim * TILE_PIXELS], pixels, TILE_PIXELS * sizeof(uint16_t));
+    entries[victim].zoom = zoom;
+    entries[victim].x = x;
+    entries[victim].y = y;
+    entries[victim].lastUse = ++useCounter;
+}
@@ -0,0 +1,23 @@
+#ifndef TILE_CACHE_H_
+#define TILE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Least recently used cache of decoded tiles. Not thread safe (only used by the task downloading tiles).
+// No dependencies, also built on host (see host/)
+
+// Returns bytes needed for given amount of tiles
+size_t tile_cache_memory_size(const size_t tiles);
+
+// Uses given memory (tile_cache_memory_size) for the cache
+void tile_cache_init(void *memory, const size_t tiles);
+
+// Returns pixels of a cached tile (valid until the next tile_cache_put) or NULL if it isn't cached
+const uint16_t *tile_cache_find(const int zoom, const int x, const int y);
+
+// Copies a tile into the cache, replacing the least recently used one
+void tile_cache_put(const int zoom, const int x, const int y, const uint16_t *pixels);
+
+#endif // TILE_CACHE_H_
@@ -0,0 +1,208 @@
+#include "tile_decoder.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "pngle.h"
+
+#include "arena.h"
+
+static const char *LOG_TAG = "TileDecoder";
+
+static pngle_t *pngle_handle = NULL;
+static uint16_t *targetPixels = NULL; // Buffer of tile being decoded
+static const uint8_t *pngData = NULL; // PNG of tile being decoded
+static size_t pngLength = 0;
+static size_t pngOffset = 0;          // Bytes of pngData consumed by the decoder so far
+static uint32_t longestSliceUs = 0;   // Of calls with time budget
+
+// pngle allocates its state once and scanline buffer and palettes per tile. Everything comes from the arena, which is reset
+// after every tile, so that decoding doesn't touch the heap (and doesn't fragment it)
+static struct Arena arena;
+static uint32_t heapAllocations = 0; // Allocations the arena was too small for
+static bool fallbackLogged = false;
+
+void *tile_decoder_malloc(size_t size)
+{
+    void *ptr = arena_alloc(&arena, size);
+    if (ptr == NULL && size > 0)
+    {
+        if (!fallbackLogged)
+        {
+            ESP_LOGW(LOG_TAG, "Decoder arena too small (%u of %u bytes used, %u requested), using heap", (unsigned)arena.used, (unsigned)arena.size, (unsigned)size);
+            fallbackLogged = true;
+        }
+        heapAllocations++;
+        ptr = malloc(size);
+    }
+    return ptr;
+}
+
+void *tile_decoder_calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+    void *ptr = tile_decoder_malloc(count * size);
+    if (ptr != NULL)
+    {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *tile_decoder_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL || !arena_contains(&arena, ptr))
+    {
+        if (ptr != NULL)
+        {
+            heapAllocations++;
+        }
+        return (ptr == NULL) ? tile_decoder_malloc(size) : realloc(ptr, size);
+    }
+    size_t oldSize = arena_block_size(ptr);
+    if (size <= oldSize)
+    {
+        return ptr;
+    }
+    void *grown = tile_decoder_malloc(size);
+    if (grown != NULL)
+    {
+        memcpy(grown, ptr, oldSize);
+    }
+    return grown;
+}
+
+void tile_decoder_free(void *ptr)
+{
+    // Blocks of the arena are released all at once by arena_reset
+    if (ptr != NULL && !arena_contains(&arena, ptr))
+    {
+        free(ptr);
+    }
+}
+
+void tile_decoder_get_stats(struct TileDecoderStats *stats)
+{
+    stats->arenaSize = arena.size;
+    stats->arenaPeak = arena.peak;
+    stats->heapAllocations = heapAllocations;
+    stats->longestSliceUs = longestSliceUs;
+}
+
+// Packs 8 bit channels into RGB565 (like lv_color_make without LV_COLOR_16_SWAP)
+static inline uint16_t to_rgb565(const uint8_t r, const uint8_t g, const uint8_t b)
+{
+    return (uint16_t)(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3));
+}
+
+// Gets called for every decoded pixel (or block of pixels of interlaced images)
+static void on_draw(pngle_t *, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t rgba[4])
+{
+    uint16_t color = to_rgb565(rgba[0], rgba[1], rgba[2]);
+    for (uint32_t row = y; row < y + h && row < TILE_SIZE; row++)
+    {
+        for (uint32_t column = x; column < x + w && column < TILE_SIZE; column++)
+        {
+            targetPixels[row * TILE_SIZE + column] = color;
+        }
+    }
+}
+
+esp_err_t tile_decoder_init(void *arenaMemory, const size_t arenaSize)
+{
+    arena_init(&arena, arenaMemory, arenaSize);
+
+    // instantiate PNGLE and set callbacks
+    pngle_handle = pngle_new();
+    if (pngle_handle == NULL)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create PNG decoder");
+        return ESP_FAIL;
+    }
+    pngle_set_draw_callback(pngle_handle, on_draw);
+    arena_set_mark(&arena); // Decoder state stays, everything after is per tile
+    ESP_LOGI(LOG_TAG, "Decoder state uses %u of %u bytes arena", (unsigned)arena.mark, (unsigned)arena.size);
+    return ESP_OK;
+}
+
+// Makes the decoder ready for the next tile
+static void finish_tile()
+{
+    pngle_reset(pngle_handle);
+    arena_reset(&arena);
+    targetPixels = NULL;
+    pngData = NULL;
+}
+
+void tile_decode_begin(const uint8_t *png, const size_t length, uint16_t *pixels)
+{
+    targetPixels = pixels;
+    pngData = png;
+    pngLength = length;
+    pngOffset = 0;
+}
+
+esp_err_t tile_decode_continue(const uint32_t budgetUs)
+{
+    if (pngData == NULL)
+    {
+        return ESP_FAIL;
+    }
+
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed = 0;
+    const size_t sliceBytes = (budgetUs == 0) ? pngLength : TILE_DECODE_SLICE_BYTES; // Without budget everything at once
+    size_t slice = sliceBytes;
+    esp_err_t ret = ESP_ERR_NOT_FINISHED;
+    while (ret == ESP_ERR_NOT_FINISHED && (budgetUs == 0 || elapsed < budgetUs))
+    {
+        size_t remaining = pngLength - pngOffset;
+        size_t length = (remaining < slice) ? remaining : slice;
+        int fed = pngle_feed(pngle_handle, pngData + pngOffset, length);
+        if (fed < 0)
+        {
+            ESP_LOGI(LOG_TAG, "PNGLE_Error: %s", pngle_error(pngle_handle));
+            ret = ESP_FAIL;
+        }
+        else if (fed == 0 && length < remaining)
+        {
+            slice *= 2; // Slice ended inside a chunk header or CRC, which pngle only takes at once
+        }
+        else
+        {
+            pngOffset += (fed == 0) ? remaining : (size_t)fed; // Like feeding everything at once, trailing bytes are ignored
+            slice = sliceBytes;
+            ret = (pngOffset >= pngLength) ? ESP_OK : ESP_ERR_NOT_FINISHED;
+        }
+        elapsed = esp_timer_get_time() - start;
+    }
+
+    if (budgetUs != 0 && elapsed > longestSliceUs)
+    {
+        longestSliceUs = (uint32_t)elapsed;
+    }
+    if (ret != ESP_ERR_NOT_FINISHED)
+    {
+        finish_tile();
+    }
+    return ret;
+}
+
+void tile_decode_abort()
+{
+    if (pngData != NULL)
+    {
+        finish_tile();
+    }
+}
+
+esp_err_t tile_decode(const uint8_t *png, const size_t length, uint16_t *pixels)
+{
+    tile_decode_begin(png, length, pixels);
+    return tile_decode_continue(0);
+}
@@ -0,0 +1,45 @@
+#ifndef TILE_DECODER_H_
+#define TILE_DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define TILE_SIZE 256 // Tile size in pixels
+#define TILE_PIXELS (TILE_SIZE * TILE_SIZE)
+#define TILE_DECODE_SLICE_BYTES 256 // PNG data fed to the decoder at once. Time budgets are checked in between
+
+struct TileDecoderStats
+{
+    size_t arenaSize;         // Bytes of the decoder's arena
+    size_t arenaPeak;         // Most bytes of the arena used at once
+    uint32_t heapAllocations; // Allocations which didn't fit into the arena and went to the heap
+    uint32_t longestSliceUs;  // Longest call of tile_decode_continue with budget (exceeded by up to one input slice)
+};
+
+// Sets up the PNG decoder. Its state (including the 32 KB inflate window) and all allocations while decoding live in given memory
+esp_err_t tile_decoder_init(void *arenaMemory, const size_t arenaSize);
+
+// Decodes a PNG tile into RGB565 pixels (TILE_SIZE x TILE_SIZE, same layout as lv_color_t with 16 bit colors). Not reentrant
+esp_err_t tile_decode(const uint8_t *png, const size_t length, uint16_t *pixels);
+
+// Starts decoding a PNG tile into pixels in slices (see tile_decode_continue). png has to stay valid until the tile is done
+void tile_decode_begin(const uint8_t *png, const size_t length, uint16_t *pixels);
+
+// Decodes until about budgetUs passed (0: no limit). Returns ESP_ERR_NOT_FINISHED if data is left, ESP_OK once the tile is done
+// and ESP_FAIL on invalid data
+esp_err_t tile_decode_continue(const uint32_t budgetUs);
+
+// Drops the rest of the tile being decoded
+void tile_decode_abort();
+
+// Returns usage of the decoder's arena
+void tile_decoder_get_stats(struct TileDecoderStats *stats);
+
+// Allocation functions pngle.c is compiled with instead of calloc/malloc/realloc/free (see main/CMakeLists.txt)
+void *tile_decoder_calloc(size_t count, size_t size);
+void *tile_decoder_malloc(size_t size);
+void *tile_decoder_realloc(void *ptr, size_t size);
+void tile_decoder_free(void *ptr);
+
+#endif // TILE_DECODER_H_
@@ -1,163 +1,646 @@
 #include "tile_downloader.h"
 
+#include <inttypes.h>
 #include <math.h>
+#include <string.h>
 
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "wifi.h"
 #include "lvgl.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_http_client.h"
-#include "pngle.h"
-#include "smallBoat.c"
+#include "ais_targets.h"
+#include "app_events.h"
+#include "display.h"
+#include "boat_sprites.h"
+#include "tile_decoder.h"
+#include "tile_math.h"
+#include "power.h"
+#include "tile_trace.h"
+#include "heap_stats.h"
+#include "tile_cache.h"
+#include "tile_synth.h"
+#include "tile_rle.h"
+#include "snapshot.h"
+#include "view_model.h"
 
-#define TILE_SIZE 256 // Tile size in pixels
-#define TILE_PIXELS (TILE_SIZE * TILE_SIZE)
-
-#define TILES_PER_COLUMN 3
-#define TILES_PER_ROW 2
+// The tile grid is bigger than the screen so that it can be panned. It gets shifted by whole tiles if the view comes near its border
+#define TILES_PER_COLUMN 5
+#define TILES_PER_ROW 3
 #define TILES_COUNT (TILES_PER_COLUMN * TILES_PER_ROW)
+#define ATTEMPTED_TILES_MAX (2 * TILES_COUNT) // Panning during a pass exposes more tiles than there are slots
 
 #define IMAGE_WIDTH (TILES_PER_COLUMN * TILE_SIZE)
 #define IMAGE_HEIGHT (TILES_PER_ROW * TILE_SIZE)
 
-#define TILE_URL_TEMPLATE "http://tile.openstreetmap.org/%d/%d/%d.png"
+// Maximum scroll position of the view inside the grid
+#define SCROLL_MAX_X (IMAGE_WIDTH - LCD_H_RES)
+#define SCROLL_MAX_Y (IMAGE_HEIGHT - LCD_V_RES)
+
+// Grid gets shifted if view is closer than this to the border. Chosen so that a shift never triggers the opposite one
+#define SHIFT_MARGIN_X ((SCROLL_MAX_X - TILE_SIZE) / 2)
+#define SHIFT_MARGIN_Y ((SCROLL_MAX_Y - TILE_SIZE) / 2)
+
+// Point of the view the ship gets centered on (the sidebar covers the right part of the screen)
+#define VIEW_CENTER_X ((LCD_H_RES - SIDEBAR_WIDTH) / 2)
+#define VIEW_CENTER_Y (LCD_V_RES / 2)
+
+#define FOLLOW_RESUME_US (30 * 1000 * 1000) // Map follows the ship again after this time without being touched
+#define FOLLOW_CHECK_PERIOD_MS 1000
+#define MAX_PINCH_ZOOM_STEPS 3 // Zoom levels one pinch may change at most
+
+#define MAX_TRAFFIC_MARKERS 32 // Maximum amount of other vessels shown at once
+#define TRAFFIC_MARKER_SIZE 10 // Diameter of traffic marker
+
+#if CONFIG_TILE_DECODER_ARENA_INTERNAL
+#define DECODER_ARENA_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#else
+#define DECODER_ARENA_CAPS MALLOC_CAP_SPIRAM
+#endif
+
+#if CONFIG_TILE_PROXY
+// Tiles come already converted to RGB565 (tools/tile_proxy.py) and get decoded while they are received
+#define TILE_HOST CONFIG_TILE_PROXY_HOST
+#define TILE_URL_TEMPLATE "http://" TILE_HOST ":%d/%d/%d/%d.rle"
+#define PROXY_CHUNK_SIZE 4096 // Received at once, small enough that decoding overlaps with receiving
+#else
+#define TILE_HOST "tile.openstreetmap.org"
+#define TILE_URL_TEMPLATE "http://" TILE_HOST "/%d/%d/%d.png"
+#endif
+
+#if SCROLL_MAX_X < TILE_SIZE || SCROLL_MAX_Y < TILE_SIZE
+#error "Tile grid has to be at least one tile bigger than the screen in each direction"
+#endif
 
 static const char *LOG_TAG = "TileDownloader";
 
-static lv_obj_t *img_widgets[TILES_COUNT] = {NULL}; // Array to hold image widgets
+// Content of a slot. Ordered by quality
+enum TILE_STATE
+{
+    TILE_MISSING,     // No content, hidden
+    TILE_APPROXIMATE, // Built from a cached tile of another zoom level, gets replaced by the real one
+    TILE_LOADED,      // Downloaded (or from cache)
+};
+
+static lv_obj_t *mapView = NULL;                    // Scrollable container holding tiles and markers
+static lv_obj_t *img_widgets[TILES_COUNT] = {NULL}; // Array to hold image widgets (slot = row * TILES_PER_COLUMN + column)
 static lv_img_dsc_t img_descs[TILES_COUNT];         // Array to hold image descriptors
 static lv_color_t *image_buffers[TILES_COUNT];      // Buffers for image data
+static lv_color_t *decodeBuffer = NULL;             // Tile being decoded. Gets swapped with the buffer of its slot afterwards
+static enum TILE_STATE tileState[TILES_COUNT];      // Content of slot
 static lv_obj_t *shipMarker = NULL;                 // Ship position marked on map
-static uint8_t httpData[TILE_PIXELS];               // Buffer for http
-static pngle_t *pngle_handle;
+static const lv_img_dsc_t *shipSprite = NULL;       // Pre-rotated image currently shown by shipMarker
+#if CONFIG_TILE_PROXY
+static uint8_t httpData[PROXY_CHUNK_SIZE];          // Buffer for http, tile is decoded chunk by chunk
+#else
+static uint8_t httpData[TILE_PIXELS];               // Buffer for http (OSM tiles are far smaller)
+#endif
 
-static size_t pixel_index = 0;             // Index to keep track of the current pixel in a tile
-static uint8_t tile_index = 0;             // Index to keep track of current tile
-static lv_coord_t shipTileCoordinateX = 0; // X-Coordinate of ship in tile
-static lv_coord_t shipTileCoordinateY = 0; // Y-Coordinate of ship in tile
+_Static_assert(sizeof(lv_color_t) == sizeof(uint16_t) && !LV_COLOR_16_SWAP, "Tile decoder writes RGB565 in lv_color_t layout");
+
+// Map state. Only accessed with display locked, as the LVGL task shifts the grid while the user pans
+static bool tilesShown = false;       // Whether the following grid coordinates are valid
+static int gridX = 0;                 // X-Tile-Coordinate of upper left tile (may be outside of the world while panning)
+static int gridY = 0;                 // Y-Tile-Coordinate of upper left tile
+static int shownZoom = 0;             // Zoom level of shown tiles
+static bool shipPositionKnown = false;
+static double shipLatitude = 0;
+static double shipLongitude = 0;
+static bool following = true;         // Map gets centered on the ship (until the user pans it)
+static int64_t lastInteraction = 0;   // Timepoint user touched the map last
+static int pendingZoomSteps = 0;      // Zoom levels requested by pinch gestures, not taken yet
+static bool shifting = false;         // Grid is being shifted, scroll events are caused by us
+
+#if CONFIG_AIS_TRAFFIC_MODE
+// Marker of another vessel on screen
+struct TrafficMarker
+{
+    lv_obj_t *obj; // Dot on screen (NULL if not created yet)
+    int mmsi;      // MMSI of shown vessel (0 if unused)
+    lv_coord_t x;  // Current position on tile grid
+    lv_coord_t y;
+};
+
+static lv_obj_t *trafficLayer = NULL; // Transparent layer above tiles holding the traffic markers
+static struct TrafficMarker trafficMarkers[MAX_TRAFFIC_MARKERS];
+static struct AIS_TARGET visibleTargets[MAX_TRAFFIC_MARKERS];
+#endif
+
+// Converts a position to pixel coordinates on the tile grid. Returns false if it is not on the grid
+static bool position_to_map_coordinates(const double latitude, const double longitude, lv_coord_t *x, lv_coord_t *y)
+{
+    struct WorldPoint point;
+    int32_t xPixel;
+    int32_t yPixel;
+    position_to_world(latitude, longitude, &point);
+    world_to_pixel(&point, shownZoom, &xPixel, &yPixel);
+    xPixel -= gridX * TILE_SIZE;
+    yPixel -= gridY * TILE_SIZE;
+    if (xPixel < 0 || xPixel >= IMAGE_WIDTH || yPixel < 0 || yPixel >= IMAGE_HEIGHT)
+    {
+        return false;
+    }
+    *x = (lv_coord_t)xPixel;
+    *y = (lv_coord_t)yPixel;
+    return true;
+}
 
-// Converts Position to tile coordinates
-void position_to_tile_coordinates(double lat, double lon, int zoom, int *x_tile, int *y_tile)
+// Converts pixel coordinates on the tile grid to a position
+static void map_coordinates_to_position(const lv_coord_t x, const lv_coord_t y, double *latitude, double *longitude)
 {
-    int n = 1 << zoom;
-    *x_tile = (int)((lon + 180.0) / 360.0 * n);
-    *y_tile = (int)((1.0 - log(tan(lat * M_PI / 180.0) + 1 / cos(lat * M_PI / 180.0)) / M_PI) / 2.0 * n);
+    *latitude = tile_to_latitude(gridY + (double)y / TILE_SIZE, shownZoom);
+    *longitude = tile_to_longitude(gridX + (double)x / TILE_SIZE, shownZoom);
 }
 
-bool new_tiles_for_position_needed(const double oldLatitude, const double oldLongitude, const int oldZoom, const double latitude, const double longitude, const int zoom)
+// Returns the tile coordinates of a slot (x wraps around the world). Returns false if the slot is beyond the poles
+static bool slot_to_tile(const int slot, int *xTile, int *yTile)
 {
-    int oldX;
-    int oldY;
-    position_to_tile_coordinates(oldLatitude, oldLongitude, oldZoom, &oldX, &oldY);
+    int n = 1 << shownZoom;
+    *xTile = ((gridX + slot % TILES_PER_COLUMN) % n + n) % n;
+    *yTile = gridY + slot / TILES_PER_COLUMN;
+    return (*yTile >= 0) && (*yTile < n);
+}
 
-    int newX;
-    int newY;
-    position_to_tile_coordinates(latitude, longitude, zoom, &newX, &newY);
+// Places ship marker at the last known ship position (hidden if it is not on the grid)
+static void place_ship_marker()
+{
+    if (!tilesShown || !shipPositionKnown)
+    {
+        return;
+    }
+    if (shipMarker == NULL)
+    {
+        shipMarker = lv_img_create(mapView); // Created last, so it is above tiles and traffic
+        shipSprite = boat_sprite_for_course(-1);
+        lv_img_set_src(shipMarker, shipSprite);
+    }
 
-    return (oldX != newX) || (oldY != newY);
+    lv_coord_t x;
+    lv_coord_t y;
+    // Changing the hidden flag invalidates the marker even if it has that state already
+    if (!position_to_map_coordinates(shipLatitude, shipLongitude, &x, &y))
+    {
+        if (lv_obj_has_flag(shipMarker, LV_OBJ_FLAG_HIDDEN))
+        {
+            view_model_count(VIEW_WIDGET_SHIP_MARKER, NULL);
+            return;
+        }
+        view_model_count(VIEW_WIDGET_SHIP_MARKER, shipMarker); // Area gets invalidated before hiding
+        lv_obj_add_flag(shipMarker, LV_OBJ_FLAG_HIDDEN);
+        return;
+    }
+    x -= shipSprite->header.w / 2;
+    y -= shipSprite->header.h / 2;
+    if (!lv_obj_has_flag(shipMarker, LV_OBJ_FLAG_HIDDEN) && lv_obj_get_style_x(shipMarker, LV_PART_MAIN) == x &&
+        lv_obj_get_style_y(shipMarker, LV_PART_MAIN) == y)
+    {
+        view_model_count(VIEW_WIDGET_SHIP_MARKER, NULL);
+        return;
+    }
+    lv_obj_clear_flag(shipMarker, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_set_pos(shipMarker, x, y);
+    view_model_count(VIEW_WIDGET_SHIP_MARKER, shipMarker);
 }
 
-// Function to calculate pixel coordinates in a tile
-void get_pixel_coordinates(const double latitude, const double longitude, const int zoom, lv_coord_t *x_pixel, lv_coord_t *y_pixel)
+void update_ship_marker(const double latitude, const double longitude)
 {
-    // Convert latitude and longitude to radians
-    double lat_rad = latitude * M_PI / 180.0;
+    shipLatitude = latitude;
+    shipLongitude = longitude;
+    shipPositionKnown = true;
+    place_ship_marker();
+}
 
-    // Calculate the x and y tile coordinates
-    double n = pow(2.0, zoom);
-    double x_tile = (longitude + 180.0) / 360.0 * n;
-    double y_tile = (1.0 - log(tan(lat_rad) + 1.0 / cos(lat_rad)) / M_PI) / 2.0 * n;
+void set_ship_course(const double course)
+{
+    const lv_img_dsc_t *sprite = boat_sprite_for_course(course);
+    if (shipMarker == NULL || sprite == shipSprite)
+    {
+        view_model_count(VIEW_WIDGET_SHIP_MARKER, NULL);
+        return;
+    }
+    // Only the image source changes, rotation was done once at startup
+    shipSprite = sprite;
+    lv_img_set_src(shipMarker, shipSprite);
+    view_model_count(VIEW_WIDGET_SHIP_MARKER, shipMarker);
+}
 
-    // Calculate the pixel coordinates within the tile
-    *x_pixel = (lv_coord_t)fmod(x_tile * TILE_SIZE, TILE_SIZE);
-    *y_pixel = (lv_coord_t)fmod(y_tile * TILE_SIZE, TILE_SIZE);
+bool get_visible_bounding_box(struct BoundingBox *box)
+{
+    display_lock();
+    bool shown = tilesShown;
+    if (shown)
+    {
+        lv_coord_t left = lv_obj_get_scroll_x(mapView);
+        lv_coord_t top = lv_obj_get_scroll_y(mapView);
+        map_coordinates_to_position(left, top, &box->latMax, &box->lonMin);
+        map_coordinates_to_position(left + LCD_H_RES, top + LCD_V_RES, &box->latMin, &box->lonMax);
+    }
+    display_unlock();
+    return shown;
 }
 
-// Adds a shipmarker to screen
-void add_ship_marker()
+bool map_get_view_center(double *latitude, double *longitude)
 {
-    if (shipMarker == NULL)
+    display_lock();
+    bool shown = tilesShown;
+    if (shown)
     {
-        shipMarker = lv_img_create(lv_scr_act());
-        lv_img_set_src(shipMarker, &smallBoat);
+        map_coordinates_to_position(lv_obj_get_scroll_x(mapView) + VIEW_CENTER_X, lv_obj_get_scroll_y(mapView) + VIEW_CENTER_Y, latitude, longitude);
     }
+    display_unlock();
+    return shown;
+}
 
-    lv_coord_t xCoord = (TILE_SIZE * 1) + shipTileCoordinateX - (smallBoat.header.w / 2); // Column 0
-    lv_coord_t yCoord = (TILE_SIZE * 0) + shipTileCoordinateY - (smallBoat.header.h / 2); // Row 1
+bool map_is_following()
+{
+    display_lock();
+    bool result = following;
+    display_unlock();
+    return result;
+}
 
-    lv_obj_set_pos(shipMarker, xCoord, yCoord);
+int map_take_zoom_steps()
+{
+    display_lock();
+    int steps = pendingZoomSteps;
+    pendingZoomSteps = 0;
+    display_unlock();
+    return steps;
 }
 
-void update_ship_marker(const double latitude, const double longitude, const int zoom)
+// Scrolls view so that given position is in its center (as far as the grid allows)
+static void center_view_on(const double latitude, const double longitude)
 {
-    get_pixel_coordinates(latitude, longitude, zoom, &shipTileCoordinateX, &shipTileCoordinateY);
-    add_ship_marker();
-    lv_obj_invalidate(shipMarker);
+    struct WorldPoint point;
+    int32_t xPixel;
+    int32_t yPixel;
+    position_to_world(latitude, longitude, &point);
+    world_to_pixel(&point, shownZoom, &xPixel, &yPixel);
+    lv_coord_t x = (lv_coord_t)(xPixel - gridX * TILE_SIZE) - VIEW_CENTER_X;
+    lv_coord_t y = (lv_coord_t)(yPixel - gridY * TILE_SIZE) - VIEW_CENTER_Y;
+    x = (x < 0) ? 0 : ((x > SCROLL_MAX_X) ? SCROLL_MAX_X : x);
+    y = (y < 0) ? 0 : ((y > SCROLL_MAX_Y) ? SCROLL_MAX_Y : y);
+
+    shifting = true;
+    lv_obj_scroll_to(mapView, x, y, LV_ANIM_OFF);
+    shifting = false;
 }
 
-// Shows all downloaded tiles on screen
-void show_tiles()
+// Shows the content of a slot (or hides it if there is none)
+static void show_tile(const int slot)
 {
-    // Update all tiles at once
-    int i = 0;
-    for (int row = 0; row < TILES_PER_ROW; row++)
+    img_descs[slot].data = (uint8_t *)image_buffers[slot];
+    if (tileState[slot] == TILE_MISSING)
+    {
+        lv_obj_add_flag(img_widgets[slot], LV_OBJ_FLAG_HIDDEN);
+    }
+    else
+    {
+        lv_obj_clear_flag(img_widgets[slot], LV_OBJ_FLAG_HIDDEN);
+        lv_obj_invalidate(img_widgets[slot]); // Buffer content changed
+    }
+}
+
+#if CONFIG_AIS_TRAFFIC_MODE
+// Returns the geographic area of the whole tile grid
+static void get_map_bounding_box(struct BoundingBox *box)
+{
+    map_coordinates_to_position(0, 0, &box->latMax, &box->lonMin);
+    map_coordinates_to_position(IMAGE_WIDTH, IMAGE_HEIGHT, &box->latMin, &box->lonMax);
+}
+#endif
+
+// Moves grid by whole tiles (e.g. shiftX = -1: one tile to the west). Buffers are passed on, only exposed tiles have to be downloaded
+static void shift_grid(const int shiftX, const int shiftY)
+{
+    lv_color_t *shiftedBuffers[TILES_COUNT] = {NULL};
+    enum TILE_STATE shiftedState[TILES_COUNT];
+    bool bufferTaken[TILES_COUNT] = {false};
+
+    for (int slot = 0; slot < TILES_COUNT; slot++)
     {
-        for (int column = 0; column < TILES_PER_COLUMN; column++)
+        int fromColumn = slot % TILES_PER_COLUMN + shiftX;
+        int fromRow = slot / TILES_PER_COLUMN + shiftY;
+        if (fromColumn >= 0 && fromColumn < TILES_PER_COLUMN && fromRow >= 0 && fromRow < TILES_PER_ROW)
         {
+            int from = fromRow * TILES_PER_COLUMN + fromColumn;
+            shiftedBuffers[slot] = image_buffers[from];
+            shiftedState[slot] = tileState[from];
+            bufferTaken[from] = true;
+        }
+        else
+        {
+            shiftedState[slot] = TILE_MISSING; // Newly exposed
+        }
+    }
 
-            if (img_widgets[i] == NULL) // Initial stuff to create image
+    // Exposed slots get the buffers of tiles which fell off the grid
+    int spare = 0;
+    for (int slot = 0; slot < TILES_COUNT; slot++)
+    {
+        if (shiftedBuffers[slot] == NULL)
+        {
+            while (bufferTaken[spare])
             {
-                // Create an image widget
-                img_widgets[i] = lv_img_create(lv_scr_act());
-
-                // Initialize the image descriptor
-                img_descs[i].header.always_zero = 0;
-                img_descs[i].header.w = TILE_SIZE;
-                img_descs[i].header.h = TILE_SIZE;
-                img_descs[i].header.cf = LV_IMG_CF_TRUE_COLOR;
-                img_descs[i].data_size = TILE_PIXELS * sizeof(lv_color_t);
-                img_descs[i].data = (uint8_t *)image_buffers[i];
-
-                // Set the image source to the widget
-                lv_img_set_src(img_widgets[i], &img_descs[i]);
-
-                // Position the widget on the screen
-                lv_coord_t x = column * TILE_SIZE;
-                lv_coord_t y = row * TILE_SIZE;
-                lv_obj_set_pos(img_widgets[i], x, y);
-
-                // Move to background so that labels, buttons, etc are in front
-                lv_obj_move_background(img_widgets[i]);
+                spare++;
             }
-            else
+            shiftedBuffers[slot] = image_buffers[spare];
+            bufferTaken[spare] = true;
+        }
+    }
+
+    memcpy(image_buffers, shiftedBuffers, sizeof(image_buffers));
+    memcpy(tileState, shiftedState, sizeof(tileState));
+    gridX += shiftX;
+    gridY += shiftY;
+    for (int slot = 0; slot < TILES_COUNT; slot++)
+    {
+        show_tile(slot);
+    }
+
+    // Keep view at the same geographic place
+    lv_coord_t dx = shiftX * TILE_SIZE;
+    lv_coord_t dy = shiftY * TILE_SIZE;
+    shifting = true;
+    lv_obj_scroll_to(mapView, lv_obj_get_scroll_x(mapView) - dx, lv_obj_get_scroll_y(mapView) - dy, LV_ANIM_OFF);
+    shifting = false;
+
+    place_ship_marker();
+#if CONFIG_AIS_TRAFFIC_MODE
+    for (int i = 0; i < MAX_TRAFFIC_MARKERS; i++)
+    {
+        struct TrafficMarker *marker = &trafficMarkers[i];
+        if (marker->mmsi != 0)
+        {
+            marker->x -= dx;
+            marker->y -= dy;
+            lv_obj_set_pos(marker->obj, marker->x, marker->y);
+        }
+    }
+#endif
+    ESP_LOGI(LOG_TAG, "Shifted map by %d/%d tiles", shiftX, shiftY);
+}
+
+// Shifts grid if the view came near its border
+static void shift_grid_if_needed()
+{
+    lv_coord_t x = lv_obj_get_scroll_x(mapView);
+    lv_coord_t y = lv_obj_get_scroll_y(mapView);
+    int shiftX = (x < SHIFT_MARGIN_X) ? -1 : ((x > SCROLL_MAX_X - SHIFT_MARGIN_X) ? 1 : 0);
+    int shiftY = (y < SHIFT_MARGIN_Y) ? -1 : ((y > SCROLL_MAX_Y - SHIFT_MARGIN_Y) ? 1 : 0);
+    if (shiftX != 0 || shiftY != 0)
+    {
+        shift_grid(shiftX, shiftY);
+    }
+}
+
+// Handles panning of the map (LVGL task)
+static void map_event_cb(lv_event_t *e)
+{
+    if (shifting)
+    {
+        return;
+    }
+    switch (lv_event_get_code(e))
+    {
+    case LV_EVENT_SCROLL_BEGIN:
+        snapshot_hide_placeholder(); // Doesn't move with the map
+        following = false; // User looks around, don't jump back to the ship
+        lastInteraction = esp_timer_get_time();
+        break;
+    case LV_EVENT_SCROLL_END: // Also after inertial scrolling stopped
+        lastInteraction = esp_timer_get_time();
+        if (tilesShown)
+        {
+            shift_grid_if_needed();
+        }
+        app_events_post(APP_EVENT_MAP); // Missing tiles and traffic have to be updated
+        break;
+    default:
+        break;
+    }
+}
+
+// Turns a finished pinch gesture into zoom steps (LVGL task)
+static void on_pinch(const float scale)
+{
+    int steps = (int)lroundf(log2f(scale)); // Spreading fingers to double distance zooms in by one level
+    steps = (steps > MAX_PINCH_ZOOM_STEPS) ? MAX_PINCH_ZOOM_STEPS : ((steps < -MAX_PINCH_ZOOM_STEPS) ? -MAX_PINCH_ZOOM_STEPS : steps);
+    lastInteraction = esp_timer_get_time();
+    if (steps != 0)
+    {
+        pendingZoomSteps += steps;
+        app_events_post(APP_EVENT_ZOOM);
+    }
+}
+
+// Lets the map follow the ship again if the user didn't touch it for a while (LVGL timer)
+static void follow_timer_cb(lv_timer_t *)
+{
+    if (!following && (esp_timer_get_time() - lastInteraction > FOLLOW_RESUME_US))
+    {
+        ESP_LOGI(LOG_TAG, "Following ship again");
+        following = true;
+        app_events_post(APP_EVENT_MAP);
+    }
+}
+
+#if CONFIG_AIS_TRAFFIC_MODE
+// Returns whether given MMSI is part of visibleTargets
+static bool is_target_visible(const int mmsi, const size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (visibleTargets[i].mmsi == mmsi)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the marker showing given MMSI (or NULL)
+static struct TrafficMarker *find_traffic_marker(const int mmsi)
+{
+    for (int i = 0; i < MAX_TRAFFIC_MARKERS; i++)
+    {
+        if (trafficMarkers[i].mmsi == mmsi)
+        {
+            return &trafficMarkers[i];
+        }
+    }
+    return NULL;
+}
+
+// Creates the layer for traffic markers directly above the tiles
+static void create_traffic_layer()
+{
+    trafficLayer = lv_obj_create(mapView);
+    lv_obj_remove_style_all(trafficLayer); // Transparent, no border, no padding
+    lv_obj_set_size(trafficLayer, IMAGE_WIDTH, IMAGE_HEIGHT);
+    lv_obj_set_pos(trafficLayer, 0, 0);
+    lv_obj_clear_flag(trafficLayer, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+}
+
+static lv_obj_t *create_traffic_marker_obj()
+{
+    lv_obj_t *obj = lv_obj_create(trafficLayer);
+    lv_obj_set_size(obj, TRAFFIC_MARKER_SIZE, TRAFFIC_MARKER_SIZE);
+    lv_obj_set_style_radius(obj, LV_RADIUS_CIRCLE, 0);
+    lv_obj_set_style_bg_color(obj, lv_color_hex(0xFF8C00), 0); // Dark orange
+    lv_obj_set_style_bg_opa(obj, LV_OPA_COVER, 0);
+    lv_obj_set_style_border_width(obj, 1, 0);
+    lv_obj_set_style_border_color(obj, lv_color_black(), 0);
+    lv_obj_set_style_pad_all(obj, 0, 0);
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    return obj;
+}
+#endif
+
+bool update_traffic_markers()
+{
+#if CONFIG_AIS_TRAFFIC_MODE
+    if (!tilesShown)
+    {
+        return false;
+    }
+
+    // Whole grid, so that markers are already in place when they get panned into view
+    struct BoundingBox area;
+    get_map_bounding_box(&area);
+
+    const int64_t maxAgeUs = (int64_t)CONFIG_AIS_TRAFFIC_MAX_AGE_S * 1000 * 1000;
+    size_t count = ais_targets_collect(&area, maxAgeUs, visibleTargets, MAX_TRAFFIC_MARKERS);
+    int budget = CONFIG_AIS_TRAFFIC_MARKER_UPDATES_PER_FRAME; // Remaining marker changes in this frame
+
+    // Hide markers of vessels which left the grid (or got evicted)
+    for (int i = 0; i < MAX_TRAFFIC_MARKERS && budget > 0; i++)
+    {
+        struct TrafficMarker *marker = &trafficMarkers[i];
+        if (marker->mmsi != 0 && !is_target_visible(marker->mmsi, count))
+        {
+            lv_obj_add_flag(marker->obj, LV_OBJ_FLAG_HIDDEN);
+            marker->mmsi = 0;
+            budget--;
+        }
+    }
+
+    // Move existing markers or show new ones. Whatever exceeds the budget is done in the next frames
+    for (size_t i = 0; i < count && budget > 0; i++)
+    {
+        const struct AIS_TARGET *target = &visibleTargets[i];
+        lv_coord_t x;
+        lv_coord_t y;
+        if (!position_to_map_coordinates(target->latitude, target->longitude, &x, &y))
+        {
+            continue; // On the border of the grid
+        }
+        x -= TRAFFIC_MARKER_SIZE / 2;
+        y -= TRAFFIC_MARKER_SIZE / 2;
+
+        struct TrafficMarker *marker = find_traffic_marker(target->mmsi);
+        if (marker == NULL)
+        {
+            marker = find_traffic_marker(0); // Unused one
+            if (marker == NULL)
             {
-                img_descs[i].data = (uint8_t *)image_buffers[i];
+                continue; // All markers in use (will be freed if their vessels leave the grid)
             }
-
-            if (column == 1 && row == 0)
+            if (marker->obj == NULL)
             {
-                add_ship_marker();
+                marker->obj = create_traffic_marker_obj();
             }
-
-            // Tell screen to updates this on next loading
-            lv_obj_invalidate(img_widgets[i]);
-            i++;
+            marker->mmsi = target->mmsi;
+            lv_obj_clear_flag(marker->obj, LV_OBJ_FLAG_HIDDEN);
         }
+        else if (marker->x == x && marker->y == y)
+        {
+            continue; // Nothing changed
+        }
+
+        marker->x = x;
+        marker->y = y;
+        lv_obj_set_pos(marker->obj, x, y);
+        budget--;
     }
+    return budget == 0;
+#else
+    return false;
+#endif
 }
 
-// Gets called every time a pixel of that PNG-data got converted. Converts each pixel int o a lv_color-object and puts it into convertedImageData-buffer
-void on_draw(pngle_t *, uint32_t, uint32_t, uint32_t, uint32_t, uint8_t rgba[4])
+// Creates the scrollable map with one (hidden) image widget per slot
+static void create_map_view()
 {
-    uint8_t r = rgba[0]; // 0 - 255
-    uint8_t g = rgba[1]; // 0 - 255
-    uint8_t b = rgba[2]; // 0 - 255
+    mapView = lv_obj_create(lv_scr_act());
+    lv_obj_remove_style_all(mapView); // No background, border or padding
+    lv_obj_set_size(mapView, LCD_H_RES, LCD_V_RES);
+    lv_obj_set_pos(mapView, 0, 0);
+    lv_obj_set_scrollbar_mode(mapView, LV_SCROLLBAR_MODE_OFF);
+    lv_obj_clear_flag(mapView, LV_OBJ_FLAG_SCROLL_ELASTIC);
+    lv_obj_add_flag(mapView, LV_OBJ_FLAG_SCROLL_MOMENTUM); // Keeps moving after a swipe
+    lv_obj_move_background(mapView);                       // Labels, buttons, etc are in front
+    snapshot_move_placeholder_to_background();             // Stays visible behind the transparent map view until tiles are loaded
+    lv_obj_add_event_cb(mapView, map_event_cb, LV_EVENT_ALL, NULL);
 
-    image_buffers[tile_index][pixel_index] = lv_color_make(r, g, b); // Convert the RGB values to an lv_color_t and store it in the buffer
-    pixel_index = (pixel_index + 1) % TILE_PIXELS;
+    // Defines the scroll range, as hidden tiles don't count
+    lv_obj_t *gridArea = lv_obj_create(mapView);
+    lv_obj_remove_style_all(gridArea);
+    lv_obj_set_size(gridArea, IMAGE_WIDTH, IMAGE_HEIGHT);
+    lv_obj_clear_flag(gridArea, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+
+    for (int slot = 0; slot < TILES_COUNT; slot++)
+    {
+        img_widgets[slot] = lv_img_create(mapView);
+
+        // Initialize the image descriptor
+        img_descs[slot].header.always_zero = 0;
+        img_descs[slot].header.w = TILE_SIZE;
+        img_descs[slot].header.h = TILE_SIZE;
+        img_descs[slot].header.cf = LV_IMG_CF_TRUE_COLOR;
+        img_descs[slot].data_size = TILE_PIXELS * sizeof(lv_color_t);
+        img_descs[slot].data = (uint8_t *)image_buffers[slot];
+
+        lv_img_set_src(img_widgets[slot], &img_descs[slot]);
+        lv_obj_set_pos(img_widgets[slot], (slot % TILES_PER_COLUMN) * TILE_SIZE, (slot / TILES_PER_COLUMN) * TILE_SIZE);
+        lv_obj_add_flag(img_widgets[slot], LV_OBJ_FLAG_HIDDEN);
+        tileState[slot] = TILE_MISSING;
+    }
+#if CONFIG_AIS_TRAFFIC_MODE
+    create_traffic_layer();
+#endif
+    lv_obj_update_layout(mapView); // Scroll range is known from now on
+
+    lv_timer_create(follow_timer_cb, FOLLOW_CHECK_PERIOD_MS, NULL);
+    display_set_pinch_callback(on_pinch);
 }
 
-// Downloads a tile and puts it into given buffer
-esp_err_t download_tile(const int x_tile, const int y_tile, const int zoom)
+// Records stages of the request in progress
+static esp_err_t http_event_handler(esp_http_client_event_t *event)
+{
+    switch (event->event_id)
+    {
+    case HTTP_EVENT_ON_CONNECTED:
+        tile_trace_stage(TILE_STAGE_CONNECT);
+        break;
+    case HTTP_EVENT_HEADERS_SENT:
+        tile_trace_stage(TILE_STAGE_REQUEST_SENT);
+        break;
+    case HTTP_EVENT_ON_HEADER:
+        tile_trace_stage(TILE_STAGE_FIRST_BYTE);
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
+
+// Downloads a tile into httpData (from the tile proxy: decoded into decodeBuffer). Length is the amount of received bytes
+static esp_err_t download_tile(const int x_tile, const int y_tile, const int zoom, size_t *length)
 {
     if (wifi_get_state() != CONNECTED)
     {
@@ -166,11 +649,17 @@ esp_err_t download_tile(const int x_tile, const int y_tile, const int zoom)
     }
 
     char url[128];
+#if CONFIG_TILE_PROXY
+    snprintf(url, sizeof(url), TILE_URL_TEMPLATE, CONFIG_TILE_PROXY_PORT, zoom, x_tile, y_tile);
+#else
     snprintf(url, sizeof(url), TILE_URL_TEMPLATE, zoom, x_tile, y_tile);
+#endif
 
+    tile_trace_resolve(TILE_HOST);
     esp_http_client_config_t config = {
         .url = url,
-        .timeout_ms = 5000};
+        .timeout_ms = 5000,
+        .event_handler = http_event_handler};
     esp_http_client_handle_t client = esp_http_client_init(&config);
     esp_http_client_set_header(client, "User-Agent", "ESP32-OSM-TileDownloader/1.0");
 
@@ -186,79 +675,460 @@ esp_err_t download_tile(const int x_tile, const int y_tile, const int zoom)
     {
         int statusCode = esp_http_client_get_status_code(client);
         ESP_LOGE(LOG_TAG, "Problem in esp_http_client_fetch_headers (%s): %d. StatusCode: %d", url, headerResult, statusCode);
+        esp_http_client_cleanup(client);
         return ESP_FAIL;
     }
-    int clientReadResult = esp_http_client_read(client, (char *)httpData, headerResult);
+#if CONFIG_TILE_PROXY
+    // Decode straight into decodeBuffer while receiving
+    struct TileRleDecoder decoder;
+    tile_rle_begin(&decoder, (uint16_t *)decodeBuffer, TILE_PIXELS);
+    int clientReadResult = 0;
+    int received = 0;
+    do
+    {
+        clientReadResult = esp_http_client_read(client, (char *)httpData, sizeof(httpData));
+        if (clientReadResult > 0)
+        {
+            received += clientReadResult;
+            if (!tile_rle_feed(&decoder, httpData, (size_t)clientReadResult))
+            {
+                break;
+            }
+        }
+    } while (clientReadResult > 0);
+    if (clientReadResult >= 0 && !tile_rle_finish(&decoder))
+    {
+        ESP_LOGE(LOG_TAG, "Invalid tile from proxy (%d bytes)", received);
+        clientReadResult = -1;
+    }
+    else if (clientReadResult >= 0)
+    {
+        clientReadResult = received;
+    }
+#else
+    int toRead = (headerResult > 0 && headerResult < (int)sizeof(httpData)) ? headerResult : (int)sizeof(httpData);
+    int clientReadResult = esp_http_client_read(client, (char *)httpData, toRead);
+#endif
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
     if (clientReadResult < 0)
     {
         ESP_LOGE(LOG_TAG, "Problem in esp_http_client_read %d", clientReadResult);
         return ESP_FAIL;
     }
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
+    *length = (size_t)clientReadResult;
+    tile_trace_stage(TILE_STAGE_BODY_COMPLETE);
     ESP_LOGI(LOG_TAG, "Download okay of url %s", url);
     return ESP_OK;
 }
 
+// Downloads a tile and decodes it into decodeBuffer. Length is the size of the PNG (or the RLE stream from the tile proxy)
+static esp_err_t fetch_tile(const int x_tile, const int y_tile, const int zoom, size_t *length)
+{
+    if (download_tile(x_tile, y_tile, zoom, length) != ESP_OK)
+    {
+        ESP_LOGE(LOG_TAG, "Problem when download tile %d/%d", x_tile, y_tile);
+        return ESP_FAIL;
+    }
+
+#if CONFIG_TILE_PROXY
+    tile_trace_stage(TILE_STAGE_DECODED); // Already while receiving
+    return ESP_OK;
+#else
+    // Decoded in slices and yielding in between, so that other tasks of the same priority aren't held up for a whole tile
+    // (higher priority ones like WiFi and LVGL preempt anyway). Sleeping a tick per slice would make a tile take several
+    // ticks longer
+    int64_t start = esp_timer_get_time();
+    int slices = 1;
+    power_performance_begin();
+    tile_decode_begin(httpData, *length, (uint16_t *)decodeBuffer);
+    esp_err_t ret;
+    while ((ret = tile_decode_continue(CONFIG_TILE_DECODE_SLICE_US)) == ESP_ERR_NOT_FINISHED)
+    {
+        if (app_events_pending() & APP_EVENT_ZOOM)
+        {
+            // Tile is of no use at the new zoom level
+            tile_decode_abort();
+            ret = ESP_FAIL;
+            break;
+        }
+        taskYIELD();
+        slices++;
+    }
+    power_performance_end();
+    if (ret == ESP_OK)
+    {
+        tile_trace_stage(TILE_STAGE_DECODED);
+        ESP_LOGD(LOG_TAG, "Decoded tile %d/%d in %" PRId64 " us (%d slices)", x_tile, y_tile, esp_timer_get_time() - start, slices);
+    }
+    return ret;
+#endif
+}
+
 esp_err_t setup_tile_downloader()
 {
-    // instantiate PNGLE and set callbacks
-    pngle_handle = pngle_new();
-    pngle_set_draw_callback(pngle_handle, on_draw);
+    void *decoderArena = heap_stats_malloc(HEAP_TAG_TILES, CONFIG_TILE_DECODER_ARENA_SIZE, DECODER_ARENA_CAPS);
+    if (decoderArena == NULL || tile_decoder_init(decoderArena, CONFIG_TILE_DECODER_ARENA_SIZE) != ESP_OK)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to set up tile decoder");
+        return ESP_FAIL;
+    }
+    tile_trace_init();
 
     // instantiate buffers
     for (int i = 0; i < TILES_COUNT; i++)
     {
-        image_buffers[i] = (lv_color_t *)heap_caps_malloc(TILE_PIXELS * sizeof(lv_color_t), MALLOC_CAP_SPIRAM); // Buffer for one tile
+        image_buffers[i] = (lv_color_t *)heap_stats_malloc(HEAP_TAG_TILES, TILE_PIXELS * sizeof(lv_color_t), MALLOC_CAP_SPIRAM); // Buffer for one tile
         if (image_buffers[i] == NULL)
         {
             ESP_LOGE(LOG_TAG, "Failed to allocate memory for tile in PSRAM");
             return ESP_FAIL;
         }
     }
-    return ESP_OK;
+    decodeBuffer = (lv_color_t *)heap_stats_malloc(HEAP_TAG_TILES, TILE_PIXELS * sizeof(lv_color_t), MALLOC_CAP_SPIRAM);
+    if (decodeBuffer == NULL)
+    {
+        ESP_LOGE(LOG_TAG, "Failed to allocate memory for tile in PSRAM");
+        return ESP_FAIL;
+    }
+    void *cacheMemory = heap_stats_malloc(HEAP_TAG_TILES, tile_cache_memory_size(CONFIG_TILE_CACHE_TILES), MALLOC_CAP_SPIRAM);
+    if (cacheMemory == NULL)
+    {
+        ESP_LOGW(LOG_TAG, "Failed to allocate tile cache in PSRAM, running without");
+    }
+    tile_cache_init(cacheMemory, (cacheMemory != NULL) ? CONFIG_TILE_CACHE_TILES : 0);
+
+    display_lock();
+    create_map_view();
+    esp_err_t spriteResult = boat_sprites_init();
+    display_unlock();
+    return spriteResult;
 }
 
-esp_err_t download_and_display_image(const double latitude, const double longitude, const int zoom)
+// Returns the overlapping area of two rectangles (given as x1/y1 inclusive, x2/y2 exclusive)
+static int32_t overlap_area(const lv_coord_t ax1, const lv_coord_t ay1, const lv_coord_t ax2, const lv_coord_t ay2,
+                            const lv_coord_t bx1, const lv_coord_t by1, const lv_coord_t bx2, const lv_coord_t by2)
 {
-    esp_err_t ret = ESP_OK;
-    // Get tile coordinates
-    int baseX;
-    int baseY;
-    position_to_tile_coordinates(latitude, longitude, zoom, &baseX, &baseY);
+    int32_t width = LV_MIN(ax2, bx2) - LV_MAX(ax1, bx1);
+    int32_t height = LV_MIN(ay2, by2) - LV_MAX(ay1, by1);
+    return (width > 0 && height > 0) ? width * height : 0;
+}
+
+// Tiles tried during one pass, keyed by their coordinates as the grid may shift while the display is unlocked
+struct AttemptedTiles
+{
+    int count;
+    struct
+    {
+        int zoom;
+        int x;
+        int y;
+    } tiles[ATTEMPTED_TILES_MAX];
+};
+
+static bool tile_attempted(const struct AttemptedTiles *attempted, const int zoom, const int xTile, const int yTile)
+{
+    for (int i = 0; i < attempted->count; i++)
+    {
+        if (attempted->tiles[i].zoom == zoom && attempted->tiles[i].x == xTile && attempted->tiles[i].y == yTile)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void mark_attempted(struct AttemptedTiles *attempted, const int zoom, const int xTile, const int yTile)
+{
+    attempted->tiles[attempted->count].zoom = zoom;
+    attempted->tiles[attempted->count].x = xTile;
+    attempted->tiles[attempted->count].y = yTile;
+    attempted->count++;
+}
+
+// Chooses the slot to fill next among the ones worse than maxState: the one holding the ship first, then by pixels visible on
+// screen (not covered by sidebar or boat info box), then hidden ones by distance to the view. Returns -1 if there is none or
+// the pass tried enough tiles. Call with display locked
+static int next_slot_to_fetch(const struct AttemptedTiles *attempted, const enum TILE_STATE maxState)
+{
+    if (attempted->count == ATTEMPTED_TILES_MAX)
+    {
+        return -1; // Rest in the next pass
+    }
 
-    // Get coordinates to put ship marker on tile
-    get_pixel_coordinates(latitude, longitude, zoom, &shipTileCoordinateX, &shipTileCoordinateY);
+    const lv_coord_t viewX = lv_obj_get_scroll_x(mapView);
+    const lv_coord_t viewY = lv_obj_get_scroll_y(mapView);
+    lv_coord_t shipX = -1;
+    lv_coord_t shipY = -1;
+    if (!shipPositionKnown || !position_to_map_coordinates(shipLatitude, shipLongitude, &shipX, &shipY))
+    {
+        shipX = -1;
+    }
 
-    // Download and draw tiles
-    for (int row = 0; row < TILES_PER_ROW; row++)
+    int best = -1;
+    int64_t bestPriority = INT64_MIN;
+    for (int slot = 0; slot < TILES_COUNT; slot++)
     {
-        for (int column = 0; column < TILES_PER_COLUMN; column++)
+        int xTile;
+        int yTile;
+        if (tileState[slot] >= maxState || !slot_to_tile(slot, &xTile, &yTile) ||
+            tile_attempted(attempted, shownZoom, xTile, yTile))
         {
-            int xTile = baseX + column - 1; // -1 so that the current position is in the middle
-            int yTile = baseY + row;
+            continue;
+        }
+        const lv_coord_t left = (slot % TILES_PER_COLUMN) * TILE_SIZE;
+        const lv_coord_t top = (slot / TILES_PER_COLUMN) * TILE_SIZE;
 
-            if (download_tile(xTile, yTile, zoom) == ESP_OK)
+        int64_t priority;
+        if (shipX >= left && shipX < left + TILE_SIZE && shipY >= top && shipY < top + TILE_SIZE)
+        {
+            priority = INT64_MAX;
+        }
+        else
+        {
+            priority = overlap_area(left, top, left + TILE_SIZE, top + TILE_SIZE,
+                                    viewX, viewY, viewX + LCD_H_RES - SIDEBAR_WIDTH, viewY + LCD_V_RES) -
+                       overlap_area(left, top, left + TILE_SIZE, top + TILE_SIZE,
+                                    viewX, viewY + LCD_V_RES - INFO_BOX_HEIGHT, viewX + INFO_BOX_WIDTH, viewY + LCD_V_RES);
+            if (priority == 0)
             {
-                int fed = pngle_feed(pngle_handle, httpData, TILE_PIXELS);
-                if (fed < 0)
-                {
-                    ESP_LOGI(LOG_TAG, "PNGLE_Error: %s", pngle_error(pngle_handle));
-                    ret = ESP_FAIL;
-                }
-                pngle_reset(pngle_handle);
+                // Hidden: needed when panning, nearest first
+                int64_t dx = left + TILE_SIZE / 2 - (viewX + VIEW_CENTER_X);
+                int64_t dy = top + TILE_SIZE / 2 - (viewY + VIEW_CENTER_Y);
+                priority = -(dx * dx + dy * dy) - 1;
             }
-            else
+        }
+        if (priority > bestPriority)
+        {
+            bestPriority = priority;
+            best = slot;
+        }
+    }
+    return best;
+}
+
+// Swaps decodeBuffer into the slot which shows the given tile now (the grid may have moved) if it improves it. Returns false if
+// there is none. Call with display locked
+static bool swap_into_slot(const int xTile, const int yTile, const int zoom, const enum TILE_STATE state)
+{
+    for (int i = 0; i < TILES_COUNT && zoom == shownZoom; i++)
+    {
+        int x;
+        int y;
+        if (tileState[i] < state && slot_to_tile(i, &x, &y) && x == xTile && y == yTile)
+        {
+            lv_color_t *buffer = image_buffers[i];
+            image_buffers[i] = decodeBuffer;
+            decodeBuffer = buffer;
+            tileState[i] = state;
+            show_tile(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Builds a tile from cached tiles of the neighbouring zoom levels into decodeBuffer: its 4 children downsampled or a quadrant of
+// its parent upscaled. Returns false if they aren't cached
+static bool synthesize_tile(const int xTile, const int yTile, const int zoom)
+{
+    const uint16_t *children[4];
+    int found = 0;
+    for (; found < 4 && zoom < TILE_MATH_MAX_ZOOM; found++)
+    {
+        children[found] = tile_cache_find(zoom + 1, 2 * xTile + found % 2, 2 * yTile + found / 2);
+        if (children[found] == NULL)
+        {
+            break;
+        }
+    }
+    if (found == 4)
+    {
+        tile_synth_downsample(children, (uint16_t *)decodeBuffer);
+        return true;
+    }
+
+    const uint16_t *parent = (zoom > 0) ? tile_cache_find(zoom - 1, xTile / 2, yTile / 2) : NULL;
+    if (parent != NULL)
+    {
+        tile_synth_upscale(parent, xTile % 2, yTile % 2, (uint16_t *)decodeBuffer);
+        return true;
+    }
+    return false;
+}
+
+// Fills missing slots from the cache (or synthesizes them from cached tiles of other zoom levels), most important first.
+// Needs no network, so the map is complete at once if the area was seen before
+static void fill_missing_tiles_from_cache()
+{
+    static struct AttemptedTiles attempted; // Static to spare the small main task stack
+    attempted.count = 0;
+    while (1)
+    {
+        display_lock();
+        int xTile = 0;
+        int yTile = 0;
+        int zoom = shownZoom;
+        int slot = next_slot_to_fetch(&attempted, TILE_APPROXIMATE);
+        if (slot >= 0)
+        {
+            slot_to_tile(slot, &xTile, &yTile);
+            mark_attempted(&attempted, zoom, xTile, yTile);
+        }
+        display_unlock();
+        if (slot < 0)
+        {
+            break;
+        }
+
+        enum TILE_STATE state = TILE_MISSING;
+        const uint16_t *cached = tile_cache_find(zoom, xTile, yTile);
+        if (cached != NULL)
+        {
+            memcpy(decodeBuffer, cached, TILE_PIXELS * sizeof(lv_color_t));
+            state = TILE_LOADED;
+        }
+        else if (synthesize_tile(xTile, yTile, zoom))
+        {
+            state = TILE_APPROXIMATE;
+        }
+
+        if (state != TILE_MISSING)
+        {
+            display_lock();
+            swap_into_slot(xTile, yTile, zoom, state);
+            display_unlock();
+        }
+    }
+}
+
+esp_err_t download_missing_tiles()
+{
+    fill_missing_tiles_from_cache();
+    if (wifi_get_state() != CONNECTED)
+    {
+        return ESP_FAIL; // Approximations get replaced once connected
+    }
+
+    esp_err_t ret = ESP_OK;
+    static struct AttemptedTiles attempted; // Each tile only once per call, failed ones get retried later (static like above)
+    attempted.count = 0;
+
+    while (1)
+    {
+        // A new zoom level makes the remaining tiles obsolete. Main reloads the map right away
+        if (app_events_pending() & APP_EVENT_ZOOM)
+        {
+            ret = ESP_FAIL;
+            break;
+        }
+
+        // Pick most important tile which isn't loaded yet. Chosen again after every tile, as the view may have been panned meanwhile
+        display_lock();
+        int xTile = 0;
+        int yTile = 0;
+        int zoom = shownZoom;
+        int slot = next_slot_to_fetch(&attempted, TILE_LOADED);
+        if (slot >= 0)
+        {
+            slot_to_tile(slot, &xTile, &yTile);
+            mark_attempted(&attempted, zoom, xTile, yTile);
+        }
+        display_unlock();
+        if (slot < 0)
+        {
+            break;
+        }
+
+        size_t length = 0;
+        tile_trace_begin(zoom, xTile, yTile);
+        if (fetch_tile(xTile, yTile, zoom, &length) != ESP_OK)
+        {
+            tile_trace_end(ESP_FAIL, length);
+            ret = ESP_FAIL;
+            continue;
+        }
+        tile_cache_put(zoom, xTile, yTile, (const uint16_t *)decodeBuffer);
+
+        display_lock();
+        if (swap_into_slot(xTile, yTile, zoom, TILE_LOADED))
+        {
+            tile_trace_stage(TILE_STAGE_SHOWN);
+        }
+        display_unlock();
+        tile_trace_end(ESP_OK, length);
+    }
+    return ret;
+}
+
+bool map_copy_view(uint16_t *frame)
+{
+    if (!tilesShown)
+    {
+        return false;
+    }
+    const lv_coord_t left = lv_obj_get_scroll_x(mapView);
+    const lv_coord_t top = lv_obj_get_scroll_y(mapView);
+    if (left < 0 || top < 0 || left + LCD_H_RES > IMAGE_WIDTH || top + LCD_V_RES > IMAGE_HEIGHT)
+    {
+        return false;
+    }
+    for (int y = 0; y < LCD_V_RES; y++)
+    {
+        const int mapY = top + y;
+        for (int x = 0; x < LCD_H_RES;)
+        {
+            // Rest of the row inside this tile at once
+            const int mapX = left + x;
+            const int slot = (mapY / TILE_SIZE) * TILES_PER_COLUMN + mapX / TILE_SIZE;
+            if (tileState[slot] != TILE_LOADED)
             {
-                ESP_LOGE(LOG_TAG, "Problem when download tile %d/%d at %d/%d", xTile, yTile, column, row);
-                ret = ESP_FAIL;
+                return false;
             }
-
-            tile_index = (tile_index + 1) % TILES_COUNT;
-            lv_timer_handler();
+            int run = TILE_SIZE - mapX % TILE_SIZE;
+            run = (run < LCD_H_RES - x) ? run : LCD_H_RES - x;
+            memcpy(&frame[y * LCD_H_RES + x], &image_buffers[slot][(mapY % TILE_SIZE) * TILE_SIZE + mapX % TILE_SIZE], run * sizeof(uint16_t));
+            x += run;
         }
     }
+    return true;
+}
+
+// Returns the first tile of the grid along one axis, chosen so that the view centered on pixel (world pixel coordinate at the
+// shown zoom) scrolls to the middle of the range which doesn't shift the grid (+- half a tile)
+static int grid_origin(const int32_t pixel, const int viewCenter, const int scrollMax)
+{
+    const int32_t origin = pixel - viewCenter - scrollMax / 2 + TILE_SIZE / 2; // Left/top edge of the grid for that scroll
+    return (origin >= 0) ? origin / TILE_SIZE : -((TILE_SIZE - 1 - origin) / TILE_SIZE);
+}
+
+esp_err_t download_and_display_image(const double latitude, const double longitude, const int zoom)
+{
+    struct WorldPoint point;
+    int32_t xPixel;
+    int32_t yPixel;
+    position_to_world(latitude, longitude, &point);
+    world_to_pixel(&point, zoom, &xPixel, &yPixel);
+
+    // Grid reaches around the view, which starts centered on the position without being near a border of the grid
+    display_lock();
+    gridX = grid_origin(xPixel, VIEW_CENTER_X, SCROLL_MAX_X);
+    gridY = grid_origin(yPixel, VIEW_CENTER_Y, SCROLL_MAX_Y);
+    shownZoom = zoom;
+    for (int slot = 0; slot < TILES_COUNT; slot++)
+    {
+        tileState[slot] = TILE_MISSING;
+        show_tile(slot);
+    }
+    center_view_on(latitude, longitude);
+    tilesShown = true;
+    place_ship_marker();
+    display_unlock();
 
-    show_tiles();
+    // Downloading runs without lock, so that LVGL keeps rendering (e.g. the spinner)
+    esp_err_t ret = download_missing_tiles();
+    display_lock();
+    snapshot_hide_placeholder(); // Map shows real tiles now
+    display_unlock();
     return ret;
 }
@@ -4,16 +4,42 @@
 #include "esp_lcd_types.h"
 #include "esp_err.h"
 
+#include "global.h"
+#include "tile_math.h"
+
 // Sets up downloader and png-converter
 esp_err_t setup_tile_downloader();
 
-// Checks if a new tile download has to be started
-bool new_tiles_for_position_needed(const double oldLatitude, const double oldLongitude, const int oldZoom, const double latitude, const double longitude, const int zoom);
-
-// Downloads tiles and displays them
+// Replaces the map by tiles around given position and centers the view on it. Locks the display only for showing them, so don't call it while holding the lock
 esp_err_t download_and_display_image(const double latitude, const double longitude, const int zoom);
 
-// Manually call this to update the ship marker of the middle tile (usually needed if position changed but no new tiles are needed [e.g. new_tiles_for_position_needed returns false])
-void update_ship_marker(const double latitude, const double longitude, const int zoom);
+// Fills tiles which got exposed by panning (or failed before) from the cache, else downloads them. Without WiFi it shows tiles
+// built from cached ones of the neighbouring zoom levels and returns ESP_FAIL. Don't call it while holding the lock
+esp_err_t download_missing_tiles();
+
+// Moves the ship marker to given position (hidden while it is outside of the tile grid). Call with display locked
+void update_ship_marker(const double latitude, const double longitude);
+
+// Turns the ship marker to given course (degrees, negative if unknown). Call with display locked
+void set_ship_course(const double course);
+
+// Returns the geographic area currently visible on screen. Returns false if no tiles are shown yet
+bool get_visible_bounding_box(struct BoundingBox *box);
+
+// Returns the position in the center of the view (left of the sidebar). Returns false if no tiles are shown yet
+bool map_get_view_center(double *latitude, double *longitude);
+
+// Whether the map follows the ship. Turns false when the user pans the map and true again after a while without touching it
+bool map_is_following();
+
+// Returns (and clears) the zoom levels requested by pinch gestures (positive: zoom in)
+int map_take_zoom_steps();
+
+// Copies the tiles of the visible area (LCD_H_RES x LCD_V_RES, without markers) into frame. Returns false if not all of them
+// are loaded. Call with display locked
+bool map_copy_view(uint16_t *frame);
+
+// Updates markers of surrounding traffic with display locked (limited amount of changes per call). Returns true if changes are left for the next frame
+bool update_traffic_markers();
 
 #endif
@@ -0,0 +1,130 @@
+#include "tile_math.h"
+
+#include <math.h>
+
+// Projection kernel: Mercator y of latitude is looked up in a table with value and slope every 2^19 * 1e-7 degrees (~5.8 km)
+// and interpolated cubically (Hermite) in between. Max error is below 1/20 pixel at zoom 19 (see host/bench/bench_tile_math.c).
+// The step is a power of two in 1e-7 degrees, so that index and interpolation parameter are plain bit fields
+#define LATITUDE_STEP_SHIFT 19
+#define LATITUDE_STEP_MASK ((1 << LATITUDE_STEP_SHIFT) - 1)
+#define INTERPOLATION_FRACTION_BITS 8 // Keeps rounding errors of the interpolation below one world unit
+#define MAX_LATITUDE_E7 850511288 // Web Mercator is cut off here (square world)
+#define LATITUDE_TABLE_SIZE ((MAX_LATITUDE_E7 >> LATITUDE_STEP_SHIFT) + 2)
+
+#define HALF_WORLD (1u << 31)
+#define LONGITUDE_SHIFT 30
+#define LONGITUDE_FACTOR 1281023894 // round(2^(32 + LONGITUDE_SHIFT) / 3600000000): 1e-7 degrees -> world units
+
+struct LatitudeSample
+{
+    uint32_t value; // Distance from equator in world units
+    int32_t slope;  // Derivative of value, multiplied by step
+};
+
+// Only northern hemisphere, Mercator is symmetric
+static struct LatitudeSample latitudeTable[LATITUDE_TABLE_SIZE];
+
+void tile_math_init()
+{
+    const double unitsPerRadian = 4294967296.0 / (2 * M_PI);
+    const double stepRadians = (1 << LATITUDE_STEP_SHIFT) * 1e-7 * M_PI / 180.0;
+    for (int i = 0; i < LATITUDE_TABLE_SIZE; i++)
+    {
+        double lat_rad = i * stepRadians;
+        latitudeTable[i].value = (uint32_t)(log(tan(lat_rad) + 1.0 / cos(lat_rad)) * unitsPerRadian + 0.5);
+        latitudeTable[i].slope = (int32_t)(stepRadians / cos(lat_rad) * unitsPerRadian + 0.5);
+    }
+}
+
+void position_e7_to_world(const int32_t latitudeE7, const int32_t longitudeE7, struct WorldPoint *point)
+{
+    point->x = (uint32_t)(((uint64_t)((uint32_t)longitudeE7 + 1800000000u) * LONGITUDE_FACTOR) >> LONGITUDE_SHIFT); // 180° wraps to 0
+
+    uint32_t latitude = (latitudeE7 < 0) ? -(uint32_t)latitudeE7 : (uint32_t)latitudeE7;
+    if (latitude > MAX_LATITUDE_E7)
+    {
+        latitude = MAX_LATITUDE_E7;
+    }
+    const struct LatitudeSample *sample = &latitudeTable[latitude >> LATITUDE_STEP_SHIFT];
+    const int64_t t = latitude & LATITUDE_STEP_MASK; // Position between samples (fraction of step)
+
+    // Hermite polynomial y0 + m0 * t + c2 * t^2 + c3 * t^3, evaluated in Horner form with INTERPOLATION_FRACTION_BITS more precision
+    const int64_t y0 = (int64_t)sample[0].value << INTERPOLATION_FRACTION_BITS;
+    const int64_t difference = ((int64_t)sample[1].value << INTERPOLATION_FRACTION_BITS) - y0;
+    const int64_t m0 = (int64_t)sample[0].slope << INTERPOLATION_FRACTION_BITS;
+    const int64_t m1 = (int64_t)sample[1].slope << INTERPOLATION_FRACTION_BITS;
+    int64_t value = m0 + m1 - 2 * difference;
+    value = 3 * difference - 2 * m0 - m1 + ((value * t) >> LATITUDE_STEP_SHIFT);
+    value = m0 + ((value * t) >> LATITUDE_STEP_SHIFT);
+    value = (y0 + ((value * t) >> LATITUDE_STEP_SHIFT) + (1 << (INTERPOLATION_FRACTION_BITS - 1))) >> INTERPOLATION_FRACTION_BITS;
+    if (value > HALF_WORLD)
+    {
+        value = HALF_WORLD;
+    }
+
+    // North is up
+    if (latitudeE7 >= 0)
+    {
+        point->y = HALF_WORLD - (uint32_t)value;
+    }
+    else
+    {
+        point->y = (value == HALF_WORLD) ? UINT32_MAX : HALF_WORLD + (uint32_t)value;
+    }
+}
+
+void position_to_world(const double latitude, const double longitude, struct WorldPoint *point)
+{
+    position_e7_to_world(DEGREES_TO_E7(latitude), DEGREES_TO_E7(longitude), point);
+}
+
+void world_to_pixel(const struct WorldPoint *point, const int zoom, int32_t *x, int32_t *y)
+{
+    const int shift = 32 - 8 - zoom; // Tiles have 2^8 pixels
+    *x = (int32_t)(point->x >> shift);
+    *y = (int32_t)(point->y >> shift);
+}
+
+void position_to_tile_coordinates(const double latitude, const double longitude, const int zoom, int *x_tile, int *y_tile)
+{
+    struct WorldPoint point;
+    position_to_world(latitude, longitude, &point);
+    *x_tile = (int)((uint64_t)point.x >> (32 - zoom));
+    *y_tile = (int)((uint64_t)point.y >> (32 - zoom));
+}
+
+void position_to_tile_fraction(const double latitude, const double longitude, const int zoom, double *x_tile, double *y_tile)
+{
+    // Convert latitude and longitude to radians
+    double lat_rad = latitude * M_PI / 180.0;
+
+    // Calculate the x and y tile coordinates
+    double n = pow(2.0, zoom);
+    *x_tile = (longitude + 180.0) / 360.0 * n;
+    *y_tile = (1.0 - log(tan(lat_rad) + 1.0 / cos(lat_rad)) / M_PI) / 2.0 * n;
+}
+
+double tile_to_latitude(const double y_tile, const int zoom)
+{
+    double n = pow(2.0, zoom);
+    return atan(sinh(M_PI * (1.0 - 2.0 * y_tile / n))) * 180.0 / M_PI;
+}
+
+double tile_to_longitude(const double x_tile, const int zoom)
+{
+    double n = pow(2.0, zoom);
+    return x_tile / n * 360.0 - 180.0;
+}
+
+bool new_tiles_for_position_needed(const double oldLatitude, const double oldLongitude, const int oldZoom, const double latitude, const double longitude, const int zoom)
+{
+    int oldX;
+    int oldY;
+    position_to_tile_coordinates(oldLatitude, oldLongitude, oldZoom, &oldX, &oldY);
+
+    int newX;
+    int newY;
+    position_to_tile_coordinates(latitude, longitude, zoom, &newX, &newY);
+
+    return (oldX != newX) || (oldY != newY);
+}
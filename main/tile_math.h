@@ -0,0 +1,48 @@
+#ifndef TILE_MATH_H_
+#define TILE_MATH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Conversions between positions and OpenStreetMap tile coordinates (Web Mercator). No dependencies, also built on host (see host/)
+
+#define TILE_MATH_MAX_ZOOM 22 // Highest zoom level pixel coordinates fit into int32 (world coordinates resolve 1/32 pixel at zoom 19)
+
+// Position in 1e-7 degrees (resolution ~1 cm)
+#define DEGREES_TO_E7(degrees) ((int32_t)((degrees) * 1e7 + (((degrees) < 0) ? -0.5 : 0.5)))
+
+// Web Mercator world coordinates: 2^32 units span the whole world, origin is the north west corner (like tiles)
+struct WorldPoint
+{
+    uint32_t x;
+    uint32_t y;
+};
+
+// Fills the latitude lookup table of the projection kernel. Call once before using any other function
+void tile_math_init();
+
+// Projects a position (1e-7 degrees) to world coordinates. Only integer math (table lookup and cubic interpolation for latitude)
+void position_e7_to_world(const int32_t latitudeE7, const int32_t longitudeE7, struct WorldPoint *point);
+
+// Projects a position to world coordinates
+void position_to_world(const double latitude, const double longitude, struct WorldPoint *point);
+
+// Converts world coordinates to pixel coordinates of the whole world at given zoom level (pixel containing the point)
+void world_to_pixel(const struct WorldPoint *point, const int zoom, int32_t *x, int32_t *y);
+
+// Converts Position to tile coordinates
+void position_to_tile_coordinates(const double latitude, const double longitude, const int zoom, int *x_tile, int *y_tile);
+
+// Converts Position to fractional tile coordinates (fraction is the position inside the tile). Exact double precision reference of the kernel
+void position_to_tile_fraction(const double latitude, const double longitude, const int zoom, double *x_tile, double *y_tile);
+
+// Converts (fractional) tile y-coordinate to latitude
+double tile_to_latitude(const double y_tile, const int zoom);
+
+// Converts (fractional) tile x-coordinate to longitude
+double tile_to_longitude(const double x_tile, const int zoom);
+
+// Checks if a new tile download has to be started
+bool new_tiles_for_position_needed(const double oldLatitude, const double oldLongitude, const int oldZoom, const double latitude, const double longitude, const int zoom);
+
+#endif // TILE_MATH_H_
@@ -0,0 +1,134 @@
+#include "tile_rle.h"
+
+#include <string.h>
+
+void tile_rle_begin(struct TileRleDecoder *decoder, uint16_t *pixels, const size_t pixelCount)
+{
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->output = (uint8_t *)pixels;
+    decoder->capacity = pixelCount * sizeof(uint16_t);
+}
+
+// Writes a pixel count times
+static bool fill(struct TileRleDecoder *decoder, const uint16_t pixel, const uint32_t count)
+{
+    if (decoder->position + count * sizeof(uint16_t) > decoder->capacity)
+    {
+        return false;
+    }
+    uint16_t *out = (uint16_t *)(decoder->output + decoder->position);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        out[i] = pixel;
+    }
+    decoder->position += count * sizeof(uint16_t);
+    return true;
+}
+
+bool tile_rle_feed(struct TileRleDecoder *decoder, const uint8_t *data, const size_t length)
+{
+    size_t index = 0;
+    while (index < length && decoder->magicRead < TILE_RLE_MAGIC_LENGTH)
+    {
+        if (data[index++] != (uint8_t)TILE_RLE_MAGIC[decoder->magicRead++])
+        {
+            decoder->failed = true;
+        }
+    }
+
+    while (index < length && !decoder->failed)
+    {
+        if (decoder->pending == 0)
+        {
+            // Control byte
+            const uint8_t control = data[index++];
+            if (control & 0x80)
+            {
+                decoder->repeat = (control & 0x7F) + 1u;
+                decoder->pending = sizeof(uint16_t);
+            }
+            else
+            {
+                decoder->repeat = 0;
+                decoder->pending = (control + 1u) * sizeof(uint16_t);
+                decoder->failed = decoder->position + decoder->pending > decoder->capacity;
+            }
+        }
+        else if (decoder->repeat == 0)
+        {
+            // Literal pixels are copied as they are, even if a chunk ends in the middle of a pixel
+            size_t count = length - index;
+            count = (count < decoder->pending) ? count : decoder->pending;
+            memcpy(decoder->output + decoder->position, &data[index], count);
+            decoder->position += count;
+            decoder->pending -= count;
+            index += count;
+        }
+        else if (decoder->pending == 2 && index + 1 < length)
+        {
+            decoder->failed = !fill(decoder, (uint16_t)(data[index] | (data[index + 1] << 8)), decoder->repeat);
+            decoder->pending = 0;
+            index += 2;
+        }
+        else if (decoder->pending == 2)
+        {
+            // Pixel split between two chunks
+            decoder->firstByte = data[index++];
+            decoder->pending = 1;
+        }
+        else
+        {
+            decoder->failed = !fill(decoder, (uint16_t)(decoder->firstByte | (data[index] << 8)), decoder->repeat);
+            decoder->pending = 0;
+            index++;
+        }
+    }
+    return !decoder->failed;
+}
+
+bool tile_rle_finish(const struct TileRleDecoder *decoder)
+{
+    return !decoder->failed && decoder->position == decoder->capacity && decoder->pending == 0;
+}
+
+size_t tile_rle_encode(const uint16_t *pixels, const size_t count, uint8_t *out)
+{
+    size_t length = 0;
+    size_t literalStart = 0;
+    size_t literals = 0; // Pending literal pixels starting at literalStart
+    size_t index = 0;
+    while (index < count)
+    {
+        size_t run = 1;
+        while (index + run < count && run < TILE_RLE_MAX_PACKET && pixels[index + run] == pixels[index])
+        {
+            run++;
+        }
+        if (run == 1)
+        {
+            literalStart = (literals == 0) ? index : literalStart;
+            literals++;
+            index++;
+            if (literals < TILE_RLE_MAX_PACKET && index < count)
+            {
+                continue;
+            }
+        }
+
+        if (literals > 0)
+        {
+            out[length++] = (uint8_t)(literals - 1);
+            memcpy(&out[length], &pixels[literalStart], literals * sizeof(uint16_t));
+            length += literals * sizeof(uint16_t);
+            literals = 0;
+        }
+        if (run > 1)
+        {
+            out[length++] = (uint8_t)(0x80 | (run - 1));
+            out[length++] = (uint8_t)(pixels[index] & 0xFF);
+            out[length++] = (uint8_t)(pixels[index] >> 8);
+            index += run;
+        }
+    }
+    return length;
+}
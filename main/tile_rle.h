@@ -0,0 +1,46 @@
+#ifndef TILE_RLE_H_
+#define TILE_RLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Run length encoded RGB565 pixels (same layout as lv_color_t with 16 bit colors) of tiles served by tools/tile_proxy.py and
+// of the boot snapshot. Decodes while the data is received, so it doesn't need to be buffered. No dependencies, also built on
+// host (see host/)
+//
+// Format: TILE_RLE_MAGIC, then packets until all pixels are complete. A packet starts with a control byte c:
+//   c < 0x80:  c + 1 literal pixels follow (2 bytes each, little endian)
+//   c >= 0x80: one pixel follows which repeats (c & 0x7F) + 1 times
+
+#define TILE_RLE_MAGIC "R565"
+#define TILE_RLE_MAGIC_LENGTH 4
+#define TILE_RLE_MAX_PACKET 128 // Pixels of one packet
+#define TILE_RLE_MAX_ENCODED(pixels) ((pixels) * 2 + ((pixels) + TILE_RLE_MAX_PACKET - 1) / TILE_RLE_MAX_PACKET) // Worst case of tile_rle_encode
+
+struct TileRleDecoder
+{
+    uint8_t *output;     // Start of pixels
+    size_t capacity;     // Bytes of output expected
+    size_t position;     // Bytes of output written
+    size_t magicRead;    // Bytes of magic received
+    uint32_t pending;    // Bytes left of literal packet or 2 while waiting for the pixel of a repeat packet (0: control byte next)
+    uint32_t repeat;     // Pixels of the current repeat packet (0 if literal)
+    uint8_t firstByte;   // First byte of a repeated pixel split between two chunks
+    bool failed;         // Stream is no valid tile
+};
+
+// Starts decoding given amount of pixels (TILE_PIXELS for a tile)
+void tile_rle_begin(struct TileRleDecoder *decoder, uint16_t *pixels, const size_t pixelCount);
+
+// Decodes next part of the stream. Returns false if it is invalid (wrong magic or too many pixels)
+bool tile_rle_feed(struct TileRleDecoder *decoder, const uint8_t *data, const size_t length);
+
+// Returns true if the stream was valid and all pixels are complete
+bool tile_rle_finish(const struct TileRleDecoder *decoder);
+
+// Encodes pixels into packets (without magic, so several calls can be concatenated). Returns bytes written to out, at most
+// TILE_RLE_MAX_ENCODED(count)
+size_t tile_rle_encode(const uint16_t *pixels, const size_t count, uint8_t *out);
+
+#endif // TILE_RLE_H_
@@ -0,0 +1,55 @@
+#include "tile_synth.h"
+
+#include "tile_decoder.h"
+
+// Averages 2x2 blocks of a child into one quadrant of tile, every channel on its own and rounded
+static void downsample_quadrant(const uint16_t *child, uint16_t *tile)
+{
+    for (int y = 0; y < TILE_SIZE / 2; y++)
+    {
+        const uint16_t *upper = &child[(2 * y) * TILE_SIZE];
+        const uint16_t *lower = &child[(2 * y + 1) * TILE_SIZE];
+        uint16_t *out = &tile[y * TILE_SIZE];
+        for (int x = 0; x < TILE_SIZE / 2; x++)
+        {
+            const uint16_t pixels[4] = {upper[2 * x], upper[2 * x + 1], lower[2 * x], lower[2 * x + 1]};
+            uint32_t r = 2;
+            uint32_t g = 2;
+            uint32_t b = 2;
+            for (int i = 0; i < 4; i++)
+            {
+                r += pixels[i] >> 11;
+                g += (pixels[i] >> 5) & 0x3F;
+                b += pixels[i] & 0x1F;
+            }
+            out[x] = (uint16_t)(((r >> 2) << 11) | ((g >> 2) << 5) | (b >> 2));
+        }
+    }
+}
+
+void tile_synth_downsample(const uint16_t *const children[4], uint16_t *tile)
+{
+    const int half = TILE_SIZE / 2;
+    downsample_quadrant(children[0], tile);
+    downsample_quadrant(children[1], tile + half);
+    downsample_quadrant(children[2], tile + half * TILE_SIZE);
+    downsample_quadrant(children[3], tile + half * TILE_SIZE + half);
+}
+
+void tile_synth_upscale(const uint16_t *parent, const int quadrantX, const int quadrantY, uint16_t *tile)
+{
+    const uint16_t *source = parent + quadrantY * (TILE_SIZE / 2) * TILE_SIZE + quadrantX * (TILE_SIZE / 2);
+    for (int y = 0; y < TILE_SIZE / 2; y++)
+    {
+        // Every source pixel becomes two in one 32 bit write, the row gets written twice
+        const uint16_t *in = &source[y * TILE_SIZE];
+        uint32_t *upper = (uint32_t *)&tile[(2 * y) * TILE_SIZE];
+        uint32_t *lower = (uint32_t *)&tile[(2 * y + 1) * TILE_SIZE];
+        for (int x = 0; x < TILE_SIZE / 2; x++)
+        {
+            const uint32_t doubled = in[x] * 0x00010001u;
+            upper[x] = doubled;
+            lower[x] = doubled;
+        }
+    }
+}
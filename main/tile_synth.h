@@ -0,0 +1,14 @@
+#ifndef TILE_SYNTH_H_
+#define TILE_SYNTH_H_
+
+#include <stdint.h>
+
+// Builds tiles of other zoom levels from RGB565 tiles (TILE_SIZE x TILE_SIZE). No dependencies, also built on host (see host/)
+
+// Builds a tile from its 4 children of the next zoom level (north west, north east, south west, south east) by averaging 2x2 pixels
+void tile_synth_downsample(const uint16_t *const children[4], uint16_t *tile);
+
+// Builds an approximation of a tile of the next zoom level by doubling the pixels of a quadrant (0 or 1 in each direction) of its parent
+void tile_synth_upscale(const uint16_t *parent, const int quadrantX, const int quadrantY, uint16_t *tile);
+
+#endif // TILE_SYNTH_H_
@@ -0,0 +1,208 @@
+#include "tile_trace.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/netdb.h"
+
+#include "console.h"
+#include "histogram.h"
+
+// Binary trace format (see tools/tile_trace_timeline.py): every record is printed as one line
+// "TILETRACE<TAB>version<TAB>hex of struct TileTraceRecord (little endian)"
+#define TRACE_MARKER "TILETRACE"
+#define TRACE_VERSION 1
+#define TRACE_RECORDS 64 // Latest requests kept for "tiletrace dump"
+
+#if CONFIG_APP_TILE_TRACE
+static const char *LOG_TAG = "tile_trace";
+
+static const char *STAGE_NAMES[TILE_STAGE_COUNT] = {"dns", "connect", "request", "first byte", "body", "decode", "shown"};
+
+struct TileTraceRecord
+{
+    int64_t startUs;                    // Timepoint request started (since boot)
+    uint32_t x;                         // Tile coordinates
+    uint32_t y;
+    uint32_t bytes;                     // Size of received PNG
+    uint8_t zoom;
+    uint8_t failed;                     // Request or decoding failed
+    uint16_t reserved;
+    uint32_t stageUs[TILE_STAGE_COUNT]; // Time from start until stage was reached (0 if it wasn't)
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct TileTraceRecord) == 56, "Record layout is read by tools/tile_trace_timeline.py");
+
+static struct Histogram stageTime[TILE_STAGE_COUNT]; // Time (us) from previous reached stage to this one
+static struct Histogram totalTime;                   // Time (us) from start to last reached stage
+
+// Request in progress (only accessed by the task downloading tiles)
+static struct TileTraceRecord current;
+static bool tracing = false;
+
+static struct TileTraceRecord records[TRACE_RECORDS]; // Ring buffer of finished requests
+static uint32_t recordCount = 0;                      // Records written since reset (index of next one modulo TRACE_RECORDS)
+static portMUX_TYPE recordsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Prints p50/p90/p99/max of a histogram
+static void print_histogram(const char *name, const struct Histogram *histogram)
+{
+    printf("%-11s %6" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n", name, (uint32_t)histogram->count,
+           histogram_percentile(histogram, 50), histogram_percentile(histogram, 90), histogram_percentile(histogram, 99), (uint32_t)histogram->max);
+}
+
+// Prints the records of the ring buffer, oldest first
+static void dump_records()
+{
+    taskENTER_CRITICAL(&recordsLock);
+    uint32_t end = recordCount;
+    taskEXIT_CRITICAL(&recordsLock);
+    uint32_t start = (end > TRACE_RECORDS) ? end - TRACE_RECORDS : 0;
+
+    for (uint32_t i = start; i < end; i++)
+    {
+        struct TileTraceRecord record;
+        taskENTER_CRITICAL(&recordsLock);
+        record = records[i % TRACE_RECORDS];
+        taskEXIT_CRITICAL(&recordsLock);
+
+        char hex[sizeof(record) * 2 + 1];
+        const uint8_t *bytes = (const uint8_t *)&record;
+        for (size_t j = 0; j < sizeof(record); j++)
+        {
+            snprintf(&hex[j * 2], 3, "%02x", bytes[j]);
+        }
+        printf(TRACE_MARKER "\t%d\t%s\n", TRACE_VERSION, hex);
+    }
+}
+
+static void reset()
+{
+    for (int stage = 0; stage < TILE_STAGE_COUNT; stage++)
+    {
+        histogram_reset(&stageTime[stage]);
+    }
+    histogram_reset(&totalTime);
+    taskENTER_CRITICAL(&recordsLock);
+    recordCount = 0;
+    taskEXIT_CRITICAL(&recordsLock);
+}
+
+// Console command: tiletrace [dump | reset]
+static int tiletrace_command(int argc, char **argv)
+{
+    if (argc == 1)
+    {
+        printf("%-11s %6s %8s %8s %8s %8s (us, time since previous stage)\n", "stage", "count", "p50", "p90", "p99", "max");
+        for (int stage = 0; stage < TILE_STAGE_COUNT; stage++)
+        {
+            print_histogram(STAGE_NAMES[stage], &stageTime[stage]);
+        }
+        print_histogram("total", &totalTime);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "dump") == 0)
+    {
+        dump_records();
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "reset") == 0)
+    {
+        reset();
+        return 0;
+    }
+    printf("Usage: tiletrace [dump | reset]\n");
+    return 1;
+}
+#endif
+
+esp_err_t tile_trace_init()
+{
+#if CONFIG_APP_TILE_TRACE
+    return console_register("tiletrace", "Tile pipeline latencies: tiletrace [dump | reset]. Feed dump to tools/tile_trace_timeline.py", tiletrace_command);
+#else
+    return ESP_OK;
+#endif
+}
+
+void tile_trace_begin(const int zoom, const int x_tile, const int y_tile)
+{
+#if CONFIG_APP_TILE_TRACE
+    memset(&current, 0, sizeof(current));
+    current.startUs = esp_timer_get_time();
+    current.zoom = (uint8_t)zoom;
+    current.x = (uint32_t)x_tile;
+    current.y = (uint32_t)y_tile;
+    tracing = true;
+#endif
+}
+
+void tile_trace_resolve(const char *host)
+{
+#if CONFIG_APP_TILE_TRACE
+    if (!tracing)
+    {
+        return;
+    }
+    const struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(host, NULL, &hints, &result) == 0)
+    {
+        tile_trace_stage(TILE_STAGE_DNS);
+        freeaddrinfo(result);
+    }
+    else
+    {
+        ESP_LOGW(LOG_TAG, "Resolving %s failed", host);
+    }
+#endif
+}
+
+void tile_trace_stage(const enum TILE_STAGE stage)
+{
+#if CONFIG_APP_TILE_TRACE
+    if (tracing && current.stageUs[stage] == 0)
+    {
+        int64_t elapsed = esp_timer_get_time() - current.startUs;
+        current.stageUs[stage] = (elapsed > 0) ? (uint32_t)elapsed : 1; // 0 means not reached
+    }
+#endif
+}
+
+void tile_trace_end(const esp_err_t result, const size_t bytes)
+{
+#if CONFIG_APP_TILE_TRACE
+    if (!tracing)
+    {
+        return;
+    }
+    tracing = false;
+    current.failed = (result != ESP_OK);
+    current.bytes = (uint32_t)bytes;
+
+    uint32_t previous = 0;
+    for (int stage = 0; stage < TILE_STAGE_COUNT; stage++)
+    {
+        if (current.stageUs[stage] != 0)
+        {
+            histogram_record(&stageTime[stage], current.stageUs[stage] - previous);
+            previous = current.stageUs[stage];
+        }
+    }
+    if (!current.failed)
+    {
+        histogram_record(&totalTime, previous);
+    }
+
+    taskENTER_CRITICAL(&recordsLock);
+    records[recordCount % TRACE_RECORDS] = current;
+    recordCount++;
+    taskEXIT_CRITICAL(&recordsLock);
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef TILE_TRACE_H_
+#define TILE_TRACE_H_
+
+#include <stddef.h>
+#include "esp_err.h"
+
+// Latency tracing of the tile pipeline (only records with CONFIG_APP_TILE_TRACE, otherwise all functions do nothing)
+
+// Stages of a tile request in the order they are passed
+enum TILE_STAGE
+{
+    TILE_STAGE_DNS,           // Host name resolved
+    TILE_STAGE_CONNECT,       // TCP connection established
+    TILE_STAGE_REQUEST_SENT,  // HTTP request sent
+    TILE_STAGE_FIRST_BYTE,    // First response header received
+    TILE_STAGE_BODY_COMPLETE, // Whole PNG received
+    TILE_STAGE_DECODED,       // PNG inflated and converted to RGB565 (pngle does both in one pass)
+    TILE_STAGE_SHOWN,         // Tile swapped into its slot and invalidated
+    TILE_STAGE_COUNT
+};
+
+// Sets up the "tiletrace" console command
+esp_err_t tile_trace_init();
+
+// Starts tracing a tile request. Only one request is traced at a time (tiles are fetched one after another)
+void tile_trace_begin(const int zoom, const int x_tile, const int y_tile);
+
+// Resolves host (timed as TILE_STAGE_DNS). lwIP caches the result, so the HTTP client doesn't ask the DNS server again
+void tile_trace_resolve(const char *host);
+
+// Records the time a stage was reached. Only the first call per stage and request counts
+void tile_trace_stage(const enum TILE_STAGE stage);
+
+// Finishes the request: adds stage durations to the histograms and the record to the trace buffer
+void tile_trace_end(const esp_err_t result, const size_t bytes);
+
+#endif // TILE_TRACE_H_
@@ -0,0 +1,217 @@
+#include "tls_resume.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+
+#define TLS_DEFAULT_PORT 443
+
+static const char *LOG_TAG = "TlsResume";
+
+struct TlsResumeContext
+{
+    esp_tls_t *tls;                    // Current connection (NULL if closed)
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    esp_tls_client_session_t *session; // Session of the last successful handshake (NULL before the first one)
+#endif
+};
+
+// Waits until the socket is readable (forRead) or writable. Returns 1 if it is, 0 on timeout and -1 on error
+static int poll_socket(struct TlsResumeContext *context, const bool forRead, const int timeout_ms)
+{
+    int fd = -1;
+    if (context->tls == NULL || esp_tls_get_conn_sockfd(context->tls, &fd) != ESP_OK || fd < 0)
+    {
+        return -1;
+    }
+
+    fd_set readySet;
+    fd_set errorSet;
+    FD_ZERO(&readySet);
+    FD_ZERO(&errorSet);
+    FD_SET(fd, &readySet);
+    FD_SET(fd, &errorSet);
+    struct timeval timeout = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+    int ret = select(fd + 1, forRead ? &readySet : NULL, forRead ? NULL : &readySet, &errorSet, (timeout_ms < 0) ? NULL : &timeout);
+    if (ret > 0 && FD_ISSET(fd, &errorSet))
+    {
+        return -1;
+    }
+    return (ret > 0) ? 1 : ret;
+}
+
+static int tls_poll_read(esp_transport_handle_t transport, int timeout_ms)
+{
+    struct TlsResumeContext *context = esp_transport_get_context_data(transport);
+    if (context->tls != NULL && esp_tls_get_bytes_avail(context->tls) > 0)
+    {
+        return 1; // Already decrypted, the socket may have nothing left
+    }
+    return poll_socket(context, true, timeout_ms);
+}
+
+static int tls_poll_write(esp_transport_handle_t transport, int timeout_ms)
+{
+    return poll_socket(esp_transport_get_context_data(transport), false, timeout_ms);
+}
+
+static int tls_close(esp_transport_handle_t transport)
+{
+    struct TlsResumeContext *context = esp_transport_get_context_data(transport);
+    if (context->tls != NULL)
+    {
+        esp_tls_conn_destroy(context->tls);
+        context->tls = NULL;
+    }
+    return 0;
+}
+
+static int tls_connect(esp_transport_handle_t transport, const char *host, int port, int timeout_ms)
+{
+    struct TlsResumeContext *context = esp_transport_get_context_data(transport);
+    tls_close(transport);
+    context->tls = esp_tls_init();
+    if (context->tls == NULL)
+    {
+        return -1;
+    }
+
+    esp_tls_cfg_t config = {
+        .timeout_ms = timeout_ms,
+        .skip_common_name = true,
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        .client_session = context->session,
+#endif
+    };
+    bool resuming = false;
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    resuming = context->session != NULL;
+#endif
+
+    int64_t start = esp_timer_get_time();
+    if (esp_tls_conn_new_sync(host, strlen(host), port, &config, context->tls) <= 0)
+    {
+        ESP_LOGE(LOG_TAG, "Connecting to %s:%d failed", host, port);
+        tls_close(transport);
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        // The offered session may be the reason (e.g. the server restarted), the next attempt does a full handshake
+        if (context->session != NULL)
+        {
+            esp_tls_free_client_session(context->session);
+            context->session = NULL;
+        }
+#endif
+        return -1;
+    }
+    ESP_LOGI(LOG_TAG, "Connected to %s in %" PRId64 " ms (%s)", host, (esp_timer_get_time() - start) / 1000,
+             resuming ? "session offered for resumption" : "full handshake");
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // Keep the newest session, a resumed one may have got a fresh ticket
+    esp_tls_client_session_t *session = esp_tls_get_client_session(context->tls);
+    if (session != NULL)
+    {
+        if (context->session != NULL)
+        {
+            esp_tls_free_client_session(context->session);
+        }
+        context->session = session;
+    }
+#endif
+    return 0;
+}
+
+static int tls_read(esp_transport_handle_t transport, char *buffer, int length, int timeout_ms)
+{
+    struct TlsResumeContext *context = esp_transport_get_context_data(transport);
+    if (context->tls == NULL)
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    if (timeout_ms >= 0 && esp_tls_get_bytes_avail(context->tls) <= 0)
+    {
+        int poll = poll_socket(context, true, timeout_ms);
+        if (poll < 0)
+        {
+            return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+        }
+        if (poll == 0)
+        {
+            return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+        }
+    }
+
+    int ret = esp_tls_conn_read(context->tls, buffer, length);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE)
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret < 0)
+    {
+        ESP_LOGE(LOG_TAG, "Read failed: -0x%x", -ret);
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    if (ret == 0)
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN; // Socket was readable but the server closed it
+    }
+    return ret;
+}
+
+static int tls_write(esp_transport_handle_t transport, const char *buffer, int length, int timeout_ms)
+{
+    struct TlsResumeContext *context = esp_transport_get_context_data(transport);
+    int poll = poll_socket(context, false, timeout_ms);
+    if (poll <= 0)
+    {
+        return poll;
+    }
+    int ret = esp_tls_conn_write(context->tls, buffer, length);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE)
+    {
+        return 0;
+    }
+    if (ret < 0)
+    {
+        ESP_LOGE(LOG_TAG, "Write failed: -0x%x", -ret);
+    }
+    return ret;
+}
+
+static int tls_destroy(esp_transport_handle_t transport)
+{
+    struct TlsResumeContext *context = esp_transport_get_context_data(transport);
+    tls_close(transport);
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (context->session != NULL)
+    {
+        esp_tls_free_client_session(context->session);
+    }
+#endif
+    free(context);
+    return 0;
+}
+
+esp_transport_handle_t tls_resume_transport_init()
+{
+    esp_transport_handle_t transport = esp_transport_init();
+    struct TlsResumeContext *context = calloc(1, sizeof(struct TlsResumeContext));
+    if (transport == NULL || context == NULL)
+    {
+        free(context);
+        if (transport != NULL)
+        {
+            esp_transport_destroy(transport);
+        }
+        return NULL;
+    }
+    esp_transport_set_context_data(transport, context);
+    esp_transport_set_func(transport, tls_connect, tls_read, tls_write, tls_close, tls_poll_read, tls_poll_write, tls_destroy);
+    esp_transport_set_default_port(transport, TLS_DEFAULT_PORT);
+    return transport;
+}
@@ -0,0 +1,13 @@
+#ifndef TLS_RESUME_H_
+#define TLS_RESUME_H_
+
+#include "esp_transport.h"
+
+// TLS transport on top of esp-tls which keeps the session of the last handshake and offers it on the next connect, so
+// that a reconnect needs an abbreviated handshake instead of a full one (needs CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS).
+// Certificates are handled like the stock SSL transport with CONFIG_ESP_TLS_SKIP_SERVER_CERT_VERIFY
+
+// Creates the transport (default port 443). Returns NULL if out of memory
+esp_transport_handle_t tls_resume_transport_init();
+
+#endif // TLS_RESUME_H_
@@ -0,0 +1,178 @@
+#include "view_model.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "display.h"
+#include "console.h"
+
+#define INFO_TEXT_LENGTH 100
+
+// Update counters of a widget, protected by the display lock
+struct WidgetStats
+{
+    uint32_t applied;           // Updates which changed the widget
+    uint32_t skipped;           // Updates with the values already shown
+    uint64_t invalidatedPixels; // Area invalidated by applied updates
+};
+
+static const char *WIDGET_NAMES[VIEW_WIDGET_COUNT] = {"state", "info", "ship"};
+
+static lv_obj_t *stateMarker = NULL;
+static lv_obj_t *infoLabel = NULL;
+
+// Last shown values
+static bool stateShown = false;
+static uint32_t stateColor; // RGB888 as passed to lv_color_hex
+static bool infoShown = false;
+static struct AIS_DATA infoData; // Only name, position and time are used
+static char infoText[INFO_TEXT_LENGTH];
+
+static struct WidgetStats stats[VIEW_WIDGET_COUNT];
+
+// Puts decimal position to a degree position string with N/S or E/W char infront
+static void decimal_to_dms(const double decimal, char *result, const bool isLat)
+{
+    char direction;
+    int degrees;
+    int minutes;
+    double seconds;
+
+    if (isLat)
+    {
+        direction = (decimal >= 0) ? 'N' : 'S';
+    }
+    else
+    {
+        direction = (decimal >= 0) ? 'E' : 'W';
+    }
+
+    double abs_decimal = fabs(decimal);
+    degrees = (int)abs_decimal;
+    double fractional_part = abs_decimal - degrees;
+    minutes = (int)(fractional_part * 60);
+    seconds = (fractional_part * 60 - minutes) * 60;
+    sprintf(result, "%c %d°%02d'%02.0f", direction, degrees, minutes, seconds);
+}
+
+void view_model_count(const enum VIEW_WIDGET widget, const lv_obj_t *obj)
+{
+    if (obj == NULL)
+    {
+        stats[widget].skipped++;
+        return;
+    }
+    stats[widget].applied++;
+    stats[widget].invalidatedPixels += lv_area_get_size(&obj->coords);
+}
+
+void view_model_set_state(const enum WIFI_STATE wifiState, const enum Validity validity)
+{
+    uint32_t color;
+    if (wifiState != CONNECTED)
+    {
+        color = 0x000000; // Black
+    }
+    else
+    {
+        switch (validity)
+        {
+        case NO_CONNECTION:
+            color = 0xFF0000; // Red
+            break;
+        case CONNECTION_BUT_NO_DATA:
+            color = 0xFFA500; // Orange
+            break;
+        case CONNECTION_BUT_CORRUPT_DATA:
+            color = 0xFFFF00; // Yellow
+            break;
+        case VALID:
+            color = 0x00FF00; // Green
+            break;
+        default:
+            color = 0xFFFFFF; // White
+            break;
+        }
+    }
+
+    if (stateShown && color == stateColor)
+    {
+        view_model_count(VIEW_WIDGET_STATE_MARKER, NULL);
+        return;
+    }
+    lv_obj_set_style_bg_color(stateMarker, lv_color_hex(color), 0);
+    stateColor = color;
+    stateShown = true;
+    view_model_count(VIEW_WIDGET_STATE_MARKER, stateMarker);
+}
+
+void view_model_set_ais_data(const struct AIS_DATA *aisData)
+{
+    // Most updates repeat name and time, and the position only changes with the ship moving
+    if (infoShown && aisData->latitude == infoData.latitude && aisData->longitude == infoData.longitude &&
+        strcmp(aisData->shipName, infoData.shipName) == 0 && strcmp(aisData->time_utc, infoData.time_utc) == 0)
+    {
+        view_model_count(VIEW_WIDGET_INFO_LABEL, NULL);
+        return;
+    }
+    infoData = *aisData;
+
+    char latitudeBuffer[20];
+    char longitudeBuffer[20];
+    decimal_to_dms(aisData->latitude, latitudeBuffer, true);
+    decimal_to_dms(aisData->longitude, longitudeBuffer, false);
+
+    char timeBuffer[9]; // HH:MM:SS is 8 characters + 1 for null terminator
+    strncpy(timeBuffer, aisData->time_utc + 11, 8);
+    timeBuffer[8] = '\0';
+
+    // Position changes below a second of arc and dates don't show up in the text
+    char text[INFO_TEXT_LENGTH];
+    snprintf(text, sizeof(text), "%s\n%s\n%s\n%s %s", aisData->shipName, latitudeBuffer, longitudeBuffer, timeBuffer, "UTC");
+    if (infoShown && strcmp(text, infoText) == 0)
+    {
+        view_model_count(VIEW_WIDGET_INFO_LABEL, NULL);
+        return;
+    }
+    lv_label_set_text(infoLabel, text);
+    strcpy(infoText, text);
+    infoShown = true;
+    view_model_count(VIEW_WIDGET_INFO_LABEL, infoLabel);
+}
+
+// Console command: ui [reset]
+static int ui_command(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0)
+    {
+        display_lock();
+        memset(stats, 0, sizeof(stats));
+        display_unlock();
+        return 0;
+    }
+    if (argc != 1)
+    {
+        printf("Usage: ui [reset]\n");
+        return 1;
+    }
+
+    struct WidgetStats copy[VIEW_WIDGET_COUNT];
+    display_lock();
+    memcpy(copy, stats, sizeof(copy));
+    display_unlock();
+
+    printf("%-7s %9s %9s %14s\n", "widget", "applied", "skipped", "invalidated px");
+    for (int widget = 0; widget < VIEW_WIDGET_COUNT; widget++)
+    {
+        printf("%-7s %9" PRIu32 " %9" PRIu32 " %14" PRIu64 "\n", WIDGET_NAMES[widget], copy[widget].applied, copy[widget].skipped,
+               copy[widget].invalidatedPixels);
+    }
+    return 0;
+}
+
+void view_model_init(lv_obj_t *marker, lv_obj_t *label)
+{
+    stateMarker = marker;
+    infoLabel = label;
+    console_register("ui", "Updates of status widgets applied and skipped, and the area they invalidated: ui [reset]", ui_command);
+}
@@ -0,0 +1,32 @@
+#ifndef VIEW_MODEL_H_
+#define VIEW_MODEL_H_
+
+#include "lvgl.h"
+#include "wifi.h"
+#include "aisstream.h"
+
+// Last values shown by the status widgets. LVGL objects are only touched if a value changed, as every change
+// invalidates the widget and LVGL has to blend it over the map again. "ui" on the serial console prints the counters
+
+// Widgets whose updates are counted
+enum VIEW_WIDGET
+{
+    VIEW_WIDGET_STATE_MARKER, // Colored dot showing WiFi and AIS state
+    VIEW_WIDGET_INFO_LABEL,   // Ship's name, position and time
+    VIEW_WIDGET_SHIP_MARKER,  // Own vessel on the map (updated by tile_downloader)
+    VIEW_WIDGET_COUNT
+};
+
+// Binds the widgets created by main and sets up the "ui" console command
+void view_model_init(lv_obj_t *stateMarker, lv_obj_t *infoLabel);
+
+// Shows WiFi and AIS state as color of the state marker. Call with display locked
+void view_model_set_state(const enum WIFI_STATE wifiState, const enum Validity validity);
+
+// Shows ship's name, position and time of the AIS data in the info label. Call with display locked
+void view_model_set_ais_data(const struct AIS_DATA *aisData);
+
+// Counts an update of a widget changed elsewhere. obj is the changed object (its area gets invalidated) or NULL if nothing changed
+void view_model_count(const enum VIEW_WIDGET widget, const lv_obj_t *obj);
+
+#endif // VIEW_MODEL_H_
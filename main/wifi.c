@@ -1,26 +1,153 @@
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "esp_event.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 
 #include "wifi.h"
+#include "app_events.h"
+#include "nvs_wrapper.h"
 
 #define MAX_WIFI_LIST_SIZE 20
+#define CONNECT_TIMEOUT_MS 10000   // wifi_connect gives up waiting after this
+#define SCAN_WAIT_TIMEOUT_MS 10000 // Scan waits this long for a pending connection attempt to finish
+#define CACHED_AP_ATTEMPTS 2       // Failed attempts to the last access point before scanning all channels for the network
+
+#define STATE_BIT(state) (1u << (state)) // Bit of stateBits for a WIFI_STATE
+#define STATE_BITS_ALL (STATE_BIT(SCANNING + 1) - 1)
 
 static const char *TAG = "WiFi";
 static esp_netif_t *sta_netif = NULL;
 
 enum WIFI_STATE currentWiFiState = DISCONNECTED;
 bool tryScan = false; // Indicator that inhibit reconnecting so that wifi-scan can start
+static EventGroupHandle_t stateBits = NULL; // Bit of currentWiFiState is set, for waiting on a state
+static bool usingCachedAp = false;          // Connecting directly to the BSSID/channel of the last connection
+static int cachedApFailures = 0;
+static int64_t connectStartUs = 0; // Start of the current connection attempt (to log how long it took)
 
 enum WIFI_STATE wifi_get_state()
 {
     return currentWiFiState;
 }
 
+// Sets new state and notifies application core
+static void set_wifi_state(const enum WIFI_STATE state)
+{
+    currentWiFiState = state;
+    xEventGroupClearBits(stateBits, STATE_BITS_ALL & ~STATE_BIT(state));
+    xEventGroupSetBits(stateBits, STATE_BIT(state));
+    app_events_post(APP_EVENT_WIFI);
+}
+
+// Starts connecting with the current config
+static void start_connecting()
+{
+    connectStartUs = esp_timer_get_time();
+    esp_wifi_connect();
+}
+
+// Sets config without writing it to flash (used for the BSSID/channel of the last connection, which is stored in nvs_wrapper)
+static esp_err_t set_config_in_ram(wifi_config_t *wifi_config)
+{
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_err_t ret = esp_wifi_set_config(ESP_IF_WIFI_STA, wifi_config);
+    esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+    return ret;
+}
+
+// Makes the saved network get connected directly to the access point of the last connection, skipping the scan of all
+// channels. Returns false if there is none for this network
+static bool use_cached_access_point(wifi_config_t *wifi_config)
+{
+    struct StoredAccessPoint accessPoint;
+    if (get_last_access_point(&accessPoint) != ESP_OK ||
+        strncmp(accessPoint.ssid, (const char *)wifi_config->sta.ssid, sizeof(wifi_config->sta.ssid)) != 0)
+    {
+        return false;
+    }
+    wifi_config->sta.bssid_set = true;
+    memcpy(wifi_config->sta.bssid, accessPoint.bssid, sizeof(wifi_config->sta.bssid));
+    wifi_config->sta.channel = accessPoint.channel;
+    wifi_config->sta.scan_method = WIFI_FAST_SCAN;
+    if (set_config_in_ram(wifi_config) != ESP_OK)
+    {
+        return false;
+    }
+    ESP_LOGI(TAG, "Connecting directly to " MACSTR " on channel %d", MAC2STR(accessPoint.bssid), accessPoint.channel);
+    usingCachedAp = true;
+    cachedApFailures = 0;
+    return true;
+}
+
+// Access point of the last connection didn't answer (switched off, network moved): find the network on all channels again
+static void forget_cached_access_point()
+{
+    wifi_config_t wifi_config;
+    usingCachedAp = false;
+    if (esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config) == ESP_OK)
+    {
+        ESP_LOGW(TAG, "Last access point not reachable, scanning for %s", wifi_config.sta.ssid);
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.channel = 0;
+        set_config_in_ram(&wifi_config);
+    }
+}
+
+// Remembers the access point of a successful connection for the next start
+static void store_connected_access_point(const wifi_event_sta_connected_t *event)
+{
+    struct StoredAccessPoint accessPoint;
+    memset(&accessPoint, 0, sizeof(accessPoint));
+    memcpy(accessPoint.ssid, event->ssid, (event->ssid_len < STORED_SSID_LENGTH) ? event->ssid_len : STORED_SSID_LENGTH - 1);
+    memcpy(accessPoint.bssid, event->bssid, sizeof(accessPoint.bssid));
+    accessPoint.channel = event->channel;
+    store_access_point(&accessPoint);
+}
+
+#if CONFIG_APP_WIFI_STATIC_IP
+// Replaces DHCP by the configured address, so the connection is usable right after associating
+static void set_static_ip()
+{
+    esp_netif_dhcpc_stop(sta_netif);
+    esp_netif_ip_info_t ipInfo = {0};
+    ipInfo.ip.addr = esp_ip4addr_aton(CONFIG_APP_WIFI_STATIC_IP_ADDRESS);
+    ipInfo.netmask.addr = esp_ip4addr_aton(CONFIG_APP_WIFI_STATIC_IP_NETMASK);
+    ipInfo.gw.addr = esp_ip4addr_aton(CONFIG_APP_WIFI_STATIC_IP_GATEWAY);
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(sta_netif, &ipInfo));
+
+    esp_netif_dns_info_t dns = {0};
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    dns.ip.u_addr.ip4.addr = esp_ip4addr_aton(CONFIG_APP_WIFI_STATIC_IP_DNS);
+    ESP_ERROR_CHECK(esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns));
+}
+#endif
+
+// Connects to the saved network (directly to its last access point if known)
+static esp_err_t connect_saved_network()
+{
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config) != ESP_OK || wifi_config.sta.ssid[0] == '\0')
+    {
+        ESP_LOGI(TAG, "Could not load WiFi settings from NVS");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Loaded WiFi settings from NVS with SSID: %s", wifi_config.sta.ssid);
+    if (!usingCachedAp)
+    {
+        use_cached_access_point(&wifi_config);
+    }
+    start_connecting();
+    return ESP_OK;
+}
+
 // Event handler for WiFi and IP events
 static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
@@ -29,34 +156,45 @@ static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_
         if (tryScan)
         {
             ESP_LOGW(TAG, "Starting: Not doing anything. Currently waiting for scan");
-            currentWiFiState = SCANNING;
+            set_wifi_state(SCANNING);
         }
         else
         {
-            currentWiFiState = STARTING;
+            set_wifi_state(STARTING);
             ESP_LOGI(TAG, "WiFi started, connecting...");
-            esp_wifi_connect();
+            connect_saved_network();
         }
     }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED)
+    {
+        const wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)event_data;
+        ESP_LOGI(TAG, "Associated with " MACSTR " after %" PRId64 " ms", MAC2STR(event->bssid), (esp_timer_get_time() - connectStartUs) / 1000);
+        cachedApFailures = 0;
+        store_connected_access_point(event);
+    }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
         if (tryScan)
         {
             ESP_LOGW(TAG, "Disconnected. Not doing anything. Currently waiting for scan");
-            currentWiFiState = SCANNING;
+            set_wifi_state(SCANNING);
         }
         else
         {
-            currentWiFiState = DISCONNECTED;
+            set_wifi_state(DISCONNECTED);
             ESP_LOGI(TAG, "Disconnected from WiFi, attempting to reconnect...");
-            esp_wifi_connect();
+            if (usingCachedAp && ++cachedApFailures >= CACHED_AP_ATTEMPTS)
+            {
+                forget_cached_access_point();
+            }
+            start_connecting();
         }
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
     {
-        currentWiFiState = CONNECTED;
+        set_wifi_state(CONNECTED);
         const ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+        ESP_LOGI(TAG, "Got IP: " IPSTR " (%" PRId64 " ms after start of connecting)", IP2STR(&event->ip_info.ip), (esp_timer_get_time() - connectStartUs) / 1000);
     }
 }
 
@@ -71,6 +209,9 @@ esp_err_t wifi_init()
     }
     ESP_ERROR_CHECK(ret);
 
+    stateBits = xEventGroupCreate();
+    xEventGroupSetBits(stateBits, STATE_BIT(currentWiFiState));
+
     // Initialize the TCP/IP stack
     ESP_ERROR_CHECK(esp_netif_init());
 
@@ -79,6 +220,9 @@ esp_err_t wifi_init()
 
     // Create default WiFi station
     sta_netif = esp_netif_create_default_wifi_sta();
+#if CONFIG_APP_WIFI_STATIC_IP
+    set_static_ip();
+#endif
 
     // Initialize WiFi with default configurations
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -102,9 +246,24 @@ esp_err_t wifi_init()
     return ESP_OK;
 }
 
+// Waits until connected (IP acquired) or timeout elapsed
+static esp_err_t wait_for_connected(const char *ssid)
+{
+    EventBits_t bits = xEventGroupWaitBits(stateBits, STATE_BIT(CONNECTED), pdFALSE, pdTRUE, pdMS_TO_TICKS(CONNECT_TIMEOUT_MS));
+    if (bits & STATE_BIT(CONNECTED))
+    {
+        ESP_LOGI(TAG, "Successfully connected to %s", ssid);
+        return ESP_OK;
+    }
+    ESP_LOGW(TAG, "Could not connect to %s", ssid);
+    esp_wifi_disconnect();
+    return ESP_FAIL;
+}
+
 esp_err_t wifi_connect(wifi_config_t *wifi_config, bool wait_for_connection)
 {
     esp_wifi_disconnect();
+    usingCachedAp = false; // New network is looked for on all channels
     esp_err_t ret = esp_wifi_set_config(ESP_IF_WIFI_STA, wifi_config);
     if (ret != ESP_OK)
     {
@@ -112,49 +271,23 @@ esp_err_t wifi_connect(wifi_config_t *wifi_config, bool wait_for_connection)
         return ret;
     }
 
-    esp_wifi_connect();
-
-    if (wait_for_connection)
-    {
-        // Allow time for connection to establish and IP to be acquired
-        for (int i = 0; i < 5; i++)
-        {
-            // TODO maybe wait for event bits instead?
-            if (currentWiFiState == CONNECTED)
-            {
-                ESP_LOGI(TAG, "Successfully connected to %s", wifi_config->sta.ssid);
-                return ESP_OK;
-            }
-            else
-            {
-                ESP_LOGI(TAG, "Waiting for connection...");
-                vTaskDelay(2000 / portTICK_PERIOD_MS); // Adjust delay as needed
-            }
-        }
-        ESP_LOGW(TAG, "Could not connect to %s", wifi_config->sta.ssid);
-        esp_wifi_disconnect();
-        return ESP_FAIL;
-    }
-    else
-    {
-        return ESP_OK;
-    }
+    set_wifi_state(STARTING); // Previous connection doesn't count while waiting
+    start_connecting();
+    return wait_for_connection ? wait_for_connected((const char *)wifi_config->sta.ssid) : ESP_OK;
 }
 
 esp_err_t wifi_connect_last_saved(bool wait_for_connection)
 {
-    wifi_config_t wifi_configOrig;
-
-    if (esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_configOrig) == ESP_OK)
-    {
-        ESP_LOGI(TAG, "Loaded WiFi settings from NVS with SSID: %s", wifi_configOrig.sta.ssid);
-        return wifi_connect(&wifi_configOrig, wait_for_connection);
-    }
-    else
+    esp_wifi_disconnect();
+    set_wifi_state(STARTING);
+    esp_err_t ret = connect_saved_network();
+    if (ret != ESP_OK || !wait_for_connection)
     {
-        ESP_LOGI(TAG, "Could not load WiFi settings from NVS");
-        return ESP_FAIL;
+        return ret;
     }
+    wifi_config_t wifi_config;
+    esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config);
+    return wait_for_connected((const char *)wifi_config.sta.ssid);
 }
 
 wifi_ap_record_t wifi_list[MAX_WIFI_LIST_SIZE];
@@ -164,12 +297,13 @@ esp_err_t wifi_scan_networks(uint16_t *amount_networks_found, wifi_ap_record_t *
     ESP_LOGI(TAG, "Starting WiFi scan...");
     esp_err_t retVal = ESP_OK;
     tryScan = true;
-    // If its connected or scanning, ignore this waiting loop
-    while (!((currentWiFiState == CONNECTED) || (currentWiFiState == SCANNING)))
+    // Wait until connected or the pending connection attempt gave up
+    EventBits_t bits = xEventGroupWaitBits(stateBits, STATE_BIT(CONNECTED) | STATE_BIT(SCANNING), pdFALSE, pdFALSE, pdMS_TO_TICKS(SCAN_WAIT_TIMEOUT_MS));
+    if (!(bits & (STATE_BIT(CONNECTED) | STATE_BIT(SCANNING))))
     {
-        ESP_LOGI(TAG, "Waiting for wifi state");
-        vTaskDelay(100 / portTICK_PERIOD_MS);
-        // TODO timeout?
+        ESP_LOGE(TAG, "Timeout waiting for wifi state");
+        tryScan = false;
+        return ESP_ERR_TIMEOUT;
     }
     wifi_scan_config_t scan_config = {
         .ssid = NULL,
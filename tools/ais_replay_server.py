@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Local stand-in for the aisstream.io WebSocket which replays a captured session.
+
+Capture a session by enabling CONFIG_AIS_CAPTURE and saving the monitor output, e.g.:
+    idf.py monitor | tee capture.log
+
+Then point CONFIG_AIS_STREAM_URI to this server (ws://<host>:<port>) and run:
+    python3 tools/ais_replay_server.py capture.log            # Original timing (1x)
+    python3 tools/ais_replay_server.py capture.log --speed 0  # As fast as possible
+
+The device's statistics (CONFIG_AIS_STREAM_STATS) then report messages/sec, parse latency and allocations.
+"""
+
+import argparse
+import asyncio
+import json
+import time
+
+import websockets
+
+CAPTURE_MARKER = "AISCAP\t"
+
+
+def load_capture(path):
+    """Returns list of (timestamp_us, payload) of all captured messages in given log file."""
+    messages = []
+    with open(path, encoding="utf-8", errors="replace") as file:
+        for line in file:
+            start = line.find(CAPTURE_MARKER)
+            if start < 0:
+                continue  # Other log output
+            fields = line[start + len(CAPTURE_MARKER):].rstrip("\r\n").split("\t", 1)
+            if len(fields) != 2:
+                continue
+            messages.append((int(fields[0]), fields[1]))
+    return messages
+
+
+async def replay(websocket, messages, speed, loop):
+    # Like aisstream: wait for the subscription first
+    subscription = await websocket.recv()
+    try:
+        print("Subscription: %s" % json.dumps(json.loads(subscription)))
+    except ValueError:
+        print("Invalid subscription: %s" % subscription)
+
+    while True:
+        start = time.monotonic()
+        first_timestamp = messages[0][0]
+        for timestamp, payload in messages:
+            if speed > 0:
+                due = start + (timestamp - first_timestamp) / 1e6 / speed
+                delay = due - time.monotonic()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+            await websocket.send(payload)
+
+        duration = time.monotonic() - start
+        print("Replayed %d messages in %.2f s (%.1f msg/s)" % (len(messages), duration, len(messages) / max(duration, 1e-6)))
+        if not loop:
+            break
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="Monitor log containing AISCAP lines")
+    parser.add_argument("--host", default="0.0.0.0", help="Address to listen on")
+    parser.add_argument("--port", type=int, default=8765, help="Port to listen on")
+    parser.add_argument("--speed", type=float, default=1.0, help="Replay speed factor (0 = as fast as possible)")
+    parser.add_argument("--loop", action="store_true", help="Replay endlessly")
+    args = parser.parse_args()
+
+    messages = load_capture(args.capture)
+    if not messages:
+        raise SystemExit("No AISCAP lines found in %s" % args.capture)
+    print("Loaded %d messages spanning %.1f s" % (len(messages), (messages[-1][0] - messages[0][0]) / 1e6))
+
+    async def handler(websocket, *_):
+        print("Client connected: %s" % (websocket.remote_address,))
+        try:
+            await replay(websocket, messages, args.speed, args.loop)
+        except websockets.ConnectionClosed:
+            print("Client disconnected")
+
+    async with websockets.serve(handler, args.host, args.port):
+        print("Listening on ws://%s:%d" % (args.host, args.port))
+        await asyncio.Future()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""Tile proxy for the local network which serves OpenStreetMap tiles ready for the display.
+
+Tiles are fetched from tile.openstreetmap.org once, converted to RGB565 (lv_color_t) and run length encoded
+(format see main/tile_rle.h), so the device copies them into its tile buffers instead of inflating PNGs.
+Converted tiles are cached on disk and shared by all displays using the proxy.
+
+Enable CONFIG_TILE_PROXY, set CONFIG_TILE_PROXY_HOST to this computer and run:
+    python3 tools/tile_proxy.py --cache-dir ~/.cache/whereismyboat-tiles
+
+Requires Pillow (pip install pillow).
+"""
+
+import argparse
+import io
+import os
+import re
+import struct
+import threading
+import urllib.request
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+from PIL import Image
+
+UPSTREAM_URL = "https://tile.openstreetmap.org/%d/%d/%d.png"
+USER_AGENT = "WhereIsMyBoat-TileProxy/1.0"
+TILE_SIZE = 256
+MAGIC = b"R565"
+MAX_PACKET = 128
+TILE_PATH = re.compile(r"^/(\d+)/(\d+)/(\d+)\.rle$")
+
+
+def to_rgb565(image):
+    """Returns the pixels of a tile as list of RGB565 values (like main/tile_decoder.c)."""
+    image = image.convert("RGB")
+    if image.size != (TILE_SIZE, TILE_SIZE):
+        image = image.resize((TILE_SIZE, TILE_SIZE))
+    return [((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3) for r, g, b in image.getdata()]
+
+
+def encode_rle(pixels):
+    """Encodes RGB565 pixels: control byte c < 0x80 is followed by c + 1 literal pixels, c >= 0x80 by one pixel repeated
+    (c & 0x7F) + 1 times. Pixels are little endian."""
+    out = bytearray(MAGIC)
+    literals = []
+    index = 0
+    count = len(pixels)
+
+    def flush_literals():
+        for start in range(0, len(literals), MAX_PACKET):
+            chunk = literals[start:start + MAX_PACKET]
+            out.append(len(chunk) - 1)
+            out.extend(struct.pack("<%dH" % len(chunk), *chunk))
+        literals.clear()
+
+    while index < count:
+        pixel = pixels[index]
+        run = 1
+        while index + run < count and run < MAX_PACKET and pixels[index + run] == pixel:
+            run += 1
+        if run >= 2:
+            flush_literals()
+            out.append(0x80 | (run - 1))
+            out.extend(struct.pack("<H", pixel))
+        else:
+            literals.append(pixel)
+        index += run
+    flush_literals()
+    return bytes(out)
+
+
+class TileStore:
+    """Converted tiles in memory and (optionally) on disk."""
+
+    def __init__(self, cache_dir, upstream):
+        self.cache_dir = cache_dir
+        self.upstream = upstream
+        self.memory = {}
+        self.lock = threading.Lock()
+        self.hits = 0
+        self.misses = 0
+
+    def _path(self, zoom, x, y):
+        return os.path.join(self.cache_dir, str(zoom), str(x), "%d.rle" % y)
+
+    def get(self, zoom, x, y):
+        key = (zoom, x, y)
+        with self.lock:
+            tile = self.memory.get(key)
+        if tile is None and self.cache_dir:
+            try:
+                with open(self._path(zoom, x, y), "rb") as file:
+                    tile = file.read()
+            except OSError:
+                pass
+
+        if tile is not None:
+            self.hits += 1
+        else:
+            self.misses += 1
+            request = urllib.request.Request(self.upstream % (zoom, x, y), headers={"User-Agent": USER_AGENT})
+            with urllib.request.urlopen(request, timeout=10) as response:
+                png = response.read()
+            tile = encode_rle(to_rgb565(Image.open(io.BytesIO(png))))
+            if self.cache_dir:
+                path = self._path(zoom, x, y)
+                os.makedirs(os.path.dirname(path), exist_ok=True)
+                with open(path + ".tmp", "wb") as file:
+                    file.write(tile)
+                os.replace(path + ".tmp", path)
+            print("Converted %d/%d/%d: PNG %d bytes -> RLE %d bytes" % (zoom, x, y, len(png), len(tile)))
+
+        with self.lock:
+            self.memory[key] = tile
+        return tile
+
+
+def make_handler(store):
+    class TileHandler(BaseHTTPRequestHandler):
+        def do_GET(self):
+            match = TILE_PATH.match(self.path)
+            if not match:
+                self.send_error(404)
+                return
+            zoom, x, y = (int(value) for value in match.groups())
+            if zoom > 22 or x >= (1 << zoom) or y >= (1 << zoom):
+                self.send_error(404)
+                return
+            try:
+                tile = store.get(zoom, x, y)
+            except Exception as error:  # Upstream unreachable or invalid PNG
+                print("Failed to get %d/%d/%d: %s" % (zoom, x, y, error))
+                self.send_error(502)
+                return
+            self.send_response(200)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Content-Length", str(len(tile)))
+            self.end_headers()
+            self.wfile.write(tile)
+
+        def log_message(self, format, *args):
+            pass  # Conversions are printed instead
+
+    return TileHandler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="0.0.0.0", help="Interface to listen on")
+    parser.add_argument("--port", type=int, default=8766, help="Port to listen on (CONFIG_TILE_PROXY_PORT)")
+    parser.add_argument("--cache-dir", help="Directory to keep converted tiles in (only in memory if omitted)")
+    parser.add_argument("--upstream", default=UPSTREAM_URL, help="Tile URL template (zoom, x, y)")
+    args = parser.parse_args()
+
+    store = TileStore(args.cache_dir, args.upstream)
+    server = ThreadingHTTPServer((args.host, args.port), make_handler(store))
+    print("Serving tiles on http://%s:%d/<zoom>/<x>/<y>.rle" % (args.host, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        print("%d hits, %d conversions" % (store.hits, store.misses))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Turns the tile pipeline trace of the device into a timeline.
+
+Enable CONFIG_APP_TILE_TRACE, let the map load and run "tiletrace dump" on the serial console while saving the monitor output:
+    idf.py monitor | tee trace.log
+
+Then:
+    python3 tools/tile_trace_timeline.py trace.log                      # Text timeline and per-stage summary
+    python3 tools/tile_trace_timeline.py trace.log --chrome trace.json  # Additionally for chrome://tracing or ui.perfetto.dev
+"""
+
+import argparse
+import json
+import struct
+
+TRACE_MARKER = "TILETRACE\t"
+TRACE_VERSION = 1
+STAGES = ["dns", "connect", "request", "first byte", "body", "decode", "shown"]
+# struct TileTraceRecord in main/tile_trace.c
+RECORD_FORMAT = "<qIIIBBH%dI" % len(STAGES)
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+
+def load_trace(path):
+    """Returns list of records (dicts) found in given log file, ordered by start time. Duplicates of repeated dumps are dropped."""
+    records = {}
+    with open(path, encoding="utf-8", errors="replace") as file:
+        for line in file:
+            start = line.find(TRACE_MARKER)
+            if start < 0:
+                continue  # Other log output
+            fields = line[start + len(TRACE_MARKER):].strip().split("\t")
+            if len(fields) != 2 or int(fields[0]) != TRACE_VERSION:
+                continue
+            data = bytes.fromhex(fields[1])
+            if len(data) != RECORD_SIZE:
+                continue
+            start_us, x, y, size, zoom, failed, _, *stage_us = struct.unpack(RECORD_FORMAT, data)
+            records[start_us] = {"start_us": start_us, "zoom": zoom, "x": x, "y": y, "bytes": size, "failed": bool(failed), "stage_us": stage_us}
+    return [records[key] for key in sorted(records)]
+
+
+def stage_durations(record):
+    """Returns list of (stage name, begin offset, duration) of all stages the record reached (in us, relative to its start)."""
+    durations = []
+    previous = 0
+    for name, offset in zip(STAGES, record["stage_us"]):
+        if offset:
+            durations.append((name, previous, offset - previous))
+            previous = offset
+    return durations
+
+
+def print_timeline(records):
+    first = records[0]["start_us"]
+    print("%10s  %-20s %7s  %s" % ("start ms", "tile", "bytes", "stages (ms)"))
+    for record in records:
+        stages = "  ".join("%s %.1f" % (name, duration / 1000) for name, _, duration in stage_durations(record))
+        tile = "%d/%d/%d" % (record["zoom"], record["x"], record["y"])
+        print("%10.1f  %-20s %7d  %s%s" % ((record["start_us"] - first) / 1000, tile, record["bytes"], stages, "  FAILED" if record["failed"] else ""))
+
+
+def print_summary(records):
+    print("\n%-11s %6s %9s %9s %9s (ms)" % ("stage", "count", "median", "p90", "max"))
+    for stage in STAGES:
+        values = sorted(duration for record in records for name, _, duration in stage_durations(record) if name == stage)
+        if values:
+            print("%-11s %6d %9.1f %9.1f %9.1f" % (stage, len(values), values[len(values) // 2] / 1000, values[min(len(values) - 1, len(values) * 9 // 10)] / 1000, values[-1] / 1000))
+    failed = sum(record["failed"] for record in records)
+    span = (records[-1]["start_us"] + max(records[-1]["stage_us"]) - records[0]["start_us"]) / 1e6
+    print("%d tiles (%d failed) in %.2f s" % (len(records), failed, span))
+
+
+def write_chrome_trace(records, path):
+    """Writes Trace Event Format (one row, one slice per stage, nested in one slice per tile)."""
+    events = []
+    for record in records:
+        tile = "%d/%d/%d" % (record["zoom"], record["x"], record["y"])
+        total = max(record["stage_us"])
+        events.append({"name": tile, "ph": "X", "pid": 1, "tid": 1, "ts": record["start_us"], "dur": total,
+                       "args": {"bytes": record["bytes"], "failed": record["failed"]}})
+        for name, begin, duration in stage_durations(record):
+            events.append({"name": name, "ph": "X", "pid": 1, "tid": 1, "ts": record["start_us"] + begin, "dur": duration})
+    with open(path, "w", encoding="utf-8") as file:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, file)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="Monitor log containing TILETRACE lines")
+    parser.add_argument("--chrome", metavar="JSON", help="Also write a trace for chrome://tracing / Perfetto")
+    args = parser.parse_args()
+
+    records = load_trace(args.log)
+    if not records:
+        raise SystemExit("No TILETRACE lines found in %s" % args.log)
+    print_timeline(records)
+    print_summary(records)
+    if args.chrome:
+        write_chrome_trace(records, args.chrome)
+        print("Wrote %s" % args.chrome)
+
+
+if __name__ == "__main__":
+    main()